@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../src/inc/chip8.h"
+#include "../src/inc/chip8_cache.h"
+#include "../src/inc/chip8_state.h"
+#include "../tools/common.h"
+
+#define PASSES 64
+#define FRAMES 1200
+#define BUDGET (8u << 20u)
+
+/***
+ * Every pass replays the same input prefix and branches off at a different frame, the
+ * way a search over inputs revisits the same states.
+ */
+static uint16_t
+keys_for(uint32_t pass, uint32_t frame)
+{
+    uint32_t x = frame < pass * (FRAMES / PASSES) ? frame : frame * 2654435761u + pass;
+    return (x / 37) % 5 == 0 ? (uint16_t)(1u << ((x / 11) % 16)) : 0;
+}
+
+static struct chip8_hash
+run(const uint8_t *rom, uint32_t size, struct chip8_cache *cache, double *elapsed)
+{
+    uint16_t keyboard = 0;
+    struct chip8 *chip8 = chip8_init(&keyboard);
+    struct chip8_hash digest = {0, 0};
+
+    double start = now();
+    for (uint32_t pass = 0; pass < PASSES; pass++) {
+        chip8_reset(chip8, 1);
+        chip8_load_program(chip8, rom, size);
+        for (uint32_t frame = 0; frame < FRAMES; frame++) {
+            keyboard = keys_for(pass, frame);
+            if (cache) {
+                chip8_cache_step(cache, chip8);
+            } else {
+                chip8_step(chip8);
+            }
+        }
+        struct chip8_hash hash = chip8_state_hash(chip8);
+        digest.low ^= hash.low;
+        digest.high += hash.high;
+    }
+    *elapsed = now() - start;
+
+    chip8_free(chip8);
+    return digest;
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        puts("Usage: chip8_cache_bench /path/to/rom");
+        exit(EXIT_FAILURE);
+    }
+
+    uint8_t rom[ROM_SIZE];
+    uint32_t size = read_rom(argv[1], rom);
+    struct chip8_cache *cache = chip8_cache_init(BUDGET);
+    struct chip8_cache_stats stats;
+    double plain, cached;
+
+    struct chip8_hash expected = run(rom, size, NULL, &plain);
+    struct chip8_hash actual = run(rom, size, cache, &cached);
+    chip8_cache_get_stats(cache, &stats);
+
+    printf("plain  %10.0f frames/s\n", PASSES * FRAMES / plain);
+    printf("cached %10.0f frames/s  hits %llu  misses %llu  uncacheable %llu  evictions %llu  entries %u/%u\n",
+           PASSES * FRAMES / cached, (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+           (unsigned long long)stats.uncacheable, (unsigned long long)stats.evictions, stats.entries,
+           stats.capacity);
+    printf("states %s\n", chip8_hash_equal(expected, actual) ? "match" : "DIFFER");
+
+    chip8_cache_free(cache);
+    return chip8_hash_equal(expected, actual) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
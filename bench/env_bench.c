@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../src/inc/chip8_env.h"
+#include "../tools/common.h"
+
+#define ENVS 256
+#define STEPS 500
+
+static uint64_t
+run(const uint8_t *rom, uint32_t size, uint16_t threads, double *elapsed)
+{
+    static uint8_t observations[ENVS * 64 * 32];
+    static uint16_t actions[ENVS];
+    static float rewards[ENVS];
+    static bool dones[ENVS];
+    struct chip8_env_config config = {
+        .envs = ENVS,
+        .threads = threads,
+        .frame_skip = 4,
+        .max_frames = 2000,
+        .observation = ENV_OBSERVATION_BITPLANE,
+    };
+
+    struct chip8_env *env = chip8_env_init(rom, size, &config);
+    chip8_env_reset(env, 42, observations);
+
+    uint64_t checksum = 0;
+    uint32_t action = 1;
+    double start = now();
+    for (int step = 0; step < STEPS; step++) {
+        for (int i = 0; i < ENVS; i++) {
+            action = action * 1103515245u + 12345u;
+            actions[i] = (uint16_t)(1u << ((action >> 16u) & 0x0fu));
+        }
+        chip8_env_step(env, actions, ENVS, observations, rewards, dones);
+        for (size_t i = 0; i < sizeof(observations); i += 8) {
+            checksum = checksum * 31 + observations[i];
+        }
+    }
+    *elapsed = now() - start;
+
+    chip8_env_free(env);
+    return checksum;
+}
+
+/***
+ * A machine that faults is halted, so its episode has to end there and restart on the next
+ * step, even without max_frames or a done hook. The ROM returns with an empty stack.
+ */
+static bool
+faults_end_episodes(void)
+{
+    static const uint8_t rom[] = {0x00, 0xee};
+    static uint8_t observations[ENVS * 64 * 32];
+    static uint16_t actions[ENVS];
+    static float rewards[ENVS];
+    static bool dones[ENVS];
+    struct chip8_env_config config = {
+        .envs = ENVS,
+        .threads = 1,
+        .frame_skip = 4,
+        .observation = ENV_OBSERVATION_BITPLANE,
+    };
+
+    struct chip8_env *env = chip8_env_init(rom, sizeof(rom), &config);
+    chip8_env_reset(env, 42, observations);
+    bool ok = true;
+    for (int step = 0; step < 3; step++) {
+        chip8_env_step(env, actions, ENVS, observations, rewards, dones);
+        for (int i = 0; i < ENVS; i++) {
+            ok = ok && dones[i];
+        }
+    }
+    chip8_env_free(env);
+    return ok;
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        puts("Usage: chip8_env_bench /path/to/rom");
+        exit(EXIT_FAILURE);
+    }
+
+    uint8_t rom[ROM_SIZE];
+    uint32_t size = read_rom(argv[1], rom);
+    const uint16_t threads[] = {1, 0};
+
+    for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+        double elapsed;
+        uint64_t checksum = run(rom, size, threads[i], &elapsed);
+        char label[8] = "all";
+        if (threads[i]) {
+            snprintf(label, sizeof(label), "%u", threads[i]);
+        }
+        printf("threads %-4s %10.0f env steps/s  checksum %016llx\n", label, ENVS * STEPS / elapsed,
+               (unsigned long long)checksum);
+    }
+
+    bool ok = faults_end_episodes();
+    printf("faults %s\n", ok ? "end episodes" : "DO NOT END EPISODES");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
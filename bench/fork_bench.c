@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../src/inc/chip8.h"
+#include "../src/inc/chip8_memory.h"
+#include "../src/inc/chip8_state.h"
+#include "../tools/common.h"
+
+#define WARMUP_FRAMES 600
+#define BRANCHES 20000
+
+static const uint32_t rollouts[] = {0, 1, 10, 60};
+
+static uint16_t
+branch_keys(uint32_t branch, uint32_t frame)
+{
+    return (uint16_t)(1u << ((branch * 7 + frame / 5) % 16));
+}
+
+/***
+ * Branch the machine BRANCHES times, run every branch for some frames on its own keys and
+ * throw it away, the way a tree search expands nodes.
+ * @param fork - share memory copy-on-write instead of copying the whole state
+ * @param hash - combined hash of every branch's final state
+ */
+static double
+branch(struct chip8 *root, uint32_t frames, bool fork, uint64_t *hash, uint64_t *copied)
+{
+    static struct chip8_state state;
+    uint16_t keyboard = 0;
+
+    *hash = 0;
+    *copied = 0;
+    double start = now();
+    for (uint32_t i = 0; i < BRANCHES; i++) {
+        struct chip8 *child;
+        if (fork) {
+            child = chip8_fork(root, &keyboard);
+        } else {
+            child = chip8_init(&keyboard);
+            chip8_state_save(root, &state);
+            chip8_state_load(child, &state);
+        }
+        for (uint32_t frame = 0; frame < frames; frame++) {
+            keyboard = branch_keys(i, frame);
+            chip8_step(child);
+        }
+        if (frames) {
+            *hash ^= chip8_state_hash(child).low + i;
+        }
+        *copied += child->memory->copied;
+        chip8_free(child);
+    }
+    return (now() - start) / BRANCHES;
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        puts("Usage: chip8_fork_bench /path/to/rom...");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 1; i < argc; i++) {
+        uint8_t rom[ROM_SIZE];
+        uint32_t size = read_rom(argv[i], rom);
+        uint16_t keyboard = 0;
+        struct chip8 *root = chip8_init(&keyboard);
+
+        chip8_reset(root, 1);
+        chip8_load_program(root, rom, size);
+        for (uint32_t frame = 0; frame < WARMUP_FRAMES; frame++) {
+            keyboard = bench_keys(frame);
+            chip8_step(root);
+        }
+
+        printf("%s\n", argv[i]);
+        for (size_t j = 0; j < sizeof(rollouts) / sizeof(rollouts[0]); j++) {
+            uint64_t copy_hash, fork_hash, copy_pages, fork_pages;
+            double copy = branch(root, rollouts[j], false, &copy_hash, &copy_pages);
+            double fork = branch(root, rollouts[j], true, &fork_hash, &fork_pages);
+            printf("  %3u frames  copy %8.0f ns  fork %8.0f ns  %5.2fx  %5.2f of %u pages copied%s\n", rollouts[j],
+                   copy * 1e9, fork * 1e9, copy / fork, (double)fork_pages / BRANCHES, MEMORY_PAGES,
+                   copy_hash == fork_hash ? "" : "  STATES DIFFER");
+        }
+        chip8_free(root);
+    }
+    return EXIT_SUCCESS;
+}
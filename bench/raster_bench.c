@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../src/inc/chip8_raster.h"
+#include "../src/inc/chip8_display.h"
+#include "../tools/common.h"
+
+#define FRAMES 2000
+
+static const char *kernel_names[] = {"scalar", "sse2", "avx2"};
+
+static void
+fill_display(uint64_t *display)
+{
+    uint64_t seed = 0x9e3779b97f4a7c15u;
+    for (uint8_t row = 0; row < DISPLAY_HEIGHT; row++) {
+        seed ^= seed << 13u;
+        seed ^= seed >> 7u;
+        seed ^= seed << 17u;
+        display[row] = seed;
+    }
+}
+
+static void
+bench(const struct chip8_raster *raster, const uint64_t *display)
+{
+    uint16_t width = chip8_raster_width(raster);
+    uint16_t height = chip8_raster_height(raster);
+    uint32_t *pixels = malloc(width * height * sizeof(*pixels));
+    if (pixels == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+
+    chip8_raster_draw(raster, display, pixels, width * sizeof(*pixels));
+    double start = now();
+    for (int i = 0; i < FRAMES; i++) {
+        chip8_raster_draw(raster, display, pixels, width * sizeof(*pixels));
+    }
+    double elapsed = now() - start;
+
+    printf("%-8s %-8s %5u %4ux%-4u %10.2f us/frame %8.1f Mpix/s\n",
+           kernel_names[raster->kernel], raster->filter == RASTER_FILTER_SCALE2X ? "scale2x" : "none",
+           raster->scale, width, height, elapsed / FRAMES * 1e6, (double)width * height * FRAMES / elapsed / 1e6);
+    free(pixels);
+}
+
+int
+main(void)
+{
+    uint64_t display[DISPLAY_HEIGHT];
+    const uint8_t scales[] = {1, 2, 4, 10, 20};
+
+    fill_display(display);
+    printf("%-8s %-8s %5s %9s %21s\n", "kernel", "filter", "scale", "size", "cost");
+
+    for (int filter = RASTER_FILTER_NONE; filter <= RASTER_FILTER_SCALE2X; filter++) {
+        for (size_t s = 0; s < sizeof(scales) / sizeof(scales[0]); s++) {
+            struct chip8_raster raster;
+            if (!chip8_raster_init(&raster, scales[s], filter, 0xffffffffu, 0xff202020u)) {
+                continue;
+            }
+            enum chip8_raster_kernel best = raster.kernel;
+            for (int kernel = RASTER_KERNEL_SCALAR; kernel <= (int)best; kernel++) {
+                raster.kernel = kernel;
+                bench(&raster, display);
+            }
+        }
+    }
+    return 0;
+}
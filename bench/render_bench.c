@@ -0,0 +1,204 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/inc/chip8.h"
+#include "../src/inc/chip8_frames.h"
+#include "../tools/common.h"
+
+#define SECONDS 5
+#define FRAME_NS (1000000000ull / FRAMES_PER_SECOND)
+#define VBLANK_PHASE_NS 5000000ull      /* Refresh is not in step with emulation */
+#define STALL_EVERY 45                  /* Presents between two compositor stalls */
+#define STALL_NS 35000000ull
+#define SAMPLES (SECONDS * FRAMES_PER_SECOND * 4)
+#define PUBLISHED 8                     /* Publish times kept, by frame sequence */
+
+struct samples {
+    double values[SAMPLES];
+    uint32_t count;
+};
+
+struct run {
+    struct chip8 *chip8;
+    uint16_t *keyboard;
+    bool split;
+    uint64_t start;
+    uint64_t end;
+    struct chip8_frames frames;
+    sem_t ready;
+    uint32_t presents;
+    uint64_t published[PUBLISHED];
+    struct samples lateness;        /* Emulated frame started after its deadline, ms */
+    struct samples intervals;       /* Between two presents, ms */
+    struct samples age;             /* Frame published until presented, ms */
+};
+
+static void
+sleep_until(uint64_t deadline)
+{
+    struct timespec ts = {deadline / 1000000000u, deadline % 1000000000u};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) {
+    }
+}
+
+static void
+sample(struct samples *samples, uint64_t ns)
+{
+    if (samples->count < SAMPLES) {
+        samples->values[samples->count++] = ns / 1e6;
+    }
+}
+
+static int
+compare(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void
+print_samples(const char *name, struct samples *samples)
+{
+    if (samples->count == 0) {
+        printf("  %-10s -\n", name);
+        return;
+    }
+    qsort(samples->values, samples->count, sizeof(double), compare);
+    printf("  %-10s p50 %6.2f  p99 %6.2f  max %6.2f ms\n", name, samples->values[samples->count / 2],
+           samples->values[samples->count * 99 / 100], samples->values[samples->count - 1]);
+}
+
+/***
+ * Stand-in for SDL_RenderPresent with vsync: blocks until the next refresh, and now and then
+ * for a lot longer while the compositor is busy.
+ */
+static void
+present(struct run *run)
+{
+    uint64_t t = now_ns() - run->start + FRAME_NS - VBLANK_PHASE_NS;
+    uint64_t vblank = run->start + VBLANK_PHASE_NS + t / FRAME_NS * FRAME_NS;
+    if (++run->presents % STALL_EVERY == 0) {
+        vblank += STALL_NS;
+    }
+    sleep_until(vblank);
+}
+
+static void
+presented(struct run *run, uint64_t *last, uint64_t published)
+{
+    uint64_t t = now_ns();
+    if (*last) {
+        sample(&run->intervals, t - *last);
+    }
+    sample(&run->age, t - published);
+    *last = t;
+}
+
+static void *
+render_main(void *data)
+{
+    struct run *run = data;
+    uint64_t last = 0;
+    while (now_ns() < run->end) {
+        struct timespec timeout;
+        clock_gettime(CLOCK_REALTIME, &timeout);
+        timeout.tv_nsec += 100000000;
+        timeout.tv_sec += timeout.tv_nsec / 1000000000;
+        timeout.tv_nsec %= 1000000000;
+        if (sem_timedwait(&run->ready, &timeout) != 0) {
+            continue;
+        }
+        const struct chip8_frame *frame = chip8_frames_acquire(&run->frames);
+        if (frame == NULL) {
+            continue;
+        }
+        uint64_t published = run->published[frame->sequence % PUBLISHED];
+        present(run);
+        presented(run, &last, published);
+    }
+    return NULL;
+}
+
+/***
+ * Emulate at 60 Hz on absolute deadlines, catching up on frames a stall made late, and
+ * present either in line like the old frontend loop or through the triple buffer.
+ */
+static void
+emulate(struct run *run)
+{
+    pthread_t renderer;
+    uint64_t last = 0;
+    run->start = now_ns();
+    run->end = run->start + SECONDS * 1000000000ull;
+    if (run->split) {
+        chip8_frames_init(&run->frames);
+        sem_init(&run->ready, 0, 0);
+        if (pthread_create(&renderer, NULL, render_main, run)) {
+            puts("Error creating thread!");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (uint64_t frame = 1; run->start + frame * FRAME_NS < run->end; frame++) {
+        uint64_t deadline = run->start + frame * FRAME_NS;
+        sleep_until(deadline);
+        sample(&run->lateness, now_ns() - deadline);
+
+        *run->keyboard = bench_keys(frame);
+        chip8_step(run->chip8);
+        uint64_t published = now_ns();
+        if (run->split) {
+            run->published[(run->frames.sequence + 1) % PUBLISHED] = published;
+            chip8_frames_publish(&run->frames, run->chip8->display);
+            int waiting;
+            if (sem_getvalue(&run->ready, &waiting) == 0 && waiting == 0) {
+                sem_post(&run->ready);
+            }
+        } else if (now_ns() < deadline + FRAME_NS) {
+            /* Behind schedule the old loop ran the missed frames first and presented once */
+            present(run);
+            presented(run, &last, published);
+        }
+    }
+
+    if (run->split) {
+        pthread_join(renderer, NULL);
+        sem_destroy(&run->ready);
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        puts("Usage: chip8_render_bench /path/to/rom");
+        exit(EXIT_FAILURE);
+    }
+
+    uint8_t rom[ROM_SIZE];
+    uint32_t size = read_rom(argv[1], rom);
+    for (int split = 0; split < 2; split++) {
+        static struct run run;
+        uint16_t keyboard = 0;
+        memset(&run, 0, sizeof(run));
+        run.chip8 = chip8_init(&keyboard);
+        run.keyboard = &keyboard;
+        run.split = split;
+        chip8_reset(run.chip8, 1);
+        chip8_load_program(run.chip8, rom, size);
+
+        emulate(&run);
+        printf("%s, %u presents in %d s\n", split ? "render thread" : "one thread", run.presents, SECONDS);
+        print_samples("lateness", &run.lateness);
+        print_samples("present", &run.intervals);
+        print_samples("age", &run.age);
+        chip8_free(run.chip8);
+    }
+    return EXIT_SUCCESS;
+}
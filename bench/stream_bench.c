@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/inc/chip8.h"
+#include "../src/inc/chip8_display.h"
+#include "../src/inc/chip8_registers.h"
+#include "../src/inc/chip8_stream.h"
+#include "../tools/common.h"
+
+#define FRAMES 3600
+#define SUBSCRIBERS 1000
+#define LATE_JOIN 1000              /* Frame the late viewer subscribes at */
+#define RAW_FRAME (DISPLAY_HEIGHT * sizeof(uint64_t) + 2)
+
+/***
+ * Apply one packet the way a viewer would and check it shows what the machine shows.
+ */
+static bool
+viewer(struct chip8_stream_decoder *decoder, const struct chip8_stream_packet *packet, const struct chip8 *chip8)
+{
+    size_t consumed;
+    if (!chip8_stream_decode(decoder, packet->bytes, packet->size, &consumed) || consumed != packet->size) {
+        return false;
+    }
+    return decoder->synced && decoder->frame == packet->frame && decoder->DT == chip8->registers->DT &&
+           decoder->ST == chip8->registers->ST &&
+           memcmp(decoder->display, chip8->display->display, sizeof(decoder->display)) == 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        puts("Usage: chip8_stream_bench /path/to/rom...");
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t total_bytes = 0, total_frames = 0;
+    for (int i = 1; i < argc; i++) {
+        uint8_t rom[ROM_SIZE];
+        uint32_t size = read_rom(argv[i], rom);
+        uint16_t keyboard = 0;
+        struct chip8 *chip8 = chip8_init(&keyboard);
+        chip8_reset(chip8, 1);
+        chip8_load_program(chip8, rom, size);
+
+        struct chip8_stream *stream = chip8_stream_init(0);
+        struct chip8_stream_subscriber **subscribers = calloc(SUBSCRIBERS, sizeof(*subscribers));
+        if (subscribers == NULL) {
+            puts("Error allocating memory!");
+            exit(EXIT_FAILURE);
+        }
+        for (int j = 0; j < SUBSCRIBERS - 1; j++) {
+            subscribers[j] = chip8_stream_subscribe(stream);
+        }
+        struct chip8_stream_decoder first, late;
+        chip8_stream_decoder_init(&first);
+        chip8_stream_decoder_init(&late);
+
+        double encode = 0, fan_out = 0;
+        uint32_t largest = 0, mismatches = 0;
+        for (uint32_t frame = 0; frame < FRAMES; frame++) {
+            keyboard = bench_keys(frame);
+            chip8_step(chip8);
+            if (frame == LATE_JOIN) {
+                subscribers[SUBSCRIBERS - 1] = chip8_stream_subscribe(stream);
+            }
+
+            double start = now();
+            struct chip8_stream_packet *packet = chip8_stream_encode(stream, chip8);
+            double encoded = now();
+            chip8_stream_publish(stream, packet);
+            largest = packet->size > largest ? packet->size : largest;
+
+            /* Every viewer takes the same buffer off its queue, two of them decode it */
+            for (int j = 0; j < SUBSCRIBERS; j++) {
+                if (subscribers[j] == NULL) {
+                    continue;
+                }
+                while ((packet = chip8_stream_next(subscribers[j])) != NULL) {
+                    if (j == 0 && !viewer(&first, packet, chip8)) {
+                        mismatches++;
+                    }
+                    if (j == SUBSCRIBERS - 1 && !viewer(&late, packet, chip8)) {
+                        mismatches++;
+                    }
+                    chip8_stream_release(packet);
+                }
+            }
+            encode += encoded - start;
+            fan_out += now() - encoded;
+        }
+
+        struct chip8_stream_stats stats;
+        chip8_stream_get_stats(stream, &stats);
+        uint64_t delta_frames = stats.frames - stats.keyframes;
+        uint64_t delta_bytes = stats.bytes - stats.keyframes * (RAW_FRAME + 5);
+        printf("%-40s %6.2f bytes/frame  deltas %6.2f  largest %3u  %5.1fx smaller than raw  "
+               "encode %5.0f ns  fan-out to %d %6.0f ns%s\n",
+               argv[i], (double)stats.bytes / stats.frames, delta_frames ? (double)delta_bytes / delta_frames : 0.0,
+               largest, (double)RAW_FRAME * stats.frames / stats.bytes, encode / FRAMES * 1e9, SUBSCRIBERS,
+               fan_out / FRAMES * 1e9, mismatches ? "  DECODED DISPLAY DIFFERS" : "");
+        total_bytes += stats.bytes;
+        total_frames += stats.frames;
+
+        chip8_stream_free(stream);
+        free(subscribers);
+        chip8_free(chip8);
+    }
+    printf("all %6.2f bytes/frame against %zu raw\n", (double)total_bytes / total_frames, (size_t)RAW_FRAME);
+    return EXIT_SUCCESS;
+}
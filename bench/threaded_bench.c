@@ -0,0 +1,120 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "../src/inc/chip8.h"
+#include "../src/inc/chip8_engine.h"
+#include "../src/inc/chip8_state.h"
+#include "../src/inc/chip8_threaded.h"
+#include "../tools/common.h"
+
+#define FRAMES 60000
+#define CHECK_EVERY 100
+
+struct result {
+    double elapsed;
+    long long branch_misses;    /* -1 if the kernel does not allow counting */
+    struct chip8_hash hashes[FRAMES / CHECK_EVERY];
+};
+
+static int
+open_branch_misses(void)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void
+run(const uint8_t *rom, uint32_t size, struct chip8_engine *engine, struct result *result)
+{
+    uint16_t keyboard = 0;
+    struct chip8 *chip8 = chip8_init(&keyboard);
+    long long misses = -1;
+    int counter = open_branch_misses();
+
+    chip8_reset(chip8, 1);
+    chip8_load_program(chip8, rom, size);
+    chip8->engine = engine;
+
+    if (counter >= 0) {
+        ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+        ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    double start = now();
+    for (uint32_t frame = 0; frame < FRAMES; frame++) {
+        keyboard = bench_keys(frame);
+        chip8_step(chip8);
+        if (frame % CHECK_EVERY == CHECK_EVERY - 1) {
+            result->hashes[frame / CHECK_EVERY] = chip8_state_hash(chip8);
+        }
+    }
+    result->elapsed = now() - start;
+    if (counter >= 0) {
+        ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(counter, &misses, sizeof(misses)) != sizeof(misses)) {
+            misses = -1;
+        }
+        close(counter);
+    }
+    result->branch_misses = misses;
+
+    chip8->engine = NULL;
+    chip8_free(chip8);
+}
+
+static void
+report(const char *name, const struct result *result)
+{
+    printf("  %-12s %10.0f frames/s %12.0f instructions/s", name, FRAMES / result->elapsed,
+           (double)FRAMES * CYCLES_PER_FRAME / result->elapsed);
+    if (result->branch_misses >= 0) {
+        printf(" %10lld branch misses", result->branch_misses);
+    }
+    printf("\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+    static struct result interpreted, threaded;
+    bool match = true;
+
+    if (argc < 2) {
+        puts("Usage: chip8_threaded_bench /path/to/rom...");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 1; i < argc; i++) {
+        uint8_t rom[ROM_SIZE];
+        uint32_t size = read_rom(argv[i], rom);
+        struct chip8_engine *engine = chip8_threaded_init();
+        struct chip8_threaded_stats stats;
+
+        run(rom, size, NULL, &interpreted);
+        run(rom, size, engine, &threaded);
+        chip8_threaded_get_stats(engine, &stats);
+
+        bool same = memcmp(interpreted.hashes, threaded.hashes, sizeof(interpreted.hashes)) == 0;
+        match = match && same;
+        printf("%s: states %s, %llu decoded, %llu fused, %llu flushes\n", argv[i], same ? "match" : "DIFFER",
+               (unsigned long long)stats.decoded, (unsigned long long)stats.fused,
+               (unsigned long long)stats.flushes);
+        report("interpreter", &interpreted);
+        report("threaded", &threaded);
+        engine->free(engine);
+    }
+    return match ? EXIT_SUCCESS : EXIT_FAILURE;
+}
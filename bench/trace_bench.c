@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../src/inc/chip8.h"
+#include "../src/inc/chip8_state.h"
+#include "../src/inc/chip8_trace.h"
+#include "../tools/common.h"
+
+#define FRAMES 200000
+#define REPEATS 5
+#define CAPACITY (1u << 16u)
+
+static struct chip8_hash
+run(const uint8_t *rom, uint32_t size, struct chip8_trace *trace, double *elapsed)
+{
+    uint16_t keyboard = 0;
+    struct chip8 *chip8 = chip8_init(&keyboard);
+
+    chip8_reset(chip8, 1);
+    chip8_load_program(chip8, rom, size);
+    chip8->trace = trace;
+
+    double start = now();
+    for (uint32_t frame = 0; frame < FRAMES; frame++) {
+        keyboard = bench_keys(frame);
+        chip8_step(chip8);
+    }
+    *elapsed = now() - start;
+
+    struct chip8_hash hash = chip8_state_hash(chip8);
+    chip8_free(chip8);
+    return hash;
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        puts("Usage: chip8_trace_bench /path/to/rom...");
+        exit(EXIT_FAILURE);
+    }
+
+    double plain_total = 0, traced_total = 0;
+    for (int i = 1; i < argc; i++) {
+        uint8_t rom[ROM_SIZE];
+        uint32_t size = read_rom(argv[i], rom);
+        struct chip8_trace *trace = chip8_trace_init(CAPACITY);
+        double plain, traced;
+
+        /* Best of several runs, the difference is small next to scheduling noise */
+        struct chip8_hash expected = run(rom, size, NULL, &plain);
+        struct chip8_hash actual = run(rom, size, trace, &traced);
+        for (int repeat = 1; repeat < REPEATS; repeat++) {
+            double elapsed;
+            run(rom, size, NULL, &elapsed);
+            plain = elapsed < plain ? elapsed : plain;
+            run(rom, size, trace, &elapsed);
+            traced = elapsed < traced ? elapsed : traced;
+        }
+        plain_total += plain;
+        traced_total += traced;
+        printf("%-28s plain %9.0f frames/s  traced %9.0f frames/s  %+5.1f%%  %llu recorded%s\n", argv[i],
+               FRAMES / plain, FRAMES / traced, (traced / plain - 1) * 100,
+               (unsigned long long)(trace->header.total / REPEATS), chip8_hash_equal(expected, actual) ? "" : "  STATES DIFFER");
+        chip8_trace_free(trace);
+    }
+    printf("overall tracing cost %+.1f%%\n", (traced_total / plain_total - 1) * 100);
+    return EXIT_SUCCESS;
+}
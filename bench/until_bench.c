@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../src/inc/chip8.h"
+#include "../src/inc/chip8_state.h"
+#include "../tools/common.h"
+
+#define FRAMES 60000
+#define CHUNK 7                     /* Instructions per call, so calls stop inside frames */
+#define UNREACHABLE_PC 0xffe
+#define QUIET_ADDRESS 0x000         /* Font data, programs do not write there */
+
+struct condition {
+    const char *name;
+    uint32_t conditions;
+};
+
+/* Watched on top of the frame count, the run resumes whenever one of them holds */
+static const struct condition conditions[] = {
+        {"frames", 0},
+        {"pc", UNTIL_PC},
+        {"memory", UNTIL_MEMORY},
+        {"display", UNTIL_DISPLAY},
+        {"sound", UNTIL_SOUND},
+        {"key wait", UNTIL_KEY_WAIT},
+        {"all", UNTIL_PC | UNTIL_MEMORY | UNTIL_DISPLAY | UNTIL_SOUND | UNTIL_KEY_WAIT},
+};
+
+static struct chip8 *
+boot(const uint8_t *rom, uint32_t size, uint16_t *keyboard)
+{
+    struct chip8 *chip8 = chip8_init(keyboard);
+    chip8_reset(chip8, 1);
+    chip8_load_program(chip8, rom, size);
+    return chip8;
+}
+
+static double
+run_steps(struct chip8 *chip8)
+{
+    double start = now();
+    for (uint32_t frame = 0; frame < FRAMES && !chip8->fault; frame++) {
+        chip8_step(chip8);
+    }
+    return (now() - start) / FRAMES;
+}
+
+/***
+ * Run FRAMES frames in as few calls as the conditions allow, resuming after every stop.
+ */
+static double
+run_until(struct chip8 *chip8, uint32_t watch, uint32_t *stops)
+{
+    struct chip8_until until = {UNTIL_FRAMES | watch, 0, 0, UNREACHABLE_PC, QUIET_ADDRESS, 0, 0};
+    uint32_t frames = 0;
+    *stops = 0;
+
+    double start = now();
+    while (frames < FRAMES) {
+        until.frames = FRAMES - frames;
+        enum chip8_stop stop = chip8_run_until(chip8, &until);
+        frames += until.elapsed;
+        if (stop == STOP_FAULT) {
+            break;
+        }
+        *stops += stop != STOP_FRAMES;
+    }
+    return (now() - start) / FRAMES;
+}
+
+/***
+ * The same frames in calls of CHUNK instructions each. A frame ticks as soon as its last
+ * instruction ran, so the last call ends with the tick.
+ */
+static void
+run_chunks(struct chip8 *chip8)
+{
+    struct chip8_until until = {UNTIL_INSTRUCTIONS, CHUNK, 0, 0, 0, 0, 0};
+    uint64_t left = (uint64_t)FRAMES * CYCLES_PER_FRAME;
+    while (left && !chip8->fault) {
+        until.instructions = left < CHUNK ? left : CHUNK;
+        chip8_run_until(chip8, &until);
+        left -= until.executed;
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        puts("Usage: chip8_until_bench /path/to/rom...");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 1; i < argc; i++) {
+        uint8_t rom[ROM_SIZE];
+        uint32_t size = read_rom(argv[i], rom);
+        uint16_t keyboard = 0;
+
+        struct chip8 *reference = boot(rom, size, &keyboard);
+        double step = run_steps(reference);
+        uint64_t expected = chip8_state_hash(reference).low;
+        chip8_free(reference);
+
+        struct chip8 *chunked = boot(rom, size, &keyboard);
+        run_chunks(chunked);
+        bool chunks_match = chip8_state_hash(chunked).low == expected;
+        chip8_free(chunked);
+
+        printf("%s%s\n  step      %6.0f ns/frame\n", argv[i], chunks_match ? "" : "  CHUNKED STATE DIFFERS",
+               step * 1e9);
+        for (size_t j = 0; j < sizeof(conditions) / sizeof(conditions[0]); j++) {
+            struct chip8 *chip8 = boot(rom, size, &keyboard);
+            uint32_t stops;
+            double until = run_until(chip8, conditions[j].conditions, &stops);
+            printf("  %-9s %6.0f ns/frame  %6u stops%s\n", conditions[j].name, until * 1e9, stops,
+                   chip8_state_hash(chip8).low == expected ? "" : "  STATE DIFFERS");
+            chip8_free(chip8);
+        }
+    }
+    return EXIT_SUCCESS;
+}
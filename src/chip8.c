@@ -1,8 +1,8 @@
 #include "inc/chip8.h"
 
-#include <SDL2/SDL.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 
 #include "inc/chip8_display.h"
@@ -10,9 +10,17 @@
 #include "inc/chip8_memory.h"
 #include "inc/chip8_registers.h"
 #include "inc/chip8_keyboard.h"
+#include "inc/chip8_idle.h"
+#include "inc/chip8_shm.h"
+#include "inc/chip8_engine.h"
+#include "inc/chip8_trace.h"
+#include "inc/chip8_heatmap.h"
 
 static void chip8_decode(struct chip8 *chip8, uint16_t instruction);
-static void chip8_draw_screen(const struct chip8 *chip8);
+static uint8_t chip8_random(struct chip8 *chip8);
+static void chip8_fault(struct chip8 *chip8, enum chip8_fault fault);
+static void chip8_record(struct chip8 *chip8, uint16_t pc, uint16_t instruction);
+static uint32_t chip8_run_cycles(struct chip8 *chip8, uint8_t end);
 
 static void chip8_instruction_0XXX(struct chip8 *chip8, uint16_t instruction);
 static void chip8_instruction_00E0(struct chip8 *chip8, uint16_t instruction);
@@ -54,7 +62,7 @@ static void chip8_instruction_Fx55(struct chip8 *chip8, uint16_t instruction);
 static void chip8_instruction_Fx65(struct chip8 *chip8, uint16_t instruction);
 
 struct chip8 *
-chip8_init(struct SDL_Renderer *renderer, uint16_t *keyboard)
+chip8_init(uint16_t *keyboard)
 {
     struct chip8 *chip = calloc(1, sizeof(*chip));
     if (chip == NULL) {
@@ -66,18 +74,124 @@ chip8_init(struct SDL_Renderer *renderer, uint16_t *keyboard)
     chip->stack = calloc(1, sizeof(*chip->stack));
     chip->keyboard = chip8_keyboard_init(keyboard);
     chip->display = calloc(1, sizeof(*chip->display));
-    chip->renderer = renderer;
-
-    chip8_registers_set_PC(chip->registers, PROGRAM_START_ADDR);
+    chip->idle = calloc(1, sizeof(*chip->idle));
+    if (chip->registers == NULL || chip->stack == NULL || chip->display == NULL || chip->idle == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
 
-    srand(time(NULL));
+    chip8_reset(chip, time(NULL));
     return chip;
 }
 
+void
+chip8_free(struct chip8 *chip8)
+{
+    chip8_memory_free(chip8->memory);
+    free(chip8->registers);
+    free(chip8->stack);
+    free(chip8->keyboard);
+    free(chip8->display);
+    free(chip8->idle);
+    free(chip8);
+}
+
+/***
+ * A second machine continuing from the state of the given one. Memory pages are shared
+ * until either machine writes to them, everything else is copied. The fork starts without
+ * an engine, trace, heatmap or shared memory export.
+ */
+struct chip8 *
+chip8_fork(const struct chip8 *chip8, uint16_t *keyboard)
+{
+    static uint32_t forks;
+    struct chip8 *fork = calloc(1, sizeof(*fork));
+    if (fork == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+    fork->memory = chip8_memory_fork(chip8->memory);
+    fork->registers = malloc(sizeof(*fork->registers));
+    fork->stack = malloc(sizeof(*fork->stack));
+    fork->keyboard = chip8_keyboard_init(keyboard);
+    fork->display = malloc(sizeof(*fork->display));
+    fork->idle = calloc(1, sizeof(*fork->idle));
+    if (fork->registers == NULL || fork->stack == NULL || fork->display == NULL || fork->idle == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+
+    *fork->registers = *chip8->registers;
+    *fork->stack = *chip8->stack;
+    *fork->display = *chip8->display;
+    fork->effects = chip8->effects;
+    fork->random = chip8->random;
+    fork->waiting = chip8->waiting;
+    fork->fault = chip8->fault;
+    fork->fault_pc = chip8->fault_pc;
+    fork->cycle = chip8->cycle;
+    /*
+     * Engines recognize memory by machine address and version. Forks are freed and allocated
+     * in quick succession, a version no other fork had keeps a reused address from passing
+     * as the machine it used to be.
+     */
+    fork->memory_version = __atomic_add_fetch(&forks, 1, __ATOMIC_RELAXED) * 0x9e3779b9u;
+    return fork;
+}
+
+/***
+ * Power cycle the machine. The program has to be loaded again.
+ * The seed fully determines the values produced by Cxkk.
+ */
+void
+chip8_reset(struct chip8 *chip8, uint32_t seed)
+{
+    chip8_memory_reset(chip8->memory);
+    memset(chip8->registers, 0, sizeof(*chip8->registers));
+    memset(chip8->stack, 0, sizeof(*chip8->stack));
+    chip8_display_clear(chip8->display);
+    chip8_registers_set_PC(chip8->registers, PROGRAM_START_ADDR);
+
+    chip8->random = seed ? seed : 0x9e3779b9u;
+    chip8->waiting = false;
+    chip8->fault = FAULT_NONE;
+    chip8->fault_pc = 0;
+    chip8->cycle = 0;
+    chip8->memory_version++;
+}
+
 void
 chip8_load_program(struct chip8 *chip8, const uint8_t *program, uint32_t size)
 {
     chip8_memory_load_program(chip8->memory, program, size);
+    chip8->memory_version++;
+}
+
+/***
+ * Replace a loaded program with an edited one, keeping registers, stack, display and all memory
+ * the edit did not change, data the program stored within its own image included. Bytes of the
+ * old program past the end of the new one read as zero again, as after a fresh load. A fault
+ * or key wait is dropped, so the edited program continues from the same PC.
+ */
+void
+chip8_reload_program(struct chip8 *chip8, const uint8_t *previous, uint32_t previous_size, const uint8_t *program,
+                     uint32_t size)
+{
+    uint32_t limit = MEMORY_SIZE - PROGRAM_START_ADDR;
+    previous_size = previous_size < limit ? previous_size : limit;
+    size = size < limit ? size : limit;
+
+    for (uint32_t i = 0; i < previous_size || i < size; i++) {
+        uint8_t old = i < previous_size ? previous[i] : 0;
+        uint8_t new = i < size ? program[i] : 0;
+        if (old != new) {
+            chip8_memory_set(chip8->memory, PROGRAM_START_ADDR + i, new);
+        }
+    }
+    chip8->waiting = false;
+    chip8->fault = FAULT_NONE;
+    chip8->fault_pc = 0;
+    chip8->memory_version++;
 }
 
 /***
@@ -86,16 +200,277 @@ chip8_load_program(struct chip8 *chip8, const uint8_t *program, uint32_t size)
 bool
 chip8_step(struct chip8 *chip8)
 {
-    for (uint8_t cycle = 0; cycle < CYCLES_PER_SECOND / FRAMES_PER_SECOND; cycle++) {
-        chip8_decode(chip8, chip8_memory_fetch(chip8->memory, chip8_registers_get_PC(chip8->registers)));
+    chip8_run_cycles(chip8, CYCLES_PER_FRAME);
+    chip8->cycle = 0;
+    return chip8_tick(chip8);
+}
+
+/***
+ * Idle loops are only skipped when nothing has to see every instruction, the trace ring and the
+ * heatmap record the iterations a skip would leave out
+ */
+static inline bool
+chip8_skips_idle(const struct chip8 *chip8)
+{
+    return !chip8->trace && !chip8->heatmap;
+}
+
+/***
+ * Execute the current frame up to cycle end, through the engine unless instructions are traced
+ * or counted.
+ * Idle loop detection starts over, the keyboard may have changed since the frame was left.
+ * Return instructions executed, counting cycles skipped in idle loops
+ */
+static uint32_t
+chip8_run_cycles(struct chip8 *chip8, uint8_t end)
+{
+    uint8_t start = chip8->cycle;
+
+    if (chip8->engine && !chip8->trace && !chip8->heatmap) {
+        uint32_t cycles = start;
+        while (cycles < end && !chip8->fault) {
+            cycles += chip8->engine->run(chip8->engine, chip8, end - cycles);
+            if (chip8->waiting) {
+                /* Fx0A would see the same keyboard for the rest of the frame */
+                chip8->cycle = CYCLES_PER_FRAME;
+                return cycles - start;
+            }
+        }
+        chip8->cycle = cycles;
+        return cycles - start;
+    }
+
+    uint8_t cycle;
+    bool idle = chip8_skips_idle(chip8);
+    chip8_idle_begin_frame(chip8->idle);
+    for (cycle = start; cycle < end && !chip8->fault; cycle++) {
+        uint16_t pc = chip8_registers_get_PC(chip8->registers);
+        chip8_cycle(chip8);
+
+        if (idle && chip8_registers_get_PC(chip8->registers) <= pc) {
+            cycle += chip8_idle_check(chip8->idle, chip8->registers, chip8->effects, cycle, end);
+        }
+    }
+    chip8->cycle = cycle;
+    return cycle - start;
+}
+
+/***
+ * Tick the frame if the instruction a run stops after was its last, so timers do not depend on
+ * where runs stop
+ */
+static inline void
+chip8_finish_frame(struct chip8 *chip8, struct chip8_until *until)
+{
+    if (chip8->cycle >= CYCLES_PER_FRAME) {
+        chip8->cycle = 0;
+        chip8_tick(chip8);
+        until->elapsed++;
+    }
+}
+
+/***
+ * Run frames until a condition holds. The flags tell which instruction level conditions are
+ * asked for; the function is always inlined with constant flags, so every combination gets a
+ * loop of its own without the checks it does not need. Without any of them whole stretches
+ * of a frame go through chip8_run_cycles(), and with them instructions are interpreted one
+ * at a time. Idle loops are skipped either way, they change neither memory, display, timers
+ * nor PC targets they have not already passed, unless a trace or heatmap is attached.
+ */
+static inline __attribute__((always_inline)) enum chip8_stop
+chip8_run_checked(struct chip8 *chip8, struct chip8_until *until, const bool pc, const bool effects,
+                  const bool registers)
+{
+    uint32_t conditions = until->conditions;
+    uint64_t budget = conditions & UNTIL_INSTRUCTIONS ? until->instructions : UINT64_MAX;
+    uint32_t frames = conditions & UNTIL_FRAMES ? until->frames : UINT32_MAX;
+    uint32_t seen = chip8->effects;
+    uint16_t address = until->address % MEMORY_SIZE;
+    uint8_t byte = 0;
+    struct chip8_display shown;
+    bool sounding = chip8_registers_get_ST(chip8->registers);
+    bool waiting = chip8->waiting;
+    bool idle = chip8_skips_idle(chip8);
+
+    if (effects && (conditions & UNTIL_MEMORY)) {
+        byte = chip8_memory_get(chip8->memory, address);
+    }
+    if (effects && (conditions & UNTIL_DISPLAY)) {
+        shown = *chip8->display;
+    }
+    chip8_idle_begin_frame(chip8->idle);
+
+    while (!chip8->fault) {
+        if (chip8->cycle >= CYCLES_PER_FRAME) {
+            chip8->cycle = 0;
+            chip8_tick(chip8);
+            chip8_idle_begin_frame(chip8->idle);
+            sounding = chip8_registers_get_ST(chip8->registers);
+            if (++until->elapsed == frames) {
+                return STOP_FRAMES;
+            }
+        }
+        if (until->executed == budget) {
+            return STOP_INSTRUCTIONS;
+        }
+        uint64_t left = budget - until->executed;
+        uint8_t end = left < (uint64_t)(CYCLES_PER_FRAME - chip8->cycle) ? chip8->cycle + left : CYCLES_PER_FRAME;
+
+        if (!pc && !effects && !registers) {
+            until->executed += chip8_run_cycles(chip8, end);
+            continue;
+        }
+
+        uint16_t at = chip8_registers_get_PC(chip8->registers);
+        if (pc && at == until->pc && until->executed) {
+            return STOP_PC;
+        }
+        chip8_cycle(chip8);
+        chip8->cycle++;
+        until->executed++;
+        if (chip8->fault) {
+            break;
+        }
+        if (effects && chip8->effects != seen) {
+            seen = chip8->effects;
+            if ((conditions & UNTIL_MEMORY) && chip8_memory_get(chip8->memory, address) != byte) {
+                chip8_finish_frame(chip8, until);
+                return STOP_MEMORY;
+            }
+            if ((conditions & UNTIL_DISPLAY) && memcmp(chip8->display, &shown, sizeof(shown)) != 0) {
+                chip8_finish_frame(chip8, until);
+                return STOP_DISPLAY;
+            }
+        }
+        if (registers) {
+            if ((conditions & UNTIL_SOUND) && !sounding && chip8_registers_get_ST(chip8->registers)) {
+                chip8_finish_frame(chip8, until);
+                return STOP_SOUND;
+            }
+            if ((conditions & UNTIL_KEY_WAIT) && !waiting && chip8->waiting) {
+                chip8_finish_frame(chip8, until);
+                return STOP_KEY_WAIT;
+            }
+            sounding = chip8_registers_get_ST(chip8->registers);
+            waiting = chip8->waiting;
+        }
+        if (idle && chip8_registers_get_PC(chip8->registers) <= at) {
+            uint8_t skip = chip8_idle_check(chip8->idle, chip8->registers, chip8->effects, chip8->cycle - 1, end);
+            chip8->cycle += skip;
+            until->executed += skip;
+        }
+    }
+    return STOP_FAULT;
+}
+
+enum chip8_stop
+chip8_run_until(struct chip8 *chip8, struct chip8_until *until)
+{
+    bool pc = until->conditions & UNTIL_PC;
+    bool effects = until->conditions & (UNTIL_MEMORY | UNTIL_DISPLAY);
+    bool registers = until->conditions & (UNTIL_SOUND | UNTIL_KEY_WAIT);
+
+    until->executed = 0;
+    until->elapsed = 0;
+    if (chip8->fault) {
+        return STOP_FAULT;
+    }
+    if ((until->conditions & UNTIL_FRAMES) && until->frames == 0) {
+        return STOP_FRAMES;
+    }
+    switch ((uint8_t)(pc << 2u | effects << 1u | registers)) {
+        case 0:
+            return chip8_run_checked(chip8, until, false, false, false);
+        case 1:
+            return chip8_run_checked(chip8, until, false, false, true);
+        case 2:
+            return chip8_run_checked(chip8, until, false, true, false);
+        case 3:
+            return chip8_run_checked(chip8, until, false, true, true);
+        case 4:
+            return chip8_run_checked(chip8, until, true, false, false);
+        case 5:
+            return chip8_run_checked(chip8, until, true, false, true);
+        case 6:
+            return chip8_run_checked(chip8, until, true, true, false);
+        default:
+            return chip8_run_checked(chip8, until, true, true, true);
+    }
+}
+
+/***
+ * Emulate several frames without presenting any of them, timers tick once per frame
+ * so they follow emulated time. Stops early once the machine faulted.
+ * Return true if sound should play after the last frame
+ */
+bool
+chip8_advance(struct chip8 *chip8, uint32_t frames)
+{
+    bool sound = false;
+    for (uint32_t frame = 0; frame < frames && !chip8->fault; frame++) {
+        sound = chip8_step(chip8);
+    }
+    return sound;
+}
+
+/***
+ * Execute a single instruction. Does nothing once the machine faulted.
+ */
+void
+chip8_cycle(struct chip8 *chip8)
+{
+    uint16_t pc = chip8_registers_get_PC(chip8->registers);
+
+    if (chip8->fault) {
+        return;
+    }
+    if (pc >= MEMORY_SIZE - 1) {
+        chip8_fault(chip8, FAULT_MEMORY_BOUNDS);
+        return;
+    }
+    uint16_t instruction = chip8_memory_fetch(chip8->memory, pc);
+    if (chip8->heatmap) {
+        chip8_heatmap_record(chip8->heatmap, pc, instruction, chip8_registers_get_I(chip8->registers));
+    }
+    chip8_decode(chip8, instruction);
+    if (chip8->trace) {
+        chip8_record(chip8, pc, instruction);
+    }
+    if (!chip8->fault) {
         chip8_registers_increment_PC(chip8->registers);
     }
+}
+
+/***
+ * Advance the timers by one frame without executing instructions.
+ * Return true if sound should play
+ */
+bool
+chip8_tick(struct chip8 *chip8)
+{
     chip8_registers_decrement_DT(chip8->registers);
     chip8_registers_decrement_ST(chip8->registers);
-    chip8_draw_screen(chip8);
+    if (chip8->shm) {
+        chip8_shm_publish(chip8->shm, chip8);
+    }
     return chip8_registers_get_ST(chip8->registers);
 }
 
+/***
+ * While waiting on Fx0A with an unchanged keyboard, a frame only ticks the timers.
+ */
+bool
+chip8_waiting_for_key(const struct chip8 *chip8)
+{
+    return chip8->waiting;
+}
+
+bool
+chip8_timers_active(const struct chip8 *chip8)
+{
+    return chip8->registers->DT || chip8->registers->ST;
+}
+
 static void
 chip8_decode(struct chip8 *chip8, uint16_t instruction)
 {
@@ -112,27 +487,59 @@ chip8_decode(struct chip8 *chip8, uint16_t instruction)
     instructions[opcode](chip8, instruction);
 }
 
-static void
-chip8_draw_screen(const struct chip8 *chip8)
+const char *
+chip8_fault_name(enum chip8_fault fault)
 {
-    SDL_Rect pixel = {0, 0, SCREEN_WIDTH / DISPLAY_WIDTH, SCREEN_HEIGHT / DISPLAY_HEIGHT};
-
-    SDL_SetRenderDrawColor(chip8->renderer, 0x00, 0x00, 0x00, 0xff);
-    SDL_RenderClear(chip8->renderer);
+    switch (fault) {
+        case FAULT_NONE:
+            return "none";
+        case FAULT_STACK_OVERFLOW:
+            return "stack overflow";
+        case FAULT_STACK_UNDERFLOW:
+            return "stack underflow";
+        case FAULT_MEMORY_BOUNDS:
+            return "memory out of bounds";
+        case FAULT_ILLEGAL_INSTRUCTION:
+            return "illegal instruction";
+    }
+    return "unknown";
+}
 
-    for (uint8_t row = 0; row < DISPLAY_HEIGHT; row++) {
-        for (uint8_t col = 0; col < DISPLAY_WIDTH; col++) {
-            uint8_t bit = (chip8->display->display[row] >> (63 - col)) & 1u;
-            uint8_t color = bit ? 0xff : 0x20;
-            pixel.x = pixel.w * col;
-            pixel.y = pixel.h * row;
+static void
+chip8_fault(struct chip8 *chip8, enum chip8_fault fault)
+{
+    chip8->fault = fault;
+    chip8->fault_pc = chip8_registers_get_PC(chip8->registers);
+}
 
-            SDL_SetRenderDrawColor(chip8->renderer, color, color, color, 0xff);
-            SDL_RenderFillRect(chip8->renderer, &pixel);
-        }
-    }
+/***
+ * Plain stores into the ring, decoding is left to chip8-trace
+ */
+static void
+chip8_record(struct chip8 *chip8, uint16_t pc, uint16_t instruction)
+{
+    struct chip8_trace *trace = chip8->trace;
+    struct chip8_trace_entry *entry = &trace->entries[trace->header.total++ & trace->mask];
+
+    entry->pc = pc;
+    entry->opcode = instruction;
+    entry->I = chip8->registers->I;
+    entry->Vx = chip8->registers->V[(instruction >> (2u * NIBBLE)) & 0x0fu];
+    entry->VF = chip8->registers->V[0x0f];
+}
 
-    SDL_RenderPresent(chip8->renderer);
+/***
+ * xorshift32
+ */
+static uint8_t
+chip8_random(struct chip8 *chip8)
+{
+    uint32_t x = chip8->random;
+    x ^= x << 13u;
+    x ^= x >> 17u;
+    x ^= x << 5u;
+    chip8->random = x;
+    return x >> 24u;
 }
 
 static void
@@ -149,11 +556,16 @@ static void
 chip8_instruction_00E0(struct chip8 *chip8, uint16_t instruction)
 {
     chip8_display_clear(chip8->display);
+    chip8->effects++;
 }
 
 static void
 chip8_instruction_00EE(struct chip8 *chip8, uint16_t instruction)
 {
+    if (chip8_registers_get_SP(chip8->registers) == 0) {
+        chip8_fault(chip8, FAULT_STACK_UNDERFLOW);
+        return;
+    }
     uint16_t new_pc = chip8_stack_pop(chip8->stack, &chip8->registers->SP);
     chip8_registers_set_PC(chip8->registers, new_pc);
 }
@@ -168,9 +580,14 @@ chip8_instruction_1nnn(struct chip8 *chip8, uint16_t instruction)
 static void
 chip8_instruction_2nnn(struct chip8 *chip8, uint16_t instruction)
 {
+    if (chip8_registers_get_SP(chip8->registers) >= STACK_SIZE) {
+        chip8_fault(chip8, FAULT_STACK_OVERFLOW);
+        return;
+    }
     chip8_stack_push(chip8->stack, &chip8->registers->SP, chip8->registers->PC);
     chip8_registers_set_PC(chip8->registers, instruction & 0x0fffu);
     chip8_registers_decrement_PC(chip8->registers);
+    chip8->effects++;
 }
 
 static void
@@ -226,7 +643,12 @@ chip8_instruction_8XXX(struct chip8 *chip8, uint16_t instruction)
             [14] = chip8_instruction_8xyE
     };
 
-    instructions[instruction & 0x000fu](chip8, instruction);
+    uint8_t op = instruction & 0x000fu;
+    if (op >= sizeof(instructions) / sizeof(instructions[0]) || instructions[op] == NULL) {
+        chip8_fault(chip8, FAULT_ILLEGAL_INSTRUCTION);
+        return;
+    }
+    instructions[op](chip8, instruction);
 }
 
 /***
@@ -403,7 +825,8 @@ chip8_instruction_Cxkk(struct chip8 *chip8, uint16_t instruction)
 {
     uint16_t x = (instruction >> (2u * NIBBLE)) & 0x0fu;
     uint16_t kk = instruction & 0xffu;
-    chip8_registers_set_Vx(chip8->registers, x, (uint16_t)rand() & kk);
+    chip8_registers_set_Vx(chip8->registers, x, chip8_random(chip8) & kk);
+    chip8->effects++;
 }
 
 /***
@@ -418,9 +841,15 @@ chip8_instruction_Dxyn(struct chip8 *chip8, uint16_t instruction)
     uint8_t Vy = chip8_registers_get_Vx(chip8->registers, y);
     uint8_t n = instruction & 0x0fu;
 
+    if (chip8_registers_get_I(chip8->registers) + n > MEMORY_SIZE) {
+        chip8_fault(chip8, FAULT_MEMORY_BOUNDS);
+        return;
+    }
+    uint8_t sprite[0x0f];
     bool collision = chip8_display_draw(chip8->display, Vx, Vy, n,
-                       &chip8->memory->memory[chip8_registers_get_I(chip8->registers)]);
+                       chip8_memory_span(chip8->memory, chip8_registers_get_I(chip8->registers), n, sprite));
     chip8_registers_set_Vx(chip8->registers, 0x0f, collision);
+    chip8->effects++;
 }
 
 static void
@@ -499,6 +928,10 @@ chip8_instruction_FXXX(struct chip8 *chip8, uint16_t instruction)
             func = chip8_instruction_Fx65;
             break;
     }
+    if (func == NULL) {
+        chip8_fault(chip8, FAULT_ILLEGAL_INSTRUCTION);
+        return;
+    }
     func(chip8, instruction);
 }
 
@@ -523,7 +956,8 @@ chip8_instruction_Fx0A(struct chip8 *chip8, uint16_t instruction)
     uint16_t x = (instruction >> (2u * NIBBLE)) & 0x0fu;
     uint8_t key = chip8_keyboard_get_pressed(chip8->keyboard);
 
-    if (!(key >> 1u)) {
+    chip8->waiting = !(key >> 1u);
+    if (chip8->waiting) {
         chip8_registers_decrement_PC(chip8->registers);
     } else {
         chip8_registers_set_Vx(chip8->registers, x, key);
@@ -586,9 +1020,15 @@ chip8_instruction_Fx33(struct chip8 *chip8, uint16_t instruction)
     uint8_t tens = (Vx / 10) % 10;
     uint8_t ones = Vx % 10;
 
-    chip8->memory->memory[I] = hundreds;
-    chip8->memory->memory[I + 1] = tens;
-    chip8->memory->memory[I + 2] = ones;
+    if (I + 2 >= MEMORY_SIZE) {
+        chip8_fault(chip8, FAULT_MEMORY_BOUNDS);
+        return;
+    }
+    chip8_memory_set(chip8->memory, I, hundreds);
+    chip8_memory_set(chip8->memory, I + 1, tens);
+    chip8_memory_set(chip8->memory, I + 2, ones);
+    chip8->effects++;
+    chip8->memory_version++;
 }
 
 /***
@@ -602,9 +1042,15 @@ chip8_instruction_Fx55(struct chip8 *chip8, uint16_t instruction)
     uint8_t x = (instruction >> (2u * NIBBLE)) & 0x0fu;
     uint16_t I = chip8_registers_get_I(chip8->registers);
 
+    if (I + x >= MEMORY_SIZE) {
+        chip8_fault(chip8, FAULT_MEMORY_BOUNDS);
+        return;
+    }
     for (uint8_t i = 0; i <= x; i++) {
-        chip8->memory->memory[I + i] = chip8_registers_get_Vx(chip8->registers, i);
+        chip8_memory_set(chip8->memory, I + i, chip8_registers_get_Vx(chip8->registers, i));
     }
+    chip8->effects++;
+    chip8->memory_version++;
 }
 
 /***
@@ -617,8 +1063,12 @@ chip8_instruction_Fx65(struct chip8 *chip8, uint16_t instruction)
     uint8_t x = (instruction >> (2u * NIBBLE)) & 0x0fu;
     uint16_t I = chip8_registers_get_I(chip8->registers);
 
+    if (I + x >= MEMORY_SIZE) {
+        chip8_fault(chip8, FAULT_MEMORY_BOUNDS);
+        return;
+    }
     for (uint8_t i = 0; i <= x; i++) {
-        chip8_registers_set_Vx(chip8->registers, i, chip8->memory->memory[I + i]);
+        chip8_registers_set_Vx(chip8->registers, i, chip8_memory_get(chip8->memory, I + i));
     }
 }
 
@@ -0,0 +1,145 @@
+#include "inc/chip8_aot.h"
+
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "inc/chip8.h"
+#include "inc/chip8_memory.h"
+
+struct chip8_aot_range {
+    uint16_t address;
+    uint16_t size;
+};
+
+struct chip8_aot {
+    struct chip8_engine engine;
+    const struct chip8_aot_module *module;
+    void *handle;               /* NULL for modules linked in */
+    struct chip8_aot_stats stats;
+
+    /* Blocks merged into contiguous code, checked first since data writes rarely hit code */
+    struct chip8_aot_range *ranges;
+    uint16_t range_count;
+
+    const struct chip8 *owner;
+    uint32_t version;           /* owner->memory_version valid was computed for */
+    uint8_t *valid;
+};
+
+static bool
+chip8_aot_matches(const struct chip8_aot *aot, const struct chip8 *chip8, uint16_t address, uint16_t size)
+{
+    return chip8_memory_equal(chip8->memory, address, &aot->module->image[address], size);
+}
+
+static void
+chip8_aot_validate(struct chip8_aot *aot, const struct chip8 *chip8)
+{
+    const struct chip8_aot_module *module = aot->module;
+    bool intact = true;
+
+    for (uint16_t i = 0; i < aot->range_count && intact; i++) {
+        intact = chip8_aot_matches(aot, chip8, aot->ranges[i].address, aot->ranges[i].size);
+    }
+    for (uint16_t i = 0; i < module->block_count; i++) {
+        aot->valid[i] = intact || chip8_aot_matches(aot, chip8, module->blocks[i].address, module->blocks[i].size);
+    }
+    aot->owner = chip8;
+    aot->version = chip8->memory_version;
+    aot->stats.revalidations++;
+}
+
+static uint32_t
+chip8_aot_run(struct chip8_engine *engine, struct chip8 *chip8, uint32_t cycles)
+{
+    struct chip8_aot *aot = (struct chip8_aot *)engine;
+
+    if (aot->owner != chip8 || aot->version != chip8->memory_version) {
+        chip8_aot_validate(aot, chip8);
+    }
+    uint32_t executed = aot->module->run(chip8, aot->valid, chip8_cycle, cycles);
+    if (executed) {
+        aot->stats.compiled += executed;
+        return executed;
+    }
+    chip8_cycle(chip8);
+    aot->stats.interpreted++;
+    return 1;
+}
+
+static void
+chip8_aot_free(struct chip8_engine *engine)
+{
+    struct chip8_aot *aot = (struct chip8_aot *)engine;
+
+    if (aot->handle) {
+        dlclose(aot->handle);
+    }
+    free(aot->ranges);
+    free(aot->valid);
+    free(aot);
+}
+
+struct chip8_engine *
+chip8_aot_init(const struct chip8_aot_module *module)
+{
+    if (module->abi != AOT_ABI || module->layout != sizeof(struct chip8)) {
+        return NULL;
+    }
+
+    struct chip8_aot *aot = calloc(1, sizeof(*aot));
+    if (aot == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+    aot->engine.name = "aot";
+    aot->engine.run = chip8_aot_run;
+    aot->engine.free = chip8_aot_free;
+    aot->module = module;
+    aot->valid = calloc(module->block_count ? module->block_count : 1, sizeof(*aot->valid));
+    aot->ranges = calloc(module->block_count ? module->block_count : 1, sizeof(*aot->ranges));
+    if (aot->valid == NULL || aot->ranges == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+
+    for (uint16_t i = 0; i < module->block_count; i++) {
+        const struct chip8_aot_block *block = &module->blocks[i];
+        struct chip8_aot_range *last = aot->range_count ? &aot->ranges[aot->range_count - 1] : NULL;
+        if (last && block->address <= last->address + last->size) {
+            uint16_t end = block->address + block->size;
+            if (end > last->address + last->size) {
+                last->size = end - last->address;
+            }
+        } else {
+            aot->ranges[aot->range_count].address = block->address;
+            aot->ranges[aot->range_count++].size = block->size;
+        }
+    }
+    return &aot->engine;
+}
+
+struct chip8_engine *
+chip8_aot_load(const char *path)
+{
+    void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL) {
+        return NULL;
+    }
+    const struct chip8_aot_module *module = dlsym(handle, AOT_SYMBOL);
+    struct chip8_engine *engine = module ? chip8_aot_init(module) : NULL;
+    if (engine == NULL) {
+        dlclose(handle);
+        return NULL;
+    }
+    ((struct chip8_aot *)engine)->handle = handle;
+    return engine;
+}
+
+void
+chip8_aot_get_stats(const struct chip8_engine *engine, struct chip8_aot_stats *stats)
+{
+    *stats = ((const struct chip8_aot *)engine)->stats;
+}
@@ -0,0 +1,407 @@
+#include "inc/chip8_cache.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "inc/chip8.h"
+#include "inc/chip8_keyboard.h"
+#include "inc/chip8_memory.h"
+#include "inc/chip8_shm.h"
+
+#define CACHE_WAYS 8                /* Consecutive slots probed per key */
+#define CACHE_MISSING UINT32_MAX
+#define CACHE_SEED_LOW 0x243f6a8885a308d3u
+#define CACHE_SEED_HIGH 0x13198a2e03707344u
+
+/* Probed apart from the entries, so a lookup touches one or two cache lines */
+struct chip8_cache_tag {
+    struct chip8_hash key;          /* State before the frame */
+    uint16_t keys;
+    bool used;
+    bool referenced;                /* Second chance bit for CLOCK */
+};
+
+struct chip8_cache_entry {
+    struct chip8_hash memory;       /* Memory hash after the frame */
+    struct chip8_hash frame;        /* Display and stack hash after the frame */
+    bool effects;                   /* The frame changed chip8->effects, so display or stack may differ */
+    struct chip8_registers registers;
+    struct chip8_stack stack;
+    struct chip8_display display;
+    uint32_t random;
+    uint16_t fault_pc;
+    uint8_t fault;
+    bool waiting;
+    uint8_t writes;
+    uint16_t addresses[CACHE_MAX_WRITES];
+    uint8_t values[CACHE_MAX_WRITES];
+};
+
+struct chip8_cache {
+    struct chip8_cache_tag *tags;
+    struct chip8_cache_entry *entries;
+    uint32_t mask;
+    uint32_t hand;                  /* Rotates the CLOCK scan start within a probe window */
+    struct chip8_cache_stats stats;
+
+    /*
+     * Hashes of the last machine seen, kept up to date instead of rehashing its state every
+     * frame. The mirror shares the machine's pages, so the machine copies any page it writes
+     * and only pages that stopped being shared need comparing once memory_version moved. The
+     * bytes that differ are folded into a hash that sums a term per byte. Display and stack
+     * only change through instructions that bump chip8->effects, or through resets and state
+     * loads, which bump memory_version.
+     */
+    const struct chip8 *owner;
+    uint32_t version;
+    uint32_t effects;
+    struct chip8_hash memory;
+    struct chip8_hash frame;
+    struct chip8_memory *mirror;
+};
+
+struct chip8_cache *
+chip8_cache_init(size_t budget)
+{
+    size_t capacity = 1;
+    size_t slot = sizeof(struct chip8_cache_tag) + sizeof(struct chip8_cache_entry);
+    if (budget < slot) {
+        return NULL;
+    }
+    while (capacity * 2 * slot <= budget && capacity < (1u << 31u)) {
+        capacity *= 2;
+    }
+
+    struct chip8_cache *cache = calloc(1, sizeof(*cache));
+    if (cache == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+    cache->tags = calloc(capacity, sizeof(*cache->tags));
+    cache->entries = malloc(capacity * sizeof(*cache->entries));
+    if (cache->tags == NULL || cache->entries == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+    cache->mask = (uint32_t)(capacity - 1);
+    cache->stats.capacity = (uint32_t)capacity;
+    return cache;
+}
+
+void
+chip8_cache_free(struct chip8_cache *cache)
+{
+    if (cache->mirror) {
+        chip8_memory_free(cache->mirror);
+    }
+    free(cache->tags);
+    free(cache->entries);
+    free(cache);
+}
+
+void
+chip8_cache_clear(struct chip8_cache *cache)
+{
+    memset(cache->tags, 0, ((size_t)cache->mask + 1) * sizeof(*cache->tags));
+    cache->stats.entries = 0;
+    cache->owner = NULL;
+    if (cache->mirror) {
+        chip8_memory_free(cache->mirror);
+        cache->mirror = NULL;
+    }
+}
+
+void
+chip8_cache_get_stats(const struct chip8_cache *cache, struct chip8_cache_stats *stats)
+{
+    *stats = cache->stats;
+}
+
+static uint64_t
+chip8_cache_finish(uint64_t x)
+{
+    x ^= x >> 33u;
+    x *= 0xff51afd7ed558ccdu;
+    x ^= x >> 33u;
+    x *= 0xc4ceb9fe1a85ec53u;
+    x ^= x >> 33u;
+    return x;
+}
+
+static void
+chip8_cache_mix(struct chip8_hash *hash, uint64_t word)
+{
+    hash->low = chip8_cache_finish(hash->low ^ word);
+    hash->high = chip8_cache_finish(hash->high + word);
+}
+
+/***
+ * Add or, with a negative sign, remove the term of one memory byte
+ */
+static void
+chip8_cache_term(struct chip8_hash *hash, uint16_t address, uint8_t value, uint64_t sign)
+{
+    uint64_t x = (uint64_t)address << 8u | value;
+    hash->low += sign * chip8_cache_finish(x ^ CACHE_SEED_LOW);
+    hash->high += sign * chip8_cache_finish(x + CACHE_SEED_HIGH);
+}
+
+static uint64_t
+chip8_cache_rotate(uint64_t x, uint8_t r)
+{
+    return x << r | x >> (64u - r);
+}
+
+/***
+ * Two multiply-rotate lanes over the words, finished once, as it runs after every frame that
+ * drew
+ */
+static struct chip8_hash
+chip8_cache_frame_hash(const struct chip8 *chip8)
+{
+    struct chip8_hash hash = {CACHE_SEED_LOW, CACHE_SEED_HIGH};
+    uint64_t words[(sizeof(chip8->display->display) + sizeof(chip8->stack->stack)) / sizeof(uint64_t)];
+
+    memcpy(words, chip8->display->display, sizeof(chip8->display->display));
+    memcpy((uint8_t *)words + sizeof(chip8->display->display), chip8->stack->stack, sizeof(chip8->stack->stack));
+    for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+        hash.low = chip8_cache_rotate(hash.low ^ words[i], 29u) * 0x9e3779b97f4a7c15u;
+        hash.high = chip8_cache_rotate(hash.high + words[i], 31u) * 0xbf58476d1ce4e5b9u;
+    }
+    hash.low = chip8_cache_finish(hash.low);
+    hash.high = chip8_cache_finish(hash.high ^ hash.low);
+    return hash;
+}
+
+/***
+ * Fold the bytes of unshared pages that differ from the mirror into the memory hash, share the
+ * pages again and collect the bytes into the entry while it has room. Returns false if the
+ * entry overflowed, the hash is complete anyway.
+ */
+static bool
+chip8_cache_diff(struct chip8_cache *cache, const struct chip8_memory *memory, struct chip8_cache_entry *entry)
+{
+    uint64_t a, b;
+    bool fits = true;
+
+    entry->writes = 0;
+    for (uint16_t page = 0; page < MEMORY_PAGES; page++) {
+        if (memory->pages[page] == cache->mirror->pages[page]) {
+            continue;
+        }
+        const uint8_t *before = cache->mirror->pages[page]->bytes;
+        const uint8_t *after = memory->pages[page]->bytes;
+        for (uint16_t i = 0; i < MEMORY_PAGE_SIZE; i += sizeof(a)) {
+            memcpy(&a, before + i, sizeof(a));
+            memcpy(&b, after + i, sizeof(b));
+            if (a == b) {
+                continue;
+            }
+            for (uint16_t j = i; j < i + sizeof(a); j++) {
+                if (before[j] == after[j]) {
+                    continue;
+                }
+                uint16_t address = page * MEMORY_PAGE_SIZE + j;
+                chip8_cache_term(&cache->memory, address, before[j], -1);
+                chip8_cache_term(&cache->memory, address, after[j], 1);
+                if (entry->writes == CACHE_MAX_WRITES) {
+                    fits = false;
+                    continue;
+                }
+                entry->addresses[entry->writes] = address;
+                entry->values[entry->writes++] = after[j];
+            }
+        }
+        chip8_memory_share(cache->mirror, memory, page);
+    }
+    return fits;
+}
+
+/***
+ * Bring the hashes up to date with the machine. Return false if memory changed in more bytes
+ * than an entry holds.
+ */
+static bool
+chip8_cache_sync(struct chip8_cache *cache, const struct chip8 *chip8, struct chip8_cache_entry *scratch)
+{
+    bool fits = true;
+
+    scratch->writes = 0;
+    if (cache->owner != chip8) {
+        cache->owner = chip8;
+        if (cache->mirror) {
+            chip8_memory_free(cache->mirror);
+        }
+        cache->mirror = chip8_memory_fork(chip8->memory);
+        cache->memory = (struct chip8_hash){0, 0};
+        for (uint16_t address = 0; address < MEMORY_SIZE; address++) {
+            chip8_cache_term(&cache->memory, address, chip8_memory_get(cache->mirror, address), 1);
+        }
+        cache->version = chip8->memory_version - 1;
+    }
+    if (cache->version != chip8->memory_version) {
+        fits = chip8_cache_diff(cache, chip8->memory, scratch);
+        cache->version = chip8->memory_version;
+        cache->effects = chip8->effects - 1;
+    }
+    if (cache->effects != chip8->effects) {
+        cache->frame = chip8_cache_frame_hash(chip8);
+        cache->effects = chip8->effects;
+    }
+    return fits;
+}
+
+/***
+ * Key of the machine state, the cached memory, display and stack hashes plus the registers.
+ */
+static struct chip8_hash
+chip8_cache_key(const struct chip8_cache *cache, const struct chip8 *chip8)
+{
+    const struct chip8_registers *registers = chip8->registers;
+    struct chip8_hash hash = cache->memory;
+    uint64_t V[2];
+
+    memcpy(V, registers->V, sizeof(V));
+    chip8_cache_mix(&hash, cache->frame.low);
+    chip8_cache_mix(&hash, cache->frame.high);
+    chip8_cache_mix(&hash, V[0]);
+    chip8_cache_mix(&hash, V[1]);
+    chip8_cache_mix(&hash, (uint64_t)registers->I | (uint64_t)registers->PC << 16u |
+                           (uint64_t)registers->DT << 32u | (uint64_t)registers->ST << 40u |
+                           (uint64_t)registers->SP << 48u | (uint64_t)chip8->fault << 56u);
+    chip8_cache_mix(&hash, (uint64_t)chip8->random | (uint64_t)chip8->fault_pc << 32u |
+                           (uint64_t)chip8->waiting << 48u | (uint64_t)chip8->cycle << 56u);
+    return hash;
+}
+
+static uint32_t
+chip8_cache_slot(struct chip8_hash key, uint16_t keys, uint32_t way)
+{
+    return (uint32_t)(key.low ^ keys * 0x9e3779b9u) + way;
+}
+
+/***
+ * Slots are never emptied one at a time, so the first free slot ends the probe.
+ */
+static uint32_t
+chip8_cache_lookup(struct chip8_cache *cache, struct chip8_hash key, uint16_t keys)
+{
+    for (uint32_t i = 0; i < CACHE_WAYS; i++) {
+        uint32_t slot = chip8_cache_slot(key, keys, i) & cache->mask;
+        const struct chip8_cache_tag *tag = &cache->tags[slot];
+        if (!tag->used) {
+            return CACHE_MISSING;
+        }
+        if (tag->keys == keys && chip8_hash_equal(tag->key, key)) {
+            return slot;
+        }
+    }
+    return CACHE_MISSING;
+}
+
+static uint32_t
+chip8_cache_insert(struct chip8_cache *cache, struct chip8_hash key, uint16_t keys)
+{
+    uint32_t ways = cache->mask + 1 < CACHE_WAYS ? cache->mask + 1 : CACHE_WAYS;
+    uint32_t slot;
+
+    for (uint32_t i = 0; i < ways; i++) {
+        slot = chip8_cache_slot(key, keys, i) & cache->mask;
+        if (!cache->tags[slot].used) {
+            cache->stats.entries++;
+            goto found;
+        }
+    }
+
+    /* Every slot is taken: sweep the window clearing reference bits until one is unset */
+    uint32_t start = cache->hand++;
+    for (uint32_t i = 0;; i++) {
+        slot = chip8_cache_slot(key, keys, (start + i) % ways) & cache->mask;
+        if (!cache->tags[slot].referenced) {
+            cache->stats.evictions++;
+            break;
+        }
+        cache->tags[slot].referenced = false;
+    }
+
+found:
+    cache->tags[slot].key = key;
+    cache->tags[slot].keys = keys;
+    cache->tags[slot].used = true;
+    cache->tags[slot].referenced = false;
+    return slot;
+}
+
+static void
+chip8_cache_restore(struct chip8_cache *cache, const struct chip8_cache_entry *entry, struct chip8 *chip8)
+{
+    *chip8->registers = entry->registers;
+    chip8->random = entry->random;
+    chip8->fault_pc = entry->fault_pc;
+    chip8->fault = entry->fault;
+    chip8->waiting = entry->waiting;
+    if (entry->effects) {
+        *chip8->stack = entry->stack;
+        *chip8->display = entry->display;
+        chip8->effects++;
+        cache->effects = chip8->effects;
+        cache->frame = entry->frame;
+    }
+    if (entry->writes) {
+        for (uint8_t i = 0; i < entry->writes; i++) {
+            chip8_memory_set(chip8->memory, entry->addresses[i], entry->values[i]);
+        }
+        for (uint16_t page = 0; page < MEMORY_PAGES; page++) {
+            chip8_memory_share(cache->mirror, chip8->memory, page);
+        }
+        chip8->memory_version++;
+        cache->version = chip8->memory_version;
+        cache->memory = entry->memory;
+    }
+    if (chip8->shm) {
+        chip8_shm_publish(chip8->shm, chip8);
+    }
+}
+
+bool
+chip8_cache_step(struct chip8_cache *cache, struct chip8 *chip8)
+{
+    uint16_t keys = *chip8->keyboard->keyboard;
+    struct chip8_cache_entry scratch;
+    chip8_cache_sync(cache, chip8, &scratch);
+    struct chip8_hash key = chip8_cache_key(cache, chip8);
+
+    uint32_t slot = chip8_cache_lookup(cache, key, keys);
+    if (slot != CACHE_MISSING) {
+        cache->stats.hits++;
+        cache->tags[slot].referenced = true;
+        chip8_cache_restore(cache, &cache->entries[slot], chip8);
+        return chip8_registers_get_ST(chip8->registers);
+    }
+    cache->stats.misses++;
+
+    uint32_t effects = chip8->effects;
+    bool sound = chip8_step(chip8);
+    if (!chip8_cache_sync(cache, chip8, &scratch)) {
+        cache->stats.uncacheable++;
+        return sound;
+    }
+
+    struct chip8_cache_entry *entry = &cache->entries[chip8_cache_insert(cache, key, keys)];
+    entry->memory = cache->memory;
+    entry->frame = cache->frame;
+    entry->effects = chip8->effects != effects;
+    entry->registers = *chip8->registers;
+    if (entry->effects) {
+        entry->stack = *chip8->stack;
+        entry->display = *chip8->display;
+    }
+    entry->random = chip8->random;
+    entry->fault_pc = chip8->fault_pc;
+    entry->fault = chip8->fault;
+    entry->waiting = chip8->waiting;
+    entry->writes = scratch.writes;
+    memcpy(entry->addresses, scratch.addresses, scratch.writes * sizeof(*scratch.addresses));
+    memcpy(entry->values, scratch.values, scratch.writes);
+    return sound;
+}
@@ -0,0 +1,325 @@
+#include "inc/chip8_env.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "inc/chip8.h"
+#include "inc/chip8_display.h"
+#include "inc/chip8_memory.h"
+
+#define PROGRAM_MAX_SIZE (MEMORY_SIZE - PROGRAM_START_ADDR)
+
+struct chip8_env_machine {
+    struct chip8 *chip8;
+    uint16_t keyboard;
+    uint8_t watched[ENV_MAX_WATCH];
+    uint32_t frames;                /* Frames since the episode started */
+    uint32_t episode;               /* Episodes started, mixed into the seed */
+    bool done;
+};
+
+struct chip8_env_job {
+    const uint16_t *actions;
+    uint8_t *observations;
+    float *rewards;
+    bool *dones;
+    uint16_t count;
+};
+
+struct chip8_env_worker {
+    struct chip8_env *env;
+    pthread_t thread;
+    uint16_t index;
+};
+
+struct chip8_env {
+    struct chip8_env_config config;
+    uint8_t program[PROGRAM_MAX_SIZE];
+    uint32_t size;
+    uint64_t seed;
+    struct chip8_env_machine *machines;
+
+    /* Worker 0 is the calling thread */
+    struct chip8_env_worker *workers;
+    uint16_t threads;
+    struct chip8_env_job job;
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t finished;
+    uint32_t generation;
+    uint16_t running;
+    bool quit;
+};
+
+static void *chip8_env_worker_main(void *arg);
+
+/***
+ * splitmix64 finalizer
+ */
+static uint32_t
+chip8_env_seed(uint64_t seed, uint16_t index, uint32_t episode)
+{
+    uint64_t z = seed ^ ((uint64_t)index << 32u | episode);
+    z = (z ^ (z >> 30u)) * 0xbf58476d1ce4e5b9u;
+    z = (z ^ (z >> 27u)) * 0x94d049bb133111ebu;
+    return (uint32_t)(z ^ (z >> 31u));
+}
+
+static void
+chip8_env_read_watched(const struct chip8_env *env, struct chip8_env_machine *machine)
+{
+    for (uint8_t i = 0; i < env->config.watch_count; i++) {
+        machine->watched[i] = chip8_memory_get(machine->chip8->memory, env->config.watch[i]);
+    }
+}
+
+static void
+chip8_env_restart(struct chip8_env *env, uint16_t index)
+{
+    struct chip8_env_machine *machine = &env->machines[index];
+
+    chip8_reset(machine->chip8, chip8_env_seed(env->seed, index, machine->episode++));
+    chip8_load_program(machine->chip8, env->program, env->size);
+    machine->keyboard = 0;
+    machine->frames = 0;
+    machine->done = false;
+    chip8_env_read_watched(env, machine);
+}
+
+/***
+ * Value of the watched bytes taken as decimal digits, most significant first.
+ */
+static int32_t
+chip8_env_bcd(const uint8_t *digits, uint8_t count)
+{
+    int32_t value = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        value = value * 10 + digits[i];
+    }
+    return value;
+}
+
+static void
+chip8_env_observe(const struct chip8_env *env, const struct chip8_env_machine *machine, uint8_t *observation)
+{
+    const uint64_t *rows = machine->chip8->display->display;
+
+    if (env->config.observation == ENV_OBSERVATION_BITPLANE) {
+        memcpy(observation, rows, DISPLAY_HEIGHT * sizeof(*rows));
+        return;
+    }
+    for (uint8_t row = 0; row < DISPLAY_HEIGHT; row++) {
+        for (uint8_t col = 0; col < DISPLAY_WIDTH; col++) {
+            *observation++ = (rows[row] >> (DISPLAY_WIDTH - 1 - col)) & 1u;
+        }
+    }
+}
+
+static void
+chip8_env_step_machine(struct chip8_env *env, uint16_t index)
+{
+    const struct chip8_env_config *config = &env->config;
+    const struct chip8_env_job *job = &env->job;
+    struct chip8_env_machine *machine = &env->machines[index];
+    uint8_t previous[ENV_MAX_WATCH];
+
+    if (machine->done) {
+        chip8_env_restart(env, index);
+    }
+    memcpy(previous, machine->watched, sizeof(previous));
+    machine->keyboard = job->actions[index];
+
+    for (uint8_t frame = 0; frame < config->frame_skip && !machine->done; frame++) {
+        chip8_step(machine->chip8);
+        machine->frames++;
+        chip8_env_read_watched(env, machine);
+        machine->done = (config->max_frames && machine->frames >= config->max_frames) || machine->chip8->fault ||
+                        (config->done && config->done(machine->watched, config->watch_count, config->user));
+    }
+
+    if (config->reward) {
+        job->rewards[index] = config->reward(machine->watched, previous, config->watch_count, config->user);
+    } else {
+        job->rewards[index] = (float)(chip8_env_bcd(machine->watched, config->watch_count) -
+                                      chip8_env_bcd(previous, config->watch_count));
+    }
+    job->dones[index] = machine->done;
+    chip8_env_observe(env, machine, job->observations + index * chip8_env_observation_size(env));
+}
+
+static void
+chip8_env_run_slice(struct chip8_env *env, uint16_t worker)
+{
+    uint16_t first = (uint32_t)env->job.count * worker / env->threads;
+    uint16_t last = (uint32_t)env->job.count * (worker + 1) / env->threads;
+
+    for (uint16_t i = first; i < last; i++) {
+        chip8_env_step_machine(env, i);
+    }
+}
+
+static void *
+chip8_env_worker_main(void *arg)
+{
+    struct chip8_env_worker *worker = arg;
+    struct chip8_env *env = worker->env;
+    uint32_t generation = 0;
+
+    pthread_mutex_lock(&env->lock);
+    while (true) {
+        while (env->generation == generation && !env->quit) {
+            pthread_cond_wait(&env->start, &env->lock);
+        }
+        if (env->quit) {
+            break;
+        }
+        generation = env->generation;
+        pthread_mutex_unlock(&env->lock);
+
+        chip8_env_run_slice(env, worker->index);
+
+        pthread_mutex_lock(&env->lock);
+        if (--env->running == 0) {
+            pthread_cond_signal(&env->finished);
+        }
+    }
+    pthread_mutex_unlock(&env->lock);
+    return NULL;
+}
+
+static uint16_t
+chip8_env_thread_count(const struct chip8_env_config *config)
+{
+    long threads = config->threads ? config->threads : sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) {
+        threads = 1;
+    }
+    return threads < config->envs ? (uint16_t)threads : config->envs;
+}
+
+struct chip8_env *
+chip8_env_init(const uint8_t *program, uint32_t size, const struct chip8_env_config *config)
+{
+    if (config->envs == 0 || size > PROGRAM_MAX_SIZE || config->watch_count > ENV_MAX_WATCH) {
+        return NULL;
+    }
+    for (uint8_t i = 0; i < config->watch_count; i++) {
+        if (config->watch[i] >= MEMORY_SIZE) {
+            return NULL;
+        }
+    }
+
+    struct chip8_env *env = calloc(1, sizeof(*env));
+    if (env == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+    env->config = *config;
+    if (env->config.frame_skip == 0) {
+        env->config.frame_skip = 1;
+    }
+    memcpy(env->program, program, size);
+    env->size = size;
+
+    env->machines = calloc(config->envs, sizeof(*env->machines));
+    env->threads = chip8_env_thread_count(config);
+    env->workers = calloc(env->threads, sizeof(*env->workers));
+    if (env->machines == NULL || env->workers == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+    for (uint16_t i = 0; i < config->envs; i++) {
+        env->machines[i].chip8 = chip8_init(&env->machines[i].keyboard);
+    }
+
+    pthread_mutex_init(&env->lock, NULL);
+    pthread_cond_init(&env->start, NULL);
+    pthread_cond_init(&env->finished, NULL);
+    for (uint16_t i = 0; i < env->threads; i++) {
+        env->workers[i].env = env;
+        env->workers[i].index = i;
+        if (i && pthread_create(&env->workers[i].thread, NULL, chip8_env_worker_main, &env->workers[i])) {
+            puts("Error creating thread!");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    chip8_env_reset(env, 0, NULL);
+    return env;
+}
+
+void
+chip8_env_free(struct chip8_env *env)
+{
+    pthread_mutex_lock(&env->lock);
+    env->quit = true;
+    pthread_cond_broadcast(&env->start);
+    pthread_mutex_unlock(&env->lock);
+    for (uint16_t i = 1; i < env->threads; i++) {
+        pthread_join(env->workers[i].thread, NULL);
+    }
+    pthread_cond_destroy(&env->finished);
+    pthread_cond_destroy(&env->start);
+    pthread_mutex_destroy(&env->lock);
+
+    for (uint16_t i = 0; i < env->config.envs; i++) {
+        chip8_free(env->machines[i].chip8);
+    }
+    free(env->machines);
+    free(env->workers);
+    free(env);
+}
+
+size_t
+chip8_env_observation_size(const struct chip8_env *env)
+{
+    if (env->config.observation == ENV_OBSERVATION_BITPLANE) {
+        return DISPLAY_HEIGHT * sizeof(uint64_t);
+    }
+    return DISPLAY_WIDTH * DISPLAY_HEIGHT;
+}
+
+void
+chip8_env_reset(struct chip8_env *env, uint64_t seed, uint8_t *observations)
+{
+    env->seed = seed;
+    for (uint16_t i = 0; i < env->config.envs; i++) {
+        env->machines[i].episode = 0;
+        chip8_env_restart(env, i);
+        if (observations) {
+            chip8_env_observe(env, &env->machines[i], observations + i * chip8_env_observation_size(env));
+        }
+    }
+}
+
+void
+chip8_env_step(struct chip8_env *env, const uint16_t *actions, uint16_t n_envs, uint8_t *observations,
+               float *rewards, bool *dones)
+{
+    env->job.actions = actions;
+    env->job.observations = observations;
+    env->job.rewards = rewards;
+    env->job.dones = dones;
+    env->job.count = n_envs < env->config.envs ? n_envs : env->config.envs;
+
+    if (env->threads > 1) {
+        pthread_mutex_lock(&env->lock);
+        env->running = env->threads - 1;
+        env->generation++;
+        pthread_cond_broadcast(&env->start);
+        pthread_mutex_unlock(&env->lock);
+    }
+
+    chip8_env_run_slice(env, 0);
+
+    if (env->threads > 1) {
+        pthread_mutex_lock(&env->lock);
+        while (env->running) {
+            pthread_cond_wait(&env->finished, &env->lock);
+        }
+        pthread_mutex_unlock(&env->lock);
+    }
+}
@@ -0,0 +1,35 @@
+#include "inc/chip8_frames.h"
+
+#include <string.h>
+
+void
+chip8_frames_init(struct chip8_frames *frames)
+{
+    memset(frames, 0, sizeof(*frames));
+    frames->back = 0;
+    frames->middle = 1;
+    frames->front = 2;
+}
+
+void
+chip8_frames_publish(struct chip8_frames *frames, const struct chip8_display *display)
+{
+    struct chip8_frame *frame = &frames->slots[frames->back];
+    frame->display = *display;
+    frame->sequence = ++frames->sequence;
+
+    /* Release makes the rows visible to whoever takes the slot next */
+    uint32_t previous = __atomic_exchange_n(&frames->middle, frames->back | FRAMES_FRESH, __ATOMIC_ACQ_REL);
+    frames->back = previous & FRAMES_SLOT_MASK;
+}
+
+const struct chip8_frame *
+chip8_frames_acquire(struct chip8_frames *frames)
+{
+    if (!(__atomic_load_n(&frames->middle, __ATOMIC_RELAXED) & FRAMES_FRESH)) {
+        return NULL;
+    }
+    uint32_t previous = __atomic_exchange_n(&frames->middle, frames->front, __ATOMIC_ACQ_REL);
+    frames->front = previous & FRAMES_SLOT_MASK;
+    return &frames->slots[frames->front];
+}
@@ -0,0 +1,156 @@
+#include "inc/chip8_heatmap.h"
+
+#include <stdlib.h>
+
+struct chip8_heatmap *
+chip8_heatmap_init(void)
+{
+    struct chip8_heatmap *heatmap = calloc(1, sizeof(*heatmap));
+    if (heatmap == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+    return heatmap;
+}
+
+void
+chip8_heatmap_free(struct chip8_heatmap *heatmap)
+{
+    free(heatmap);
+}
+
+static void
+chip8_heatmap_count(struct chip8_heatmap *heatmap, enum chip8_heatmap_access access, uint16_t address)
+{
+    uint32_t *count = &heatmap->counts[access][address];
+    *count += *count != UINT32_MAX;
+}
+
+static void
+chip8_heatmap_execute(struct chip8_heatmap *heatmap, uint16_t address)
+{
+    if (heatmap->counts[HEATMAP_WRITE][address]) {
+        heatmap->flags[address] |= HEATMAP_GENERATED;
+        heatmap->generated++;
+    }
+    chip8_heatmap_count(heatmap, HEATMAP_EXECUTE, address);
+}
+
+static void
+chip8_heatmap_write(struct chip8_heatmap *heatmap, uint16_t pc, uint16_t address)
+{
+    if (heatmap->counts[HEATMAP_EXECUTE][address]) {
+        if (heatmap->modified++ == 0) {
+            heatmap->first_writer = pc;
+            heatmap->first_modified = address;
+        }
+        heatmap->flags[address] |= HEATMAP_MODIFIED;
+    }
+    chip8_heatmap_count(heatmap, HEATMAP_WRITE, address);
+}
+
+/***
+ * Count size bytes from I, the instruction faults on anything past the end of memory
+ */
+static void
+chip8_heatmap_range(struct chip8_heatmap *heatmap, enum chip8_heatmap_access access, uint16_t pc, uint16_t I,
+                    uint8_t size)
+{
+    for (uint16_t address = I; address < I + size && address < MEMORY_SIZE; address++) {
+        if (access == HEATMAP_WRITE) {
+            chip8_heatmap_write(heatmap, pc, address);
+        } else {
+            chip8_heatmap_count(heatmap, access, address);
+        }
+    }
+}
+
+void
+chip8_heatmap_record(struct chip8_heatmap *heatmap, uint16_t pc, uint16_t instruction, uint16_t I)
+{
+    uint8_t x = (instruction >> (2 * NIBBLE)) & 0x0fu;
+
+    chip8_heatmap_execute(heatmap, pc);
+    chip8_heatmap_execute(heatmap, pc + 1);
+    if ((instruction >> (3 * NIBBLE)) == 0xd) {
+        chip8_heatmap_range(heatmap, HEATMAP_SPRITE, pc, I, instruction & 0x0fu);
+    } else if ((instruction & 0xf0ffu) == 0xf033) {
+        chip8_heatmap_range(heatmap, HEATMAP_WRITE, pc, I, 3);
+    } else if ((instruction & 0xf0ffu) == 0xf055) {
+        chip8_heatmap_range(heatmap, HEATMAP_WRITE, pc, I, x + 1);
+    } else if ((instruction & 0xf0ffu) == 0xf065) {
+        chip8_heatmap_range(heatmap, HEATMAP_READ, pc, I, x + 1);
+    }
+}
+
+bool
+chip8_heatmap_write_csv(const struct chip8_heatmap *heatmap, FILE *fp)
+{
+    bool ok = fprintf(fp, "address,execute,sprite,read,write,modified,generated\n") > 0;
+    for (uint16_t address = 0; address < MEMORY_SIZE && ok; address++) {
+        const uint32_t *counts[HEATMAP_ACCESSES];
+        uint64_t total = 0;
+        for (int access = 0; access < HEATMAP_ACCESSES; access++) {
+            counts[access] = &heatmap->counts[access][address];
+            total += *counts[access];
+        }
+        if (total == 0) {
+            continue;
+        }
+        ok = fprintf(fp, "0x%03x,%u,%u,%u,%u,%u,%u\n", address, *counts[HEATMAP_EXECUTE], *counts[HEATMAP_SPRITE],
+                     *counts[HEATMAP_READ], *counts[HEATMAP_WRITE],
+                     (heatmap->flags[address] & HEATMAP_MODIFIED) != 0,
+                     (heatmap->flags[address] & HEATMAP_GENERATED) != 0) > 0;
+    }
+    return ok && fflush(fp) == 0;
+}
+
+/***
+ * Number of significant bits, a logarithm that keeps the library off libm
+ */
+static uint8_t
+chip8_heatmap_bits(uint32_t count)
+{
+    uint8_t bits = 0;
+    for (; count; count >>= 1u) {
+        bits++;
+    }
+    return bits;
+}
+
+bool
+chip8_heatmap_write_pgm(const struct chip8_heatmap *heatmap, enum chip8_heatmap_access access, FILE *fp)
+{
+    const uint32_t *counts = heatmap->counts[access];
+    uint8_t max = 1;
+    for (uint16_t address = 0; address < MEMORY_SIZE; address++) {
+        uint8_t bits = chip8_heatmap_bits(counts[address]);
+        max = bits > max ? bits : max;
+    }
+
+    uint8_t pixels[MEMORY_SIZE];
+    for (uint16_t address = 0; address < MEMORY_SIZE; address++) {
+        /* Anything touched at all is at least dimly visible */
+        pixels[address] = counts[address] ? 32 + 223 * chip8_heatmap_bits(counts[address]) / max : 0;
+    }
+    return fprintf(fp, "P5\n%d %d\n255\n", HEATMAP_WIDTH, MEMORY_SIZE / HEATMAP_WIDTH) > 0 &&
+           fwrite(pixels, 1, sizeof(pixels), fp) == sizeof(pixels) && fflush(fp) == 0;
+}
+
+const char *
+chip8_heatmap_access_name(enum chip8_heatmap_access access)
+{
+    switch (access) {
+        case HEATMAP_EXECUTE:
+            return "execute";
+        case HEATMAP_SPRITE:
+            return "sprite";
+        case HEATMAP_READ:
+            return "read";
+        case HEATMAP_WRITE:
+            return "write";
+        case HEATMAP_ACCESSES:
+            break;
+    }
+    return "unknown";
+}
@@ -0,0 +1,26 @@
+#include "inc/chip8_idle.h"
+
+void
+chip8_idle_begin_frame(struct chip8_idle *idle)
+{
+    idle->armed = false;
+}
+
+uint8_t
+chip8_idle_check(struct chip8_idle *idle, const struct chip8_registers *registers, uint32_t effects,
+                 uint8_t cycle, uint8_t cycles)
+{
+    uint8_t skip = 0;
+
+    if (idle->armed && idle->effects == effects && chip8_registers_equal(&idle->registers, registers)) {
+        uint8_t length = cycle - idle->cycle;
+        uint8_t remaining = cycles - cycle - 1;
+        skip = remaining - remaining % length;
+    }
+
+    idle->registers = *registers;
+    idle->effects = effects;
+    idle->cycle = cycle + skip;
+    idle->armed = true;
+    return skip;
+}
@@ -2,6 +2,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #define SPRITE_HEIGHT 5
 #define SPRITE_MEMORY_START 0
@@ -25,6 +26,47 @@ static const uint8_t digit_sprites[] = {
     0xf0, 0x80, 0xf0, 0x80, 0x80    /* F */
 };
 
+static struct chip8_memory_page *
+chip8_memory_page_init(void)
+{
+    struct chip8_memory_page *page = malloc(sizeof(*page));
+    if (page == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+    page->references = 1;
+    return page;
+}
+
+static void
+chip8_memory_page_release(struct chip8_memory_page *page)
+{
+    if (__atomic_sub_fetch(&page->references, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(page);
+    }
+}
+
+/***
+ * Give the memory a page of its own to write to, copying the contents if keep is set.
+ * Forks may run on other threads, so the last one to let go of a page frees it.
+ */
+static uint8_t *
+chip8_memory_own(struct chip8_memory *memory, uint16_t page, bool keep)
+{
+    struct chip8_memory_page *shared = memory->pages[page];
+    if (__atomic_load_n(&shared->references, __ATOMIC_ACQUIRE) == 1) {
+        return shared->bytes;
+    }
+    struct chip8_memory_page *copy = chip8_memory_page_init();
+    if (keep) {
+        memcpy(copy->bytes, shared->bytes, sizeof(copy->bytes));
+        memory->copied++;
+    }
+    chip8_memory_page_release(shared);
+    memory->pages[page] = copy;
+    return copy->bytes;
+}
+
 struct chip8_memory *
 chip8_memory_init(void)
 {
@@ -33,24 +75,137 @@ chip8_memory_init(void)
         puts("Error allocating memory!");
         exit(EXIT_FAILURE);
     }
-    for (int i = 0; i < sizeof(digit_sprites) / sizeof(digit_sprites[0]); i++) {
-        memory->memory[SPRITE_MEMORY_START + i] = digit_sprites[i];
+    for (uint16_t page = 0; page < MEMORY_PAGES; page++) {
+        memory->pages[page] = chip8_memory_page_init();
     }
+    chip8_memory_reset(memory);
     return memory;
 }
 
+struct chip8_memory *
+chip8_memory_fork(const struct chip8_memory *memory)
+{
+    struct chip8_memory *fork = calloc(1, sizeof(*fork));
+    if (fork == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+    for (uint16_t page = 0; page < MEMORY_PAGES; page++) {
+        __atomic_add_fetch(&memory->pages[page]->references, 1, __ATOMIC_RELAXED);
+        fork->pages[page] = memory->pages[page];
+    }
+    return fork;
+}
+
+void
+chip8_memory_share(struct chip8_memory *memory, const struct chip8_memory *source, uint16_t page)
+{
+    if (memory->pages[page] == source->pages[page]) {
+        return;
+    }
+    __atomic_add_fetch(&source->pages[page]->references, 1, __ATOMIC_RELAXED);
+    chip8_memory_page_release(memory->pages[page]);
+    memory->pages[page] = source->pages[page];
+}
+
+void
+chip8_memory_free(struct chip8_memory *memory)
+{
+    for (uint16_t page = 0; page < MEMORY_PAGES; page++) {
+        chip8_memory_page_release(memory->pages[page]);
+    }
+    free(memory);
+}
+
+void
+chip8_memory_reset(struct chip8_memory *memory)
+{
+    for (uint16_t page = 0; page < MEMORY_PAGES; page++) {
+        memset(chip8_memory_own(memory, page, false), 0, MEMORY_PAGE_SIZE);
+    }
+    chip8_memory_write(memory, SPRITE_MEMORY_START, digit_sprites, sizeof(digit_sprites));
+}
+
 uint16_t
 chip8_memory_fetch(const struct chip8_memory *memory, uint16_t pc)
 {
-    return ((uint16_t)memory->memory[pc]) << 8u | ((uint16_t)memory->memory[pc + 1]);
+    return ((uint16_t)chip8_memory_get(memory, pc)) << 8u | ((uint16_t)chip8_memory_get(memory, pc + 1));
+}
+
+uint8_t
+chip8_memory_get(const struct chip8_memory *memory, uint16_t address)
+{
+    return memory->pages[address / MEMORY_PAGE_SIZE]->bytes[address % MEMORY_PAGE_SIZE];
+}
+
+void
+chip8_memory_set(struct chip8_memory *memory, uint16_t address, uint8_t value)
+{
+    chip8_memory_own(memory, address / MEMORY_PAGE_SIZE, true)[address % MEMORY_PAGE_SIZE] = value;
+}
+
+const uint8_t *
+chip8_memory_span(const struct chip8_memory *memory, uint16_t address, uint16_t size, uint8_t *scratch)
+{
+    if (address % MEMORY_PAGE_SIZE + size <= MEMORY_PAGE_SIZE) {
+        return &memory->pages[address / MEMORY_PAGE_SIZE]->bytes[address % MEMORY_PAGE_SIZE];
+    }
+    chip8_memory_read(memory, address, scratch, size);
+    return scratch;
+}
+
+void
+chip8_memory_read(const struct chip8_memory *memory, uint16_t address, uint8_t *buffer, uint32_t size)
+{
+    while (size) {
+        uint32_t offset = address % MEMORY_PAGE_SIZE;
+        uint32_t length = MEMORY_PAGE_SIZE - offset < size ? MEMORY_PAGE_SIZE - offset : size;
+        memcpy(buffer, &memory->pages[address / MEMORY_PAGE_SIZE]->bytes[offset], length);
+        buffer += length;
+        address += length;
+        size -= length;
+    }
+}
+
+void
+chip8_memory_write(struct chip8_memory *memory, uint16_t address, const uint8_t *buffer, uint32_t size)
+{
+    while (size) {
+        uint16_t page = address / MEMORY_PAGE_SIZE;
+        uint32_t offset = address % MEMORY_PAGE_SIZE;
+        uint32_t length = MEMORY_PAGE_SIZE - offset < size ? MEMORY_PAGE_SIZE - offset : size;
+        if (memcmp(&memory->pages[page]->bytes[offset], buffer, length) != 0) {
+            memcpy(chip8_memory_own(memory, page, true) + offset, buffer, length);
+        }
+        buffer += length;
+        address += length;
+        size -= length;
+    }
+}
+
+bool
+chip8_memory_equal(const struct chip8_memory *memory, uint16_t address, const uint8_t *bytes, uint32_t size)
+{
+    while (size) {
+        uint32_t offset = address % MEMORY_PAGE_SIZE;
+        uint32_t length = MEMORY_PAGE_SIZE - offset < size ? MEMORY_PAGE_SIZE - offset : size;
+        if (memcmp(&memory->pages[address / MEMORY_PAGE_SIZE]->bytes[offset], bytes, length) != 0) {
+            return false;
+        }
+        bytes += length;
+        address += length;
+        size -= length;
+    }
+    return true;
 }
 
 void
 chip8_memory_load_program(struct chip8_memory *memory, const uint8_t *program, uint32_t size)
 {
-    for (int i = 0; i < size; i++) {
-        memory->memory[PROGRAM_START_ADDR + i] = program[i];
+    if (size > MEMORY_SIZE - PROGRAM_START_ADDR) {
+        size = MEMORY_SIZE - PROGRAM_START_ADDR;
     }
+    chip8_memory_write(memory, PROGRAM_START_ADDR, program, size);
 }
 
 uint16_t
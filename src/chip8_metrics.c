@@ -0,0 +1,166 @@
+#include "inc/chip8_metrics.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+static uint64_t
+chip8_metrics_clock(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void
+chip8_metrics_restart(struct chip8_metrics *metrics, uint64_t now)
+{
+    for (int phase = 0; phase < METRICS_PHASES; phase++) {
+        metrics->phase_time[phase] = 0;
+    }
+    for (int bucket = 0; bucket < METRICS_BUCKETS; bucket++) {
+        metrics->histogram[bucket] = 0;
+    }
+    metrics->phase_start = now;
+    metrics->interval_start = now;
+    metrics->cpu_start = chip8_metrics_clock(CLOCK_PROCESS_CPUTIME_ID);
+    metrics->instructions = 0;
+    metrics->frames = 0;
+    metrics->missed = 0;
+}
+
+struct chip8_metrics *
+chip8_metrics_init(double frame_budget)
+{
+    struct chip8_metrics *metrics = calloc(1, sizeof(*metrics));
+    if (metrics == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+    metrics->frame_budget = (uint64_t)(frame_budget * 1e6);
+    metrics->phase = METRICS_OTHER;
+    chip8_metrics_restart(metrics, chip8_metrics_clock(CLOCK_MONOTONIC));
+    return metrics;
+}
+
+void
+chip8_metrics_free(struct chip8_metrics *metrics)
+{
+    free(metrics);
+}
+
+void
+chip8_metrics_enter(struct chip8_metrics *metrics, enum chip8_metrics_phase phase)
+{
+    uint64_t now = chip8_metrics_clock(CLOCK_MONOTONIC);
+    metrics->phase_time[metrics->phase] += now - metrics->phase_start;
+    metrics->phase_start = now;
+    metrics->phase = phase;
+}
+
+void
+chip8_metrics_frame(struct chip8_metrics *metrics)
+{
+    uint64_t now = chip8_metrics_clock(CLOCK_MONOTONIC);
+    if (metrics->last_frame) {
+        uint64_t elapsed = now - metrics->last_frame;
+        uint64_t bucket = elapsed / (METRICS_BUCKET_US * 1000u);
+        metrics->histogram[bucket < METRICS_BUCKETS ? bucket : METRICS_BUCKETS - 1]++;
+        metrics->missed += elapsed * 2 > metrics->frame_budget * 3;
+    }
+    metrics->last_frame = now;
+    metrics->frames++;
+}
+
+void
+chip8_metrics_idle(struct chip8_metrics *metrics)
+{
+    metrics->last_frame = 0;
+}
+
+void
+chip8_metrics_instructions(struct chip8_metrics *metrics, uint64_t instructions)
+{
+    metrics->instructions += instructions;
+}
+
+/***
+ * Upper edge of the bucket holding the given fraction of frame times, in milliseconds
+ */
+static double
+chip8_metrics_percentile(const struct chip8_metrics *metrics, double fraction)
+{
+    uint64_t total = 0, seen = 0;
+    for (int bucket = 0; bucket < METRICS_BUCKETS; bucket++) {
+        total += metrics->histogram[bucket];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    for (int bucket = 0; bucket < METRICS_BUCKETS; bucket++) {
+        seen += metrics->histogram[bucket];
+        if (seen >= fraction * total) {
+            return (bucket + 1) * METRICS_BUCKET_US / 1e3;
+        }
+    }
+    return METRICS_BUCKETS * METRICS_BUCKET_US / 1e3;
+}
+
+void
+chip8_metrics_report(struct chip8_metrics *metrics, struct chip8_metrics_report *report)
+{
+    chip8_metrics_enter(metrics, metrics->phase);
+    uint64_t now = metrics->phase_start;
+    uint64_t wall = now - metrics->interval_start;
+    double seconds = wall ? wall / 1e9 : 1e-9;
+
+    report->seconds = seconds;
+    report->ips = metrics->instructions / seconds;
+    report->fps = metrics->frames / seconds;
+    for (int phase = 0; phase < METRICS_PHASES; phase++) {
+        report->share[phase] = metrics->phase_time[phase] / 1e9 / seconds;
+    }
+    report->p50 = chip8_metrics_percentile(metrics, 0.50);
+    report->p95 = chip8_metrics_percentile(metrics, 0.95);
+    report->p99 = chip8_metrics_percentile(metrics, 0.99);
+    report->frames = metrics->frames;
+    report->missed = metrics->missed;
+    report->cpu = (chip8_metrics_clock(CLOCK_PROCESS_CPUTIME_ID) - metrics->cpu_start) / 1e9 / seconds;
+    report->thread = NULL;
+
+    chip8_metrics_restart(metrics, now);
+}
+
+void
+chip8_metrics_format(const struct chip8_metrics_report *report, const char *separator, char *buffer, size_t size)
+{
+    snprintf(buffer, size,
+             "%s%s"
+             "ips %.0f fps %.1f%s"
+             "emulate %.1f%% render %.1f%% sleep %.1f%%%s"
+             "frame p50 %.2f p95 %.2f p99 %.2f ms%s"
+             "missed %u cpu %.1f%%",
+             report->thread ? report->thread : "", report->thread ? separator : "",
+             report->ips, report->fps, separator,
+             report->share[METRICS_EMULATE] * 100, report->share[METRICS_RENDER] * 100,
+             report->share[METRICS_SLEEP] * 100, separator,
+             report->p50, report->p95, report->p99, separator,
+             report->missed, report->cpu * 100);
+}
+
+bool
+chip8_metrics_write(const struct chip8_metrics_report *report, FILE *fp)
+{
+    int written = fprintf(fp,
+                          "{\"time\": %lld, %s%s%s\"seconds\": %.3f, \"ips\": %.0f, \"fps\": %.2f, "
+                          "\"emulate\": %.4f, \"render\": %.4f, \"sleep\": %.4f, \"other\": %.4f, "
+                          "\"p50_ms\": %.2f, \"p95_ms\": %.2f, \"p99_ms\": %.2f, "
+                          "\"frames\": %u, \"missed\": %u, \"cpu\": %.4f}\n",
+                          (long long)time(NULL), report->thread ? "\"thread\": \"" : "",
+                          report->thread ? report->thread : "", report->thread ? "\", " : "",
+                          report->seconds, report->ips, report->fps,
+                          report->share[METRICS_EMULATE], report->share[METRICS_RENDER],
+                          report->share[METRICS_SLEEP], report->share[METRICS_OTHER],
+                          report->p50, report->p95, report->p99,
+                          report->frames, report->missed, report->cpu);
+    return written > 0 && fflush(fp) == 0;
+}
@@ -0,0 +1,347 @@
+#include "inc/chip8_netplay.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "inc/chip8.h"
+#include "inc/chip8_keyboard.h"
+#include "inc/chip8_state.h"
+
+#define NETPLAY_HEADER 17           /* magic, session, start, ack, count */
+#define NETPLAY_PACKET (NETPLAY_HEADER + 2 * NETPLAY_WINDOW)
+#define NETPLAY_QUEUE 256           /* Packets held back by the simulated latency */
+#define NETPLAY_NONE UINT32_MAX
+
+struct chip8_netplay_delayed {
+    uint64_t due;                   /* Milliseconds, CLOCK_MONOTONIC */
+    uint16_t size;
+    uint8_t bytes[NETPLAY_PACKET];
+};
+
+struct chip8_netplay {
+    struct chip8 *chip8;
+    struct chip8_netplay_config config;
+    int fd;
+    struct sockaddr_storage remote;
+    socklen_t remote_size;
+
+    uint32_t frame;                 /* Next frame to simulate */
+    uint16_t local[NETPLAY_WINDOW];     /* Local input by frame */
+    uint16_t remote_input[NETPLAY_WINDOW];  /* Confirmed remote input, or the prediction used */
+    uint32_t confirmed;             /* Remote input is known for every frame below */
+    uint16_t prediction;            /* Last confirmed remote input, assumed to be held */
+    uint32_t rollback;              /* Earliest frame simulated with a wrong prediction */
+    uint32_t acked;                 /* The peer holds our input for every frame below */
+    struct chip8_state *snapshots;  /* State before each frame in the window */
+
+    struct chip8_netplay_delayed *queue;
+    uint16_t queue_head;
+    uint16_t queue_count;
+    uint32_t random;                /* Drives the simulated loss */
+    struct chip8_netplay_stats stats;
+};
+
+static uint64_t
+chip8_netplay_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000u + ts.tv_nsec / 1000000u;
+}
+
+static void
+chip8_netplay_put32(uint8_t *bytes, uint32_t value)
+{
+    bytes[0] = value >> 24u;
+    bytes[1] = value >> 16u;
+    bytes[2] = value >> 8u;
+    bytes[3] = value;
+}
+
+static uint32_t
+chip8_netplay_get32(const uint8_t *bytes)
+{
+    return (uint32_t)bytes[0] << 24u | (uint32_t)bytes[1] << 16u | (uint32_t)bytes[2] << 8u | bytes[3];
+}
+
+static int
+chip8_netplay_socket(const struct chip8_netplay_config *config, struct sockaddr_storage *remote,
+                     socklen_t *remote_size)
+{
+    struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_DGRAM};
+    struct addrinfo *result;
+    char port[8];
+
+    snprintf(port, sizeof(port), "%u", config->remote_port);
+    if (getaddrinfo(config->remote_host, port, &hints, &result) != 0) {
+        return -1;
+    }
+    memcpy(remote, result->ai_addr, result->ai_addrlen);
+    *remote_size = result->ai_addrlen;
+    freeaddrinfo(result);
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    struct sockaddr_in local = {.sin_family = AF_INET, .sin_port = htons(config->local_port)};
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(fd, (struct sockaddr *)&local, sizeof(local)) != 0 ||
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+struct chip8_netplay *
+chip8_netplay_init(struct chip8 *chip8, const uint8_t *program, uint32_t size,
+                   const struct chip8_netplay_config *config)
+{
+    if (config->player >= NETPLAY_PLAYERS || config->loss < 0 || config->loss > 1) {
+        return NULL;
+    }
+
+    struct chip8_netplay *netplay = calloc(1, sizeof(*netplay));
+    if (netplay == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+    netplay->fd = chip8_netplay_socket(config, &netplay->remote, &netplay->remote_size);
+    if (netplay->fd < 0) {
+        free(netplay);
+        return NULL;
+    }
+    netplay->snapshots = malloc(NETPLAY_WINDOW * sizeof(*netplay->snapshots));
+    netplay->queue = malloc(NETPLAY_QUEUE * sizeof(*netplay->queue));
+    if (netplay->snapshots == NULL || netplay->queue == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+    netplay->chip8 = chip8;
+    netplay->config = *config;
+    netplay->config.remote_host = NULL;
+    netplay->rollback = NETPLAY_NONE;
+    netplay->random = (config->session ^ 0x9e3779b9u * (config->player + 1)) | 1u;
+
+    chip8_reset(chip8, config->session);
+    chip8_load_program(chip8, program, size);
+    return netplay;
+}
+
+void
+chip8_netplay_free(struct chip8_netplay *netplay)
+{
+    close(netplay->fd);
+    free(netplay->snapshots);
+    free(netplay->queue);
+    free(netplay);
+}
+
+uint32_t
+chip8_netplay_frame(const struct chip8_netplay *netplay)
+{
+    return netplay->frame;
+}
+
+bool
+chip8_netplay_settled(const struct chip8_netplay *netplay)
+{
+    return netplay->confirmed >= netplay->frame && netplay->acked >= netplay->frame;
+}
+
+void
+chip8_netplay_get_stats(const struct chip8_netplay *netplay, struct chip8_netplay_stats *stats)
+{
+    *stats = netplay->stats;
+}
+
+/***
+ * Run one frame from the current state, remembering the state it started from.
+ */
+static void
+chip8_netplay_simulate(struct chip8_netplay *netplay, uint32_t frame)
+{
+    const struct chip8_netplay_config *config = &netplay->config;
+    uint8_t slot = frame % NETPLAY_WINDOW;
+
+    chip8_state_save(netplay->chip8, &netplay->snapshots[slot]);
+    *netplay->chip8->keyboard->keyboard = (netplay->local[slot] & config->masks[config->player]) |
+                                          (netplay->remote_input[slot] & config->masks[!config->player]);
+    chip8_step(netplay->chip8);
+}
+
+static void
+chip8_netplay_resimulate(struct chip8_netplay *netplay)
+{
+    if (netplay->rollback >= netplay->frame) {
+        netplay->rollback = NETPLAY_NONE;
+        return;
+    }
+    chip8_state_load(netplay->chip8, &netplay->snapshots[netplay->rollback % NETPLAY_WINDOW]);
+    for (uint32_t frame = netplay->rollback; frame < netplay->frame; frame++) {
+        chip8_netplay_simulate(netplay, frame);
+        netplay->stats.resimulated++;
+    }
+    netplay->stats.rollbacks++;
+    netplay->rollback = NETPLAY_NONE;
+}
+
+/***
+ * Record the remote input in a packet, scheduling a rollback to the first simulated frame
+ * that used a different prediction.
+ */
+static void
+chip8_netplay_receive_input(struct chip8_netplay *netplay, uint32_t start, const uint8_t *inputs, uint8_t count)
+{
+    if (start > netplay->confirmed || start + count <= netplay->confirmed) {
+        return;
+    }
+    for (uint32_t frame = netplay->confirmed; frame < start + count; frame++) {
+        const uint8_t *input = &inputs[2 * (frame - start)];
+        netplay->prediction = input[0] << 8u | input[1];
+        if (frame < netplay->frame && netplay->remote_input[frame % NETPLAY_WINDOW] != netplay->prediction &&
+            frame < netplay->rollback) {
+            netplay->rollback = frame;
+        }
+        netplay->remote_input[frame % NETPLAY_WINDOW] = netplay->prediction;
+    }
+    netplay->confirmed = start + count;
+
+    /* Frames past the new input were predicted from older input */
+    for (uint32_t frame = netplay->confirmed; frame < netplay->frame; frame++) {
+        if (netplay->remote_input[frame % NETPLAY_WINDOW] != netplay->prediction) {
+            if (frame < netplay->rollback) {
+                netplay->rollback = frame;
+            }
+            netplay->remote_input[frame % NETPLAY_WINDOW] = netplay->prediction;
+        }
+    }
+}
+
+static void
+chip8_netplay_receive(struct chip8_netplay *netplay)
+{
+    uint8_t packet[NETPLAY_PACKET];
+
+    while (true) {
+        ssize_t size = recv(netplay->fd, packet, sizeof(packet), 0);
+        if (size < 0) {
+            break;
+        }
+        if (size < NETPLAY_HEADER || chip8_netplay_get32(packet) != NETPLAY_MAGIC ||
+            chip8_netplay_get32(packet + 4) != netplay->config.session ||
+            size != NETPLAY_HEADER + 2 * packet[16] || packet[16] > NETPLAY_WINDOW) {
+            continue;
+        }
+        netplay->stats.received++;
+
+        uint32_t acked = chip8_netplay_get32(packet + 12);
+        if (acked > netplay->acked && acked <= netplay->frame) {
+            netplay->acked = acked;
+        }
+        chip8_netplay_receive_input(netplay, chip8_netplay_get32(packet + 8), packet + NETPLAY_HEADER, packet[16]);
+    }
+}
+
+static void
+chip8_netplay_flush(struct chip8_netplay *netplay)
+{
+    uint64_t now = chip8_netplay_now();
+
+    while (netplay->queue_count && netplay->queue[netplay->queue_head].due <= now) {
+        struct chip8_netplay_delayed *delayed = &netplay->queue[netplay->queue_head];
+        sendto(netplay->fd, delayed->bytes, delayed->size, 0, (struct sockaddr *)&netplay->remote,
+               netplay->remote_size);
+        netplay->queue_head = (netplay->queue_head + 1) % NETPLAY_QUEUE;
+        netplay->queue_count--;
+    }
+}
+
+/***
+ * Every packet repeats all local input the peer has not acknowledged, so a lost packet is
+ * covered by the next one.
+ */
+static void
+chip8_netplay_send(struct chip8_netplay *netplay)
+{
+    struct chip8_netplay_delayed packet;
+    uint8_t count = netplay->frame - netplay->acked;
+
+    chip8_netplay_put32(packet.bytes, NETPLAY_MAGIC);
+    chip8_netplay_put32(packet.bytes + 4, netplay->config.session);
+    chip8_netplay_put32(packet.bytes + 8, netplay->acked);
+    chip8_netplay_put32(packet.bytes + 12, netplay->confirmed);
+    packet.bytes[16] = count;
+    for (uint8_t i = 0; i < count; i++) {
+        uint16_t input = netplay->local[(netplay->acked + i) % NETPLAY_WINDOW];
+        packet.bytes[NETPLAY_HEADER + 2 * i] = input >> 8u;
+        packet.bytes[NETPLAY_HEADER + 2 * i + 1] = input;
+    }
+    packet.size = NETPLAY_HEADER + 2 * count;
+    netplay->stats.sent++;
+
+    if (netplay->config.loss > 0) {
+        netplay->random ^= netplay->random << 13u;
+        netplay->random ^= netplay->random >> 17u;
+        netplay->random ^= netplay->random << 5u;
+        if (netplay->random < netplay->config.loss * 4294967295.0) {
+            netplay->stats.dropped++;
+            return;
+        }
+    }
+    if (netplay->config.latency == 0) {
+        sendto(netplay->fd, packet.bytes, packet.size, 0, (struct sockaddr *)&netplay->remote, netplay->remote_size);
+        return;
+    }
+    if (netplay->queue_count == NETPLAY_QUEUE) {
+        netplay->stats.dropped++;
+        return;
+    }
+    packet.due = chip8_netplay_now() + netplay->config.latency;
+    netplay->queue[(netplay->queue_head + netplay->queue_count++) % NETPLAY_QUEUE] = packet;
+}
+
+void
+chip8_netplay_poll(struct chip8_netplay *netplay)
+{
+    chip8_netplay_receive(netplay);
+    chip8_netplay_resimulate(netplay);
+    chip8_netplay_send(netplay);
+    chip8_netplay_flush(netplay);
+}
+
+bool
+chip8_netplay_advance(struct chip8_netplay *netplay, uint16_t keys)
+{
+    chip8_netplay_receive(netplay);
+    chip8_netplay_resimulate(netplay);
+
+    /* Rolling back further than the window, or past input the peer may still ask for, is impossible */
+    if ((netplay->frame > netplay->confirmed && netplay->frame - netplay->confirmed >= NETPLAY_MAX_PREDICTION) ||
+        netplay->frame - netplay->acked >= NETPLAY_WINDOW) {
+        netplay->stats.stalls++;
+        chip8_netplay_send(netplay);
+        chip8_netplay_flush(netplay);
+        return false;
+    }
+
+    uint8_t slot = netplay->frame % NETPLAY_WINDOW;
+    netplay->local[slot] = keys & netplay->config.masks[netplay->config.player];
+    if (netplay->frame >= netplay->confirmed) {
+        netplay->remote_input[slot] = netplay->prediction;
+    }
+    chip8_netplay_simulate(netplay, netplay->frame++);
+    netplay->stats.frames++;
+
+    chip8_netplay_send(netplay);
+    chip8_netplay_flush(netplay);
+    return true;
+}
@@ -0,0 +1,274 @@
+#include "inc/chip8_raster.h"
+
+#include <string.h>
+
+#include "inc/chip8_display.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define RASTER_X86
+#include <immintrin.h>
+#endif
+
+#define RASTER_MAX_WORDS 2
+#define WORD_BITS 64
+#define BITS_PER_BYTE 8
+
+struct chip8_raster_kernel_ops {
+    /* Turn count bit words into count * WORD_BITS pixels */
+    void (*expand)(const uint64_t *words, uint8_t count, uint32_t on, uint32_t off, uint32_t *line);
+    /* Repeat every pixel of line factor times */
+    void (*stretch)(const uint32_t *line, uint16_t width, uint8_t factor, uint32_t *scanline);
+};
+
+static void
+chip8_raster_expand_scalar(const uint64_t *words, uint8_t count, uint32_t on, uint32_t off, uint32_t *line)
+{
+    for (uint8_t w = 0; w < count; w++) {
+        for (uint8_t bit = 0; bit < WORD_BITS; bit++) {
+            uint32_t mask = -(uint32_t)((words[w] >> (WORD_BITS - 1 - bit)) & 1u);
+            *line++ = off ^ ((on ^ off) & mask);
+        }
+    }
+}
+
+static void
+chip8_raster_stretch_scalar(const uint32_t *line, uint16_t width, uint8_t factor, uint32_t *scanline)
+{
+    if (factor == 1) {
+        memcpy(scanline, line, width * sizeof(*line));
+        return;
+    }
+    for (uint16_t i = 0; i < width; i++) {
+        for (uint8_t k = 0; k < factor; k++) {
+            *scanline++ = line[i];
+        }
+    }
+}
+
+#ifdef RASTER_X86
+__attribute__((target("sse2"))) static void
+chip8_raster_expand_sse2(const uint64_t *words, uint8_t count, uint32_t on, uint32_t off, uint32_t *line)
+{
+    const __m128i high = _mm_setr_epi32(0x80, 0x40, 0x20, 0x10);
+    const __m128i low = _mm_setr_epi32(0x08, 0x04, 0x02, 0x01);
+    const __m128i off_v = _mm_set1_epi32((int)off);
+    const __m128i diff = _mm_set1_epi32((int)(on ^ off));
+
+    for (uint8_t w = 0; w < count; w++) {
+        for (int8_t shift = WORD_BITS - BITS_PER_BYTE; shift >= 0; shift -= BITS_PER_BYTE) {
+            __m128i bits = _mm_set1_epi32((int)((words[w] >> shift) & 0xffu));
+            __m128i mask_high = _mm_cmpeq_epi32(_mm_and_si128(bits, high), high);
+            __m128i mask_low = _mm_cmpeq_epi32(_mm_and_si128(bits, low), low);
+            _mm_storeu_si128((__m128i *)line, _mm_xor_si128(off_v, _mm_and_si128(diff, mask_high)));
+            _mm_storeu_si128((__m128i *)(line + 4), _mm_xor_si128(off_v, _mm_and_si128(diff, mask_low)));
+            line += BITS_PER_BYTE;
+        }
+    }
+}
+
+__attribute__((target("sse2"))) static void
+chip8_raster_stretch_sse2(const uint32_t *line, uint16_t width, uint8_t factor, uint32_t *scanline)
+{
+    if (factor == 2) {
+        for (uint16_t i = 0; i < width; i += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i *)&line[i]);
+            _mm_storeu_si128((__m128i *)scanline, _mm_unpacklo_epi32(v, v));
+            _mm_storeu_si128((__m128i *)(scanline + 4), _mm_unpackhi_epi32(v, v));
+            scanline += 8;
+        }
+        return;
+    }
+    if (factor < 4) {
+        chip8_raster_stretch_scalar(line, width, factor, scanline);
+        return;
+    }
+
+    /* Stores may run past a pixel's span, the next pixel overwrites the excess. */
+    for (uint16_t i = 0; i < width - 1; i++) {
+        __m128i v = _mm_set1_epi32((int)line[i]);
+        for (uint8_t k = 0; k < factor; k += 4) {
+            _mm_storeu_si128((__m128i *)(scanline + k), v);
+        }
+        scanline += factor;
+    }
+    chip8_raster_stretch_scalar(&line[width - 1], 1, factor, scanline);
+}
+
+__attribute__((target("avx2"))) static void
+chip8_raster_expand_avx2(const uint64_t *words, uint8_t count, uint32_t on, uint32_t off, uint32_t *line)
+{
+    const __m256i select = _mm256_setr_epi32(0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+    const __m256i off_v = _mm256_set1_epi32((int)off);
+    const __m256i diff = _mm256_set1_epi32((int)(on ^ off));
+
+    for (uint8_t w = 0; w < count; w++) {
+        for (int8_t shift = WORD_BITS - BITS_PER_BYTE; shift >= 0; shift -= BITS_PER_BYTE) {
+            __m256i bits = _mm256_set1_epi32((int)((words[w] >> shift) & 0xffu));
+            __m256i mask = _mm256_cmpeq_epi32(_mm256_and_si256(bits, select), select);
+            _mm256_storeu_si256((__m256i *)line, _mm256_xor_si256(off_v, _mm256_and_si256(diff, mask)));
+            line += BITS_PER_BYTE;
+        }
+    }
+}
+
+__attribute__((target("avx2"))) static void
+chip8_raster_stretch_avx2(const uint32_t *line, uint16_t width, uint8_t factor, uint32_t *scanline)
+{
+    if (factor < 8) {
+        chip8_raster_stretch_sse2(line, width, factor, scanline);
+        return;
+    }
+
+    for (uint16_t i = 0; i < width - 1; i++) {
+        __m256i v = _mm256_set1_epi32((int)line[i]);
+        for (uint8_t k = 0; k < factor; k += 8) {
+            _mm256_storeu_si256((__m256i *)(scanline + k), v);
+        }
+        scanline += factor;
+    }
+    chip8_raster_stretch_scalar(&line[width - 1], 1, factor, scanline);
+}
+#endif
+
+static const struct chip8_raster_kernel_ops kernels[] = {
+    [RASTER_KERNEL_SCALAR] = {chip8_raster_expand_scalar, chip8_raster_stretch_scalar},
+#ifdef RASTER_X86
+    [RASTER_KERNEL_SSE2] = {chip8_raster_expand_sse2, chip8_raster_stretch_sse2},
+    [RASTER_KERNEL_AVX2] = {chip8_raster_expand_avx2, chip8_raster_stretch_avx2},
+#else
+    [RASTER_KERNEL_SSE2] = {chip8_raster_expand_scalar, chip8_raster_stretch_scalar},
+    [RASTER_KERNEL_AVX2] = {chip8_raster_expand_scalar, chip8_raster_stretch_scalar},
+#endif
+};
+
+static enum chip8_raster_kernel
+chip8_raster_detect_kernel(void)
+{
+#ifdef RASTER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return RASTER_KERNEL_AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return RASTER_KERNEL_SSE2;
+    }
+#endif
+    return RASTER_KERNEL_SCALAR;
+}
+
+/***
+ * Spread the 32 bits of x to the even bits of the result.
+ */
+static uint64_t
+chip8_raster_spread(uint64_t x)
+{
+    x &= 0xffffffffu;
+    x = (x | x << 16u) & 0x0000ffff0000ffffu;
+    x = (x | x << 8u) & 0x00ff00ff00ff00ffu;
+    x = (x | x << 4u) & 0x0f0f0f0f0f0f0f0fu;
+    x = (x | x << 2u) & 0x3333333333333333u;
+    x = (x | x << 1u) & 0x5555555555555555u;
+    return x;
+}
+
+/***
+ * Interleave two rows into one of twice the width, even pixels from a, odd ones from b.
+ */
+static void
+chip8_raster_interleave(uint64_t a, uint64_t b, uint64_t *words)
+{
+    words[0] = chip8_raster_spread(a >> 32u) << 1u | chip8_raster_spread(b >> 32u);
+    words[1] = chip8_raster_spread(a) << 1u | chip8_raster_spread(b);
+}
+
+/***
+ * Scale2x (identical to EPX) on a whole row at once. Every pixel E with neighbours
+ *   B
+ * D E F
+ *   H
+ * becomes E0 E1 / E2 E3, taking the colour of an edge when the edges around it agree.
+ * Pixels outside the display repeat the border.
+ */
+static void
+chip8_raster_scale2x(const uint64_t *display, uint8_t row, uint64_t *top, uint64_t *bottom)
+{
+    uint64_t E = display[row];
+    uint64_t B = display[row ? row - 1 : row];
+    uint64_t H = display[row < DISPLAY_HEIGHT - 1 ? row + 1 : row];
+    uint64_t D = E >> 1u | (E & 1ull << 63u);
+    uint64_t F = E << 1u | (E & 1u);
+
+    uint64_t corner = (B ^ H) & (D ^ F);
+    uint64_t s0 = corner & ~(D ^ B);
+    uint64_t s1 = corner & ~(B ^ F);
+    uint64_t s2 = corner & ~(D ^ H);
+    uint64_t s3 = corner & ~(H ^ F);
+
+    chip8_raster_interleave((s0 & D) | (~s0 & E), (s1 & F) | (~s1 & E), top);
+    chip8_raster_interleave((s2 & D) | (~s2 & E), (s3 & F) | (~s3 & E), bottom);
+}
+
+static uint8_t *
+chip8_raster_emit(const struct chip8_raster *raster, const uint64_t *words, uint8_t count, uint8_t factor,
+                  uint8_t *dst, uint32_t pitch)
+{
+    const struct chip8_raster_kernel_ops *ops = &kernels[raster->kernel];
+    uint32_t line[RASTER_MAX_WORDS * WORD_BITS];
+    uint16_t width = count * WORD_BITS;
+
+    ops->expand(words, count, raster->on, raster->off, line);
+    ops->stretch(line, width, factor, (uint32_t *)dst);
+    for (uint8_t i = 1; i < factor; i++) {
+        memcpy(dst + i * pitch, dst, width * factor * sizeof(uint32_t));
+    }
+    return dst + factor * pitch;
+}
+
+bool
+chip8_raster_init(struct chip8_raster *raster, uint8_t scale, enum chip8_raster_filter filter,
+                  uint32_t on, uint32_t off)
+{
+    if (scale < 1 || scale > RASTER_MAX_SCALE) {
+        return false;
+    }
+    if (filter == RASTER_FILTER_SCALE2X && scale % 2) {
+        return false;
+    }
+
+    raster->on = on;
+    raster->off = off;
+    raster->scale = scale;
+    raster->filter = filter;
+    raster->kernel = chip8_raster_detect_kernel();
+    return true;
+}
+
+uint16_t
+chip8_raster_width(const struct chip8_raster *raster)
+{
+    return DISPLAY_WIDTH * raster->scale;
+}
+
+uint16_t
+chip8_raster_height(const struct chip8_raster *raster)
+{
+    return DISPLAY_HEIGHT * raster->scale;
+}
+
+void
+chip8_raster_draw(const struct chip8_raster *raster, const uint64_t *display, uint32_t *pixels, uint32_t pitch)
+{
+    uint8_t *dst = (uint8_t *)pixels;
+
+    for (uint8_t row = 0; row < DISPLAY_HEIGHT; row++) {
+        if (raster->filter == RASTER_FILTER_SCALE2X) {
+            uint64_t top[RASTER_MAX_WORDS];
+            uint64_t bottom[RASTER_MAX_WORDS];
+            chip8_raster_scale2x(display, row, top, bottom);
+            dst = chip8_raster_emit(raster, top, RASTER_MAX_WORDS, raster->scale / 2, dst, pitch);
+            dst = chip8_raster_emit(raster, bottom, RASTER_MAX_WORDS, raster->scale / 2, dst, pitch);
+        } else {
+            dst = chip8_raster_emit(raster, &display[row], 1, raster->scale, dst, pitch);
+        }
+    }
+}
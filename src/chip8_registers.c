@@ -99,3 +99,14 @@ chip8_registers_decrement_ST(struct chip8_registers *registers)
         registers->ST--;
     }
 }
+
+bool
+chip8_registers_equal(const struct chip8_registers *a, const struct chip8_registers *b)
+{
+    for (uint8_t i = 0; i < V_REGISTERS; i++) {
+        if (a->V[i] != b->V[i]) {
+            return false;
+        }
+    }
+    return a->I == b->I && a->PC == b->PC && a->DT == b->DT && a->ST == b->ST && a->SP == b->SP;
+}
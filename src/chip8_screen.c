@@ -0,0 +1,112 @@
+#include "inc/chip8_screen.h"
+
+#include <SDL2/SDL.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "inc/chip8.h"
+#include "inc/chip8_display.h"
+
+#define GLYPH_WIDTH 3
+#define GLYPH_HEIGHT 5
+#define OVERLAY_SCALE 2
+#define OVERLAY_COLOR 0xffffc040u
+#define OVERLAY_BACKGROUND 0xff000000u
+
+/* 3x5 glyphs from ' ' to 'Z', one row per byte with the leftmost pixel in bit 2 */
+static const uint8_t font['Z' - ' ' + 1][GLYPH_HEIGHT] = {
+        [' ' - ' '] = {0, 0, 0, 0, 0}, ['%' - ' '] = {5, 1, 2, 4, 5}, ['-' - ' '] = {0, 0, 7, 0, 0},
+        ['.' - ' '] = {0, 0, 0, 0, 2}, [':' - ' '] = {0, 2, 0, 2, 0},
+        ['0' - ' '] = {7, 5, 5, 5, 7}, ['1' - ' '] = {2, 6, 2, 2, 7}, ['2' - ' '] = {7, 1, 7, 4, 7},
+        ['3' - ' '] = {7, 1, 7, 1, 7}, ['4' - ' '] = {5, 5, 7, 1, 1}, ['5' - ' '] = {7, 4, 7, 1, 7},
+        ['6' - ' '] = {7, 4, 7, 5, 7}, ['7' - ' '] = {7, 1, 1, 1, 1}, ['8' - ' '] = {7, 5, 7, 5, 7},
+        ['9' - ' '] = {7, 5, 7, 1, 7},
+        ['A' - ' '] = {2, 5, 7, 5, 5}, ['B' - ' '] = {6, 5, 6, 5, 6}, ['C' - ' '] = {3, 4, 4, 4, 3},
+        ['D' - ' '] = {6, 5, 5, 5, 6}, ['E' - ' '] = {7, 4, 6, 4, 7}, ['F' - ' '] = {7, 4, 6, 4, 4},
+        ['G' - ' '] = {3, 4, 5, 5, 3}, ['H' - ' '] = {5, 5, 7, 5, 5}, ['I' - ' '] = {7, 2, 2, 2, 7},
+        ['J' - ' '] = {1, 1, 1, 5, 2}, ['K' - ' '] = {5, 5, 6, 5, 5}, ['L' - ' '] = {4, 4, 4, 4, 7},
+        ['M' - ' '] = {5, 7, 7, 5, 5}, ['N' - ' '] = {6, 5, 5, 5, 5}, ['O' - ' '] = {2, 5, 5, 5, 2},
+        ['P' - ' '] = {6, 5, 6, 4, 4}, ['Q' - ' '] = {2, 5, 5, 6, 3}, ['R' - ' '] = {6, 5, 6, 5, 5},
+        ['S' - ' '] = {3, 4, 2, 1, 6}, ['T' - ' '] = {7, 2, 2, 2, 2}, ['U' - ' '] = {5, 5, 5, 5, 7},
+        ['V' - ' '] = {5, 5, 5, 5, 2}, ['W' - ' '] = {5, 5, 7, 7, 5}, ['X' - ' '] = {5, 5, 2, 5, 5},
+        ['Y' - ' '] = {5, 5, 2, 2, 2}, ['Z' - ' '] = {7, 1, 2, 4, 7}
+};
+
+static void chip8_screen_text(struct chip8_screen *screen, const char *text);
+
+struct chip8_screen *
+chip8_screen_init(struct SDL_Renderer *renderer)
+{
+    struct chip8_screen *screen = calloc(1, sizeof(*screen));
+    if (screen == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+    screen->renderer = renderer;
+
+    chip8_raster_init(&screen->raster, SCREEN_WIDTH / DISPLAY_WIDTH, RASTER_FILTER_NONE, 0xffffffffu, 0xff202020u);
+    uint16_t width = chip8_raster_width(&screen->raster);
+    uint16_t height = chip8_raster_height(&screen->raster);
+
+    screen->pixels = malloc(width * height * sizeof(*screen->pixels));
+    if (screen->pixels == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+    screen->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+                                        width, height);
+    if (screen->texture == NULL) {
+        puts(SDL_GetError());
+        exit(EXIT_FAILURE);
+    }
+    return screen;
+}
+
+void
+chip8_screen_draw(struct chip8_screen *screen, const struct chip8_display *display)
+{
+    uint32_t pitch = chip8_raster_width(&screen->raster) * sizeof(*screen->pixels);
+
+    chip8_raster_draw(&screen->raster, display->display, screen->pixels, pitch);
+    if (screen->overlay) {
+        chip8_screen_text(screen, screen->overlay);
+    }
+    SDL_UpdateTexture(screen->texture, NULL, screen->pixels, pitch);
+    SDL_RenderCopy(screen->renderer, screen->texture, NULL, NULL);
+    SDL_RenderPresent(screen->renderer);
+}
+
+/***
+ * Write text into the top left corner of the raster output on a dark backdrop, characters
+ * without a glyph are left blank
+ */
+static void
+chip8_screen_text(struct chip8_screen *screen, const char *text)
+{
+    /* Every cell has a blank column and row of backdrop before the glyph */
+    const uint32_t cell_width = (GLYPH_WIDTH + 1) * OVERLAY_SCALE;
+    const uint32_t cell_height = (GLYPH_HEIGHT + 1) * OVERLAY_SCALE;
+    uint32_t width = chip8_raster_width(&screen->raster);
+    uint32_t height = chip8_raster_height(&screen->raster);
+    uint32_t column = 0, line = 0;
+
+    for (const char *c = text; *c; c++) {
+        if (*c == '\n') {
+            column = 0;
+            line++;
+            continue;
+        }
+        int ch = toupper((unsigned char)*c);
+        const uint8_t *glyph = font[ch >= ' ' && ch <= 'Z' ? ch - ' ' : 0];
+        uint32_t left = column++ * cell_width, top = line * cell_height;
+
+        for (uint32_t y = 0; y < cell_height && top + y < height; y++) {
+            for (uint32_t x = 0; x < cell_width && left + x < width; x++) {
+                uint32_t gx = x / OVERLAY_SCALE, gy = y / OVERLAY_SCALE;
+                bool lit = gx && gy && (glyph[gy - 1] >> (GLYPH_WIDTH - gx)) & 1u;
+                screen->pixels[(top + y) * width + left + x] = lit ? OVERLAY_COLOR : OVERLAY_BACKGROUND;
+            }
+        }
+    }
+}
@@ -0,0 +1,442 @@
+#include "inc/chip8_server.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "inc/chip8.h"
+#include "inc/chip8_memory.h"
+#include "inc/chip8_registers.h"
+
+#define PROGRAM_MAX_SIZE (MEMORY_SIZE - PROGRAM_START_ADDR)
+#define SERVER_PERIOD (1000000000u / FRAMES_PER_SECOND)
+#define SERVER_EVENTS 64
+#define SERVER_BACKLOG 128
+
+struct chip8_server_session {
+    int fd;
+    struct chip8 *chip8;
+    uint16_t keyboard;              /* Read by the machine, only touched by the worker running it */
+    uint16_t keys;                  /* Latest mask received, written by the polling thread */
+    uint8_t partial;                /* First byte of a mask split across reads */
+    bool has_partial;
+    bool closed;                    /* Set by the polling thread, the worker frees the session */
+
+    uint64_t release;               /* Nanoseconds, CLOCK_MONOTONIC, when the next frame may run */
+    uint64_t deadline;              /* When it must be done, one period later */
+    uint32_t frame;
+    uint32_t unsent;                /* Frames since the last message sent */
+    struct chip8_server_frame out;
+    uint32_t out_sent;              /* Bytes of out already written, sizeof(out) when idle */
+};
+
+struct chip8_server {
+    struct chip8_server_config config;
+    uint8_t program[PROGRAM_MAX_SIZE];
+    uint32_t size;
+    int listener;
+    int epoll;
+
+    /* Sessions waiting for their next frame, a binary min-heap on deadline */
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    struct chip8_server_session **queue;
+    uint32_t queued;
+    bool quit;
+
+    pthread_t *workers;
+    uint16_t threads;
+    struct chip8_server_stats stats;    /* Counters updated atomically */
+};
+
+static uint64_t
+chip8_server_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void
+chip8_server_count(uint64_t *counter, uint64_t amount)
+{
+    __atomic_fetch_add(counter, amount, __ATOMIC_RELAXED);
+}
+
+/***
+ * Caller holds the lock
+ */
+static void
+chip8_server_push(struct chip8_server *server, struct chip8_server_session *session)
+{
+    struct chip8_server_session **queue = server->queue;
+    uint32_t i = server->queued++;
+
+    while (i > 0 && queue[(i - 1) / 2]->deadline > session->deadline) {
+        queue[i] = queue[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    queue[i] = session;
+}
+
+/***
+ * Caller holds the lock
+ */
+static struct chip8_server_session *
+chip8_server_pop(struct chip8_server *server)
+{
+    struct chip8_server_session **queue = server->queue;
+    struct chip8_server_session *first = queue[0];
+    struct chip8_server_session *last = queue[--server->queued];
+    uint32_t i = 0;
+
+    while (2 * i + 1 < server->queued) {
+        uint32_t child = 2 * i + 1;
+        if (child + 1 < server->queued && queue[child + 1]->deadline < queue[child]->deadline) {
+            child++;
+        }
+        if (queue[child]->deadline >= last->deadline) {
+            break;
+        }
+        queue[i] = queue[child];
+        i = child;
+    }
+    queue[i] = last;
+    return first;
+}
+
+static void
+chip8_server_close(struct chip8_server *server, struct chip8_server_session *session)
+{
+    close(session->fd);
+    chip8_free(session->chip8);
+    free(session);
+    __atomic_fetch_sub(&server->stats.sessions, 1, __ATOMIC_RELAXED);
+}
+
+/***
+ * Write what the socket takes without blocking.
+ * Return false once the client is gone
+ */
+static bool
+chip8_server_flush(struct chip8_server_session *session)
+{
+    while (session->out_sent < sizeof(session->out)) {
+        ssize_t written = send(session->fd, (const uint8_t *)&session->out + session->out_sent,
+                               sizeof(session->out) - session->out_sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (written < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        session->out_sent += written;
+    }
+    return true;
+}
+
+/***
+ * Emulate one frame of the session and send it. A client that has not read the previous
+ * frame yet misses this one rather than holding up the worker.
+ */
+static void
+chip8_server_frame(struct chip8_server *server, struct chip8_server_session *session)
+{
+    struct chip8 *chip8 = session->chip8;
+
+    session->keyboard = __atomic_load_n(&session->keys, __ATOMIC_RELAXED);
+    bool sound = chip8_step(chip8);
+    uint64_t finished = chip8_server_now();
+    int64_t lateness = (int64_t)(finished - session->deadline);
+
+    chip8_server_count(&server->stats.frames, 1);
+    chip8_server_count(&server->stats.missed, lateness > 0);
+    session->frame++;
+    session->unsent++;
+
+    if (chip8_server_flush(session) && session->out_sent == sizeof(session->out)) {
+        struct chip8_server_frame *out = &session->out;
+        out->frame = session->frame;
+        out->lateness = (int32_t)(lateness / 1000);
+        out->skipped = session->unsent - 1;
+        out->keys = session->keyboard;
+        out->sound = sound;
+        out->fault = chip8->fault;
+        memcpy(out->display, chip8->display->display, sizeof(out->display));
+        session->out_sent = 0;
+        session->unsent = 0;
+        chip8_server_flush(session);
+    } else {
+        chip8_server_count(&server->stats.dropped, 1);
+    }
+
+    session->release += SERVER_PERIOD;
+    session->deadline += SERVER_PERIOD;
+    if (finished > session->release + (uint64_t)SERVER_MAX_LAG * SERVER_PERIOD) {
+        /* Catching up would only make every later frame late as well */
+        uint64_t behind = (finished - session->release) / SERVER_PERIOD;
+        chip8_server_count(&server->stats.skipped, behind);
+        session->frame += behind;
+        session->unsent += behind;
+        session->release += behind * SERVER_PERIOD;
+        session->deadline += behind * SERVER_PERIOD;
+    }
+}
+
+/***
+ * Earliest deadline first: run the released session whose frame is due soonest, or sleep
+ * until the first one is released.
+ */
+static void *
+chip8_server_worker_main(void *arg)
+{
+    struct chip8_server *server = arg;
+
+    pthread_mutex_lock(&server->lock);
+    while (!server->quit) {
+        if (server->queued == 0) {
+            pthread_cond_wait(&server->ready, &server->lock);
+            continue;
+        }
+        struct chip8_server_session *session = server->queue[0];
+        uint64_t now = chip8_server_now();
+        if (session->release > now && !__atomic_load_n(&session->closed, __ATOMIC_ACQUIRE)) {
+            struct timespec until = {(time_t)(session->release / 1000000000u),
+                                     (long)(session->release % 1000000000u)};
+            pthread_cond_timedwait(&server->ready, &server->lock, &until);
+            continue;
+        }
+        chip8_server_pop(server);
+        pthread_mutex_unlock(&server->lock);
+
+        bool closed = __atomic_load_n(&session->closed, __ATOMIC_ACQUIRE);
+        if (closed) {
+            chip8_server_close(server, session);
+        } else {
+            chip8_server_frame(server, session);
+        }
+
+        pthread_mutex_lock(&server->lock);
+        if (!closed) {
+            chip8_server_push(server, session);
+        }
+    }
+    pthread_mutex_unlock(&server->lock);
+    return NULL;
+}
+
+static int
+chip8_server_listen(const char *path)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+    unlink(path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, SERVER_BACKLOG) != 0 ||
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static uint16_t
+chip8_server_thread_count(const struct chip8_server_config *config)
+{
+    long threads = config->workers ? config->workers : sysconf(_SC_NPROCESSORS_ONLN);
+    return threads < 1 ? 1 : (uint16_t)threads;
+}
+
+struct chip8_server *
+chip8_server_init(const uint8_t *program, uint32_t size, const struct chip8_server_config *config)
+{
+    if (size > PROGRAM_MAX_SIZE || config->max_sessions == 0 || config->path == NULL) {
+        return NULL;
+    }
+
+    struct chip8_server *server = calloc(1, sizeof(*server));
+    if (server == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+    server->config = *config;
+    memcpy(server->program, program, size);
+    server->size = size;
+
+    server->listener = chip8_server_listen(config->path);
+    server->epoll = epoll_create1(0);
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = NULL};
+    if (server->listener < 0 || server->epoll < 0 ||
+        epoll_ctl(server->epoll, EPOLL_CTL_ADD, server->listener, &event) != 0) {
+        if (server->listener >= 0) {
+            close(server->listener);
+        }
+        if (server->epoll >= 0) {
+            close(server->epoll);
+        }
+        free(server);
+        return NULL;
+    }
+
+    server->queue = calloc(config->max_sessions, sizeof(*server->queue));
+    server->threads = chip8_server_thread_count(config);
+    server->workers = calloc(server->threads, sizeof(*server->workers));
+    if (server->queue == NULL || server->workers == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Deadlines are CLOCK_MONOTONIC, so is the timed wait for the next release */
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_mutex_init(&server->lock, NULL);
+    pthread_cond_init(&server->ready, &attributes);
+    pthread_condattr_destroy(&attributes);
+    for (uint16_t i = 0; i < server->threads; i++) {
+        if (pthread_create(&server->workers[i], NULL, chip8_server_worker_main, server)) {
+            puts("Error creating thread!");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return server;
+}
+
+void
+chip8_server_free(struct chip8_server *server)
+{
+    pthread_mutex_lock(&server->lock);
+    server->quit = true;
+    pthread_cond_broadcast(&server->ready);
+    pthread_mutex_unlock(&server->lock);
+    for (uint16_t i = 0; i < server->threads; i++) {
+        pthread_join(server->workers[i], NULL);
+    }
+    pthread_cond_destroy(&server->ready);
+    pthread_mutex_destroy(&server->lock);
+
+    for (uint32_t i = 0; i < server->queued; i++) {
+        chip8_server_close(server, server->queue[i]);
+    }
+    close(server->epoll);
+    close(server->listener);
+    unlink(server->config.path);
+    free(server->queue);
+    free(server->workers);
+    free(server);
+}
+
+static void
+chip8_server_accept(struct chip8_server *server)
+{
+    int fd;
+    while ((fd = accept(server->listener, NULL, NULL)) >= 0) {
+        struct chip8_server_hello hello = {SERVER_MAGIC, server->threads, FRAMES_PER_SECOND};
+        if (__atomic_load_n(&server->stats.sessions, __ATOMIC_RELAXED) >= server->config.max_sessions ||
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0 ||
+            send(fd, &hello, sizeof(hello), MSG_NOSIGNAL) != sizeof(hello)) {
+            close(fd);
+            continue;
+        }
+
+        struct chip8_server_session *session = calloc(1, sizeof(*session));
+        if (session == NULL) {
+            puts("Error allocating memory!");
+            exit(EXIT_FAILURE);
+        }
+        session->fd = fd;
+        session->chip8 = chip8_init(&session->keyboard);
+        chip8_reset(session->chip8, server->config.seed);
+        chip8_load_program(session->chip8, server->program, server->size);
+        session->out_sent = sizeof(session->out);
+        session->release = chip8_server_now();
+        session->deadline = session->release + SERVER_PERIOD;
+
+        struct epoll_event event = {.events = EPOLLIN | EPOLLRDHUP, .data.ptr = session};
+        if (epoll_ctl(server->epoll, EPOLL_CTL_ADD, fd, &event) != 0) {
+            chip8_free(session->chip8);
+            free(session);
+            close(fd);
+            continue;
+        }
+        __atomic_fetch_add(&server->stats.sessions, 1, __ATOMIC_RELAXED);
+        chip8_server_count(&server->stats.accepted, 1);
+
+        pthread_mutex_lock(&server->lock);
+        chip8_server_push(server, session);
+        pthread_cond_signal(&server->ready);
+        pthread_mutex_unlock(&server->lock);
+    }
+}
+
+/***
+ * Keep the last complete mask, a client that sends faster than frames run only loses
+ * intermediate states of the keypad.
+ * Return false once the client hung up
+ */
+static bool
+chip8_server_receive(struct chip8_server_session *session)
+{
+    uint8_t buffer[256];
+    ssize_t received;
+
+    while ((received = recv(session->fd, buffer, sizeof(buffer), 0)) > 0) {
+        for (ssize_t i = 0; i < received; i++) {
+            if (session->has_partial) {
+                uint16_t keys;
+                uint8_t bytes[2] = {session->partial, buffer[i]};
+                memcpy(&keys, bytes, sizeof(keys));
+                __atomic_store_n(&session->keys, keys, __ATOMIC_RELAXED);
+            } else {
+                session->partial = buffer[i];
+            }
+            session->has_partial = !session->has_partial;
+        }
+    }
+    return received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+}
+
+void
+chip8_server_poll(struct chip8_server *server, int timeout)
+{
+    struct epoll_event events[SERVER_EVENTS];
+    int count = epoll_wait(server->epoll, events, SERVER_EVENTS, timeout);
+
+    for (int i = 0; i < count; i++) {
+        struct chip8_server_session *session = events[i].data.ptr;
+        if (session == NULL) {
+            chip8_server_accept(server);
+            continue;
+        }
+        if (!chip8_server_receive(session) || (events[i].events & (EPOLLHUP | EPOLLERR))) {
+            /* The worker that next pops the session frees it */
+            epoll_ctl(server->epoll, EPOLL_CTL_DEL, session->fd, NULL);
+            __atomic_store_n(&session->closed, true, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+void
+chip8_server_get_stats(const struct chip8_server *server, struct chip8_server_stats *stats)
+{
+    stats->sessions = __atomic_load_n(&server->stats.sessions, __ATOMIC_RELAXED);
+    stats->accepted = __atomic_load_n(&server->stats.accepted, __ATOMIC_RELAXED);
+    stats->frames = __atomic_load_n(&server->stats.frames, __ATOMIC_RELAXED);
+    stats->missed = __atomic_load_n(&server->stats.missed, __ATOMIC_RELAXED);
+    stats->dropped = __atomic_load_n(&server->stats.dropped, __ATOMIC_RELAXED);
+    stats->skipped = __atomic_load_n(&server->stats.skipped, __ATOMIC_RELAXED);
+}
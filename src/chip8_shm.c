@@ -0,0 +1,165 @@
+#include "inc/chip8_shm.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "inc/chip8.h"
+
+#define SHM_READ_ATTEMPTS 64
+
+/***
+ * shm_open() wants names of the form /name
+ */
+static char *
+chip8_shm_name(const char *name)
+{
+    char *path = malloc(strlen(name) + 2);
+    if (path == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+    sprintf(path, "%s%s", name[0] == '/' ? "" : "/", name);
+    return path;
+}
+
+struct chip8_shm *
+chip8_shm_create(const char *name, const struct chip8_shm_region *regions, uint8_t count)
+{
+    uint32_t total = 0;
+    if (count > SHM_MAX_REGIONS) {
+        return NULL;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        if (regions[i].address + regions[i].length > MEMORY_SIZE) {
+            return NULL;
+        }
+        total += regions[i].length;
+    }
+    if (total > MEMORY_SIZE) {
+        return NULL;
+    }
+
+    struct chip8_shm *shm = calloc(1, sizeof(*shm));
+    if (shm == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+    shm->name = chip8_shm_name(name);
+
+    int fd = shm_open(shm->name, O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        free(shm->name);
+        free(shm);
+        return NULL;
+    }
+    if (ftruncate(fd, sizeof(*shm->frame)) != 0) {
+        close(fd);
+        shm_unlink(shm->name);
+        free(shm->name);
+        free(shm);
+        return NULL;
+    }
+    shm->frame = mmap(NULL, sizeof(*shm->frame), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm->frame == MAP_FAILED) {
+        shm_unlink(shm->name);
+        free(shm->name);
+        free(shm);
+        return NULL;
+    }
+
+    memset(shm->frame, 0, sizeof(*shm->frame));
+    shm->frame->magic = SHM_MAGIC;
+    shm->frame->layout = SHM_LAYOUT;
+    shm->frame->region_count = count;
+    memcpy(shm->frame->regions, regions, count * sizeof(*regions));
+    return shm;
+}
+
+void
+chip8_shm_destroy(struct chip8_shm *shm)
+{
+    munmap(shm->frame, sizeof(*shm->frame));
+    shm_unlink(shm->name);
+    free(shm->name);
+    free(shm);
+}
+
+void
+chip8_shm_publish(struct chip8_shm *shm, const struct chip8 *chip8)
+{
+    struct chip8_shm_frame *frame = shm->frame;
+    const struct chip8_registers *registers = chip8->registers;
+    uint32_t sequence = frame->sequence;
+
+    __atomic_store_n(&frame->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    memcpy(frame->display, chip8->display->display, sizeof(frame->display));
+    memcpy(frame->V, registers->V, sizeof(frame->V));
+    frame->I = registers->I;
+    frame->PC = registers->PC;
+    frame->DT = registers->DT;
+    frame->ST = registers->ST;
+    frame->SP = registers->SP;
+    memcpy(frame->stack, chip8->stack->stack, sizeof(frame->stack));
+
+    uint8_t *dst = frame->memory;
+    for (uint8_t i = 0; i < frame->region_count; i++) {
+        chip8_memory_read(chip8->memory, frame->regions[i].address, dst, frame->regions[i].length);
+        dst += frame->regions[i].length;
+    }
+    frame->frame++;
+
+    __atomic_store_n(&frame->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+const struct chip8_shm_frame *
+chip8_shm_attach(const char *name)
+{
+    char *path = chip8_shm_name(name);
+    int fd = shm_open(path, O_RDONLY, 0);
+    free(path);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    const struct chip8_shm_frame *frame = mmap(NULL, sizeof(*frame), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (frame == MAP_FAILED) {
+        return NULL;
+    }
+    if (frame->magic != SHM_MAGIC || frame->layout != SHM_LAYOUT) {
+        chip8_shm_detach(frame);
+        return NULL;
+    }
+    return frame;
+}
+
+void
+chip8_shm_detach(const struct chip8_shm_frame *frame)
+{
+    munmap((void *)frame, sizeof(*frame));
+}
+
+bool
+chip8_shm_read(const struct chip8_shm_frame *shared, struct chip8_shm_frame *copy)
+{
+    for (int attempt = 0; attempt < SHM_READ_ATTEMPTS; attempt++) {
+        uint32_t before = __atomic_load_n(&shared->sequence, __ATOMIC_ACQUIRE);
+        if (before & 1u) {
+            continue;
+        }
+        memcpy(copy, shared, sizeof(*copy));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&shared->sequence, __ATOMIC_RELAXED) == before) {
+            copy->sequence = before;
+            return true;
+        }
+    }
+    return false;
+}
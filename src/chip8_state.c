@@ -0,0 +1,112 @@
+#include "inc/chip8_state.h"
+
+#include <string.h>
+
+#include "inc/chip8.h"
+
+#define HASH_SEED_LOW 0x243f6a8885a308d3u
+#define HASH_SEED_HIGH 0x13198a2e03707344u
+
+void
+chip8_state_save(const struct chip8 *chip8, struct chip8_state *state)
+{
+    chip8_memory_read(chip8->memory, 0, state->memory, sizeof(state->memory));
+    state->registers = *chip8->registers;
+    state->stack = *chip8->stack;
+    state->display = *chip8->display;
+    state->random = chip8->random;
+    state->fault_pc = chip8->fault_pc;
+    state->fault = chip8->fault;
+    state->waiting = chip8->waiting;
+    state->cycle = chip8->cycle;
+}
+
+void
+chip8_state_load(struct chip8 *chip8, const struct chip8_state *state)
+{
+    chip8_memory_write(chip8->memory, 0, state->memory, sizeof(state->memory));
+    *chip8->registers = state->registers;
+    *chip8->stack = state->stack;
+    *chip8->display = state->display;
+    chip8->random = state->random;
+    chip8->fault_pc = state->fault_pc;
+    chip8->fault = state->fault;
+    chip8->waiting = state->waiting;
+    chip8->cycle = state->cycle;
+    chip8->memory_version++;
+}
+
+static uint64_t
+chip8_state_rotate(uint64_t x, uint8_t r)
+{
+    return x << r | x >> (64u - r);
+}
+
+/***
+ * Two independent multiply-rotate lanes, one per half of the hash.
+ */
+static void
+chip8_state_mix(struct chip8_hash *hash, uint64_t word)
+{
+    hash->low = chip8_state_rotate(hash->low ^ word, 29u) * 0x9e3779b97f4a7c15u;
+    hash->high = chip8_state_rotate(hash->high + word, 37u) * 0xc2b2ae3d27d4eb4fu;
+}
+
+static uint64_t
+chip8_state_finish(uint64_t x)
+{
+    x ^= x >> 33u;
+    x *= 0xff51afd7ed558ccdu;
+    x ^= x >> 33u;
+    x *= 0xc4ceb9fe1a85ec53u;
+    x ^= x >> 33u;
+    return x;
+}
+
+static void
+chip8_state_mix_bytes(struct chip8_hash *hash, const void *bytes, size_t size)
+{
+    const uint8_t *ptr = bytes;
+    uint64_t word;
+    for (size_t i = 0; i < size; i += sizeof(word)) {
+        memcpy(&word, ptr + i, sizeof(word));
+        chip8_state_mix(hash, word);
+    }
+}
+
+struct chip8_hash
+chip8_state_hash_memory(const struct chip8_memory *memory)
+{
+    struct chip8_hash hash = {HASH_SEED_LOW, HASH_SEED_HIGH};
+    for (uint16_t page = 0; page < MEMORY_PAGES; page++) {
+        chip8_state_mix_bytes(&hash, memory->pages[page]->bytes, MEMORY_PAGE_SIZE);
+    }
+    return hash;
+}
+
+struct chip8_hash
+chip8_state_hash(const struct chip8 *chip8)
+{
+    const struct chip8_registers *registers = chip8->registers;
+    struct chip8_hash hash = chip8_state_hash_memory(chip8->memory);
+
+    chip8_state_mix_bytes(&hash, chip8->display->display, sizeof(chip8->display->display));
+    chip8_state_mix_bytes(&hash, chip8->stack->stack, sizeof(chip8->stack->stack));
+    chip8_state_mix_bytes(&hash, registers->V, sizeof(registers->V));
+    chip8_state_mix(&hash, (uint64_t)registers->I | (uint64_t)registers->PC << 16u |
+                           (uint64_t)registers->DT << 32u | (uint64_t)registers->ST << 40u |
+                           (uint64_t)registers->SP << 48u | (uint64_t)chip8->fault << 56u);
+    chip8_state_mix(&hash, (uint64_t)chip8->random | (uint64_t)chip8->fault_pc << 32u |
+                           (uint64_t)chip8->waiting << 48u | (uint64_t)chip8->cycle << 56u);
+
+    uint64_t low = chip8_state_finish(hash.low ^ hash.high);
+    hash.high = chip8_state_finish(hash.high + low);
+    hash.low = low;
+    return hash;
+}
+
+bool
+chip8_hash_equal(struct chip8_hash a, struct chip8_hash b)
+{
+    return a.low == b.low && a.high == b.high;
+}
@@ -0,0 +1,411 @@
+#include "inc/chip8_stream.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "inc/chip8.h"
+#include "inc/chip8_registers.h"
+
+#define STREAM_RUN 128              /* Longest run a control byte stands for */
+#define STREAM_MIN_ZEROS 3          /* Shorter zero runs cost less as literals */
+#define STREAM_LITERAL 0x80u
+#define STREAM_FLAGS (STREAM_KEYFRAME | STREAM_ROWS | STREAM_DT | STREAM_ST)
+#define ROW_BYTES (DISPLAY_WIDTH / 8)
+
+struct chip8_stream_subscriber {
+    struct chip8_stream_packet *queue[STREAM_QUEUE];
+    uint32_t head;
+    uint32_t count;
+    bool synced;                    /* Only handed packets from a keyframe on */
+};
+
+struct chip8_stream {
+    uint64_t display[DISPLAY_HEIGHT];   /* As the viewers have it */
+    uint8_t DT;                     /* As the viewers count it down */
+    uint8_t ST;
+    uint32_t frame;
+    uint32_t interval;
+    uint32_t since_keyframe;
+    bool keyframe;                  /* Forced for the next frame */
+    struct chip8_stream_subscriber **subscribers;
+    uint32_t subscriber_count;
+    uint32_t subscriber_capacity;
+    struct chip8_stream_stats stats;
+};
+
+static uint8_t *
+chip8_stream_put32(uint8_t *bytes, uint32_t value)
+{
+    bytes[0] = value >> 24u;
+    bytes[1] = value >> 16u;
+    bytes[2] = value >> 8u;
+    bytes[3] = value;
+    return bytes + 4;
+}
+
+static uint32_t
+chip8_stream_get32(const uint8_t *bytes)
+{
+    return (uint32_t)bytes[0] << 24u | (uint32_t)bytes[1] << 16u | (uint32_t)bytes[2] << 8u | bytes[3];
+}
+
+static uint8_t *
+chip8_stream_put_row(uint8_t *bytes, uint64_t row)
+{
+    for (int i = 0; i < ROW_BYTES; i++) {
+        bytes[i] = row >> (56u - 8u * i);
+    }
+    return bytes + ROW_BYTES;
+}
+
+static uint64_t
+chip8_stream_get_row(const uint8_t *bytes)
+{
+    uint64_t row = 0;
+    for (int i = 0; i < ROW_BYTES; i++) {
+        row = row << 8u | bytes[i];
+    }
+    return row;
+}
+
+static uint8_t
+chip8_stream_count_down(uint8_t timer)
+{
+    return timer ? timer - 1 : 0;
+}
+
+static size_t
+chip8_stream_zeros(const uint8_t *bytes, size_t at, size_t size)
+{
+    size_t end = at;
+    while (end < size && bytes[end] == 0) {
+        end++;
+    }
+    return end - at;
+}
+
+/***
+ * Run-length encode the row deltas, zero runs are only cut out where that is no longer than
+ * keeping them in a literal run, so the output is at most one byte per STREAM_RUN longer.
+ */
+static uint8_t *
+chip8_stream_rle(const uint8_t *bytes, size_t size, uint8_t *out)
+{
+    size_t at = 0;
+    while (at < size) {
+        size_t zeros = chip8_stream_zeros(bytes, at, size);
+        if (zeros >= STREAM_MIN_ZEROS || (zeros && at + zeros == size)) {
+            zeros = zeros < STREAM_RUN ? zeros : STREAM_RUN;
+            *out++ = zeros - 1;
+            at += zeros;
+            continue;
+        }
+
+        size_t start = at;
+        while (at < size && at - start < STREAM_RUN) {
+            if (bytes[at] == 0) {
+                zeros = chip8_stream_zeros(bytes, at, size);
+                if (zeros >= STREAM_MIN_ZEROS || at + zeros == size) {
+                    break;
+                }
+            }
+            at++;
+        }
+        *out++ = STREAM_LITERAL + (at - start - 1);
+        memcpy(out, bytes + start, at - start);
+        out += at - start;
+    }
+    return out;
+}
+
+struct chip8_stream *
+chip8_stream_init(uint32_t interval)
+{
+    struct chip8_stream *stream = calloc(1, sizeof(*stream));
+    if (stream == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+    stream->interval = interval ? interval : STREAM_KEYFRAME_INTERVAL;
+    stream->keyframe = true;
+    return stream;
+}
+
+void
+chip8_stream_free(struct chip8_stream *stream)
+{
+    while (stream->subscriber_count) {
+        chip8_stream_unsubscribe(stream, stream->subscribers[0]);
+    }
+    free(stream->subscribers);
+    free(stream);
+}
+
+struct chip8_stream_packet *
+chip8_stream_encode(struct chip8_stream *stream, const struct chip8 *chip8)
+{
+    struct chip8_stream_packet *packet = malloc(sizeof(*packet));
+    if (packet == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+    const uint64_t *display = chip8->display->display;
+    uint8_t DT = chip8->registers->DT;
+    uint8_t ST = chip8->registers->ST;
+    uint8_t *out = packet->bytes + 1;
+
+    packet->references = 1;
+    packet->frame = stream->frame++;
+    stream->stats.frames++;
+
+    if (stream->keyframe || ++stream->since_keyframe >= stream->interval) {
+        packet->bytes[0] = STREAM_KEYFRAME;
+        out = chip8_stream_put32(out, packet->frame);
+        for (int row = 0; row < DISPLAY_HEIGHT; row++) {
+            out = chip8_stream_put_row(out, display[row]);
+        }
+        *out++ = DT;
+        *out++ = ST;
+        stream->keyframe = false;
+        stream->since_keyframe = 0;
+        stream->stats.keyframes++;
+    } else {
+        uint8_t flags = 0;
+        uint32_t mask = 0;
+        uint8_t delta[DISPLAY_HEIGHT * ROW_BYTES];
+        uint8_t *changed = delta;
+        for (int row = 0; row < DISPLAY_HEIGHT; row++) {
+            if (display[row] != stream->display[row]) {
+                mask |= 1u << row;
+                changed = chip8_stream_put_row(changed, display[row] ^ stream->display[row]);
+            }
+        }
+        if (mask) {
+            flags |= STREAM_ROWS;
+            out = chip8_stream_put32(out, mask);
+            out = chip8_stream_rle(delta, changed - delta, out);
+        }
+        if (DT != chip8_stream_count_down(stream->DT)) {
+            flags |= STREAM_DT;
+            *out++ = DT;
+        }
+        if (ST != chip8_stream_count_down(stream->ST)) {
+            flags |= STREAM_ST;
+            *out++ = ST;
+        }
+        packet->bytes[0] = flags;
+    }
+
+    memcpy(stream->display, display, sizeof(stream->display));
+    stream->DT = DT;
+    stream->ST = ST;
+    packet->size = out - packet->bytes;
+    stream->stats.bytes += packet->size;
+    return packet;
+}
+
+void
+chip8_stream_retain(struct chip8_stream_packet *packet)
+{
+    __atomic_add_fetch(&packet->references, 1, __ATOMIC_RELAXED);
+}
+
+void
+chip8_stream_release(struct chip8_stream_packet *packet)
+{
+    if (__atomic_sub_fetch(&packet->references, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(packet);
+    }
+}
+
+static void
+chip8_stream_drop(struct chip8_stream_subscriber *subscriber)
+{
+    struct chip8_stream_packet *packet;
+    while ((packet = chip8_stream_next(subscriber)) != NULL) {
+        chip8_stream_release(packet);
+    }
+    subscriber->synced = false;
+}
+
+void
+chip8_stream_publish(struct chip8_stream *stream, struct chip8_stream_packet *packet)
+{
+    bool keyframe = packet->bytes[0] & STREAM_KEYFRAME;
+
+    for (uint32_t i = 0; i < stream->subscriber_count; i++) {
+        struct chip8_stream_subscriber *subscriber = stream->subscribers[i];
+        if (subscriber->count == STREAM_QUEUE) {
+            chip8_stream_drop(subscriber);
+            stream->keyframe = true;
+            stream->stats.resyncs++;
+        }
+        if (!subscriber->synced && !keyframe) {
+            continue;
+        }
+        subscriber->synced = true;
+        chip8_stream_retain(packet);
+        subscriber->queue[(subscriber->head + subscriber->count++) % STREAM_QUEUE] = packet;
+    }
+    chip8_stream_release(packet);
+}
+
+struct chip8_stream_subscriber *
+chip8_stream_subscribe(struct chip8_stream *stream)
+{
+    struct chip8_stream_subscriber *subscriber = calloc(1, sizeof(*subscriber));
+    if (subscriber == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+    if (stream->subscriber_count == stream->subscriber_capacity) {
+        stream->subscriber_capacity = stream->subscriber_capacity ? 2 * stream->subscriber_capacity : 16;
+        stream->subscribers = realloc(stream->subscribers,
+                                      stream->subscriber_capacity * sizeof(*stream->subscribers));
+        if (stream->subscribers == NULL) {
+            puts("Error allocating memory!");
+            exit(EXIT_FAILURE);
+        }
+    }
+    stream->subscribers[stream->subscriber_count++] = subscriber;
+    stream->keyframe = true;
+    return subscriber;
+}
+
+void
+chip8_stream_unsubscribe(struct chip8_stream *stream, struct chip8_stream_subscriber *subscriber)
+{
+    for (uint32_t i = 0; i < stream->subscriber_count; i++) {
+        if (stream->subscribers[i] == subscriber) {
+            stream->subscribers[i] = stream->subscribers[--stream->subscriber_count];
+            break;
+        }
+    }
+    chip8_stream_drop(subscriber);
+    free(subscriber);
+}
+
+struct chip8_stream_packet *
+chip8_stream_next(struct chip8_stream_subscriber *subscriber)
+{
+    if (subscriber->count == 0) {
+        return NULL;
+    }
+    struct chip8_stream_packet *packet = subscriber->queue[subscriber->head];
+    subscriber->head = (subscriber->head + 1) % STREAM_QUEUE;
+    subscriber->count--;
+    return packet;
+}
+
+void
+chip8_stream_get_stats(const struct chip8_stream *stream, struct chip8_stream_stats *stats)
+{
+    *stats = stream->stats;
+    stats->subscribers = stream->subscriber_count;
+}
+
+void
+chip8_stream_decoder_init(struct chip8_stream_decoder *decoder)
+{
+    memset(decoder, 0, sizeof(*decoder));
+}
+
+/***
+ * Undo chip8_stream_rle into size bytes of delta.
+ * @return bytes of input used, 0 if the input ends first
+ */
+static size_t
+chip8_stream_unrle(const uint8_t *bytes, size_t available, uint8_t *delta, size_t size, bool *malformed)
+{
+    size_t in = 0, out = 0;
+    while (out < size) {
+        if (in == available) {
+            return 0;
+        }
+        uint8_t control = bytes[in++];
+        size_t run = (control & (STREAM_LITERAL - 1u)) + 1;
+        if (out + run > size) {
+            *malformed = true;
+            return 0;
+        }
+        if (control & STREAM_LITERAL) {
+            if (in + run > available) {
+                return 0;
+            }
+            memcpy(delta + out, bytes + in, run);
+            in += run;
+        } else {
+            memset(delta + out, 0, run);
+        }
+        out += run;
+    }
+    return in;
+}
+
+bool
+chip8_stream_decode(struct chip8_stream_decoder *decoder, const uint8_t *bytes, size_t size, size_t *consumed)
+{
+    *consumed = 0;
+    if (size == 0) {
+        return true;
+    }
+    uint8_t flags = bytes[0];
+    if ((flags & ~STREAM_FLAGS) || ((flags & STREAM_KEYFRAME) && flags != STREAM_KEYFRAME)) {
+        return false;
+    }
+
+    size_t at = 1;
+    if (flags & STREAM_KEYFRAME) {
+        if (size < at + 4 + DISPLAY_HEIGHT * ROW_BYTES + 2) {
+            return true;
+        }
+        decoder->frame = chip8_stream_get32(bytes + at);
+        at += 4;
+        for (int row = 0; row < DISPLAY_HEIGHT; row++, at += ROW_BYTES) {
+            decoder->display[row] = chip8_stream_get_row(bytes + at);
+        }
+        decoder->DT = bytes[at++];
+        decoder->ST = bytes[at++];
+        decoder->synced = true;
+        *consumed = at;
+        return true;
+    }
+
+    uint32_t mask = 0;
+    uint8_t delta[DISPLAY_HEIGHT * ROW_BYTES];
+    if (flags & STREAM_ROWS) {
+        if (size < at + 4) {
+            return true;
+        }
+        mask = chip8_stream_get32(bytes + at);
+        at += 4;
+        bool malformed = false;
+        size_t used = chip8_stream_unrle(bytes + at, size - at, delta, __builtin_popcount(mask) * ROW_BYTES,
+                                         &malformed);
+        if (used == 0) {
+            return !malformed && mask;
+        }
+        at += used;
+    }
+    size_t timers = ((flags & STREAM_DT) != 0) + ((flags & STREAM_ST) != 0);
+    if (size < at + timers) {
+        return true;
+    }
+
+    *consumed = at + timers;
+    if (!decoder->synced) {
+        return true;
+    }
+    const uint8_t *changed = delta;
+    for (int row = 0; row < DISPLAY_HEIGHT; row++) {
+        if (mask & (1u << row)) {
+            decoder->display[row] ^= chip8_stream_get_row(changed);
+            changed += ROW_BYTES;
+        }
+    }
+    decoder->DT = flags & STREAM_DT ? bytes[at++] : chip8_stream_count_down(decoder->DT);
+    decoder->ST = flags & STREAM_ST ? bytes[at++] : chip8_stream_count_down(decoder->ST);
+    decoder->frame++;
+    return true;
+}
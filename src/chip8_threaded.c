@@ -0,0 +1,598 @@
+#include "inc/chip8_threaded.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "inc/chip8.h"
+#include "inc/chip8_display.h"
+#include "inc/chip8_keyboard.h"
+#include "inc/chip8_memory.h"
+#include "inc/chip8_registers.h"
+#include "inc/chip8_stack.h"
+
+/* A skip near the end of memory lands up to 4 bytes past the last fetchable address */
+#define THREADED_OPS (MEMORY_SIZE + 4)
+
+enum chip8_threaded_kind {
+    OP_DECODE,                  /* Not decoded since the last invalidation */
+    OP_BOUNDS,                  /* Fetch past the end of memory */
+    OP_ILLEGAL,
+    OP_00E0, OP_00EE, OP_1nnn, OP_2nnn, OP_3xkk, OP_4xkk, OP_5xy0, OP_6xkk, OP_7xkk,
+    OP_8xy0, OP_8xy1, OP_8xy2, OP_8xy3, OP_8xy4, OP_8xy5, OP_8xy6, OP_8xy7, OP_8xyE,
+    OP_9xy0, OP_Annn, OP_Bnnn, OP_Cxkk, OP_Dxyn, OP_Ex9E, OP_ExA1,
+    OP_Fx07, OP_Fx0A, OP_Fx15, OP_Fx18, OP_Fx1E, OP_Fx29, OP_Fx33, OP_Fx55, OP_Fx65,
+
+    /* Superinstructions, the most frequent pairs executed by the bundled ROMs */
+    OP_SPIN,                    /* 1nnn jumping to itself, nothing changes until the budget runs out */
+    OP_3xkk_1nnn,
+    OP_4xkk_1nnn,
+    OP_7xkk_3xkk,
+    OP_Fx07_3xkk,
+    OP_Annn_Dxyn,
+    OP_Annn_Fx1E,
+    OP_Annn_Fx65,
+    OP_6xkk_6xkk,
+    OP_KINDS
+};
+
+struct chip8_threaded_op {
+    uint8_t kind;
+    uint8_t single;             /* Kind of the first instruction alone, run when the budget ends mid-pair */
+    uint8_t x;
+    uint8_t y;
+    uint16_t nnn;               /* Low 12 bits of the instruction, kk and n are taken from these */
+    uint16_t next;              /* Low 12 bits of the second instruction of a superinstruction */
+};
+
+struct chip8_threaded {
+    struct chip8_engine engine;
+    struct chip8_threaded_stats stats;
+    const struct chip8 *owner;
+    uint32_t version;           /* owner->memory_version the ops were decoded from */
+    struct chip8_threaded_op ops[THREADED_OPS];    /* Indexed by address */
+};
+
+static uint8_t
+chip8_threaded_kind(uint16_t instruction)
+{
+    static const uint8_t kinds[] = {
+            0, OP_1nnn, OP_2nnn, OP_3xkk, OP_4xkk, OP_5xy0, OP_6xkk, OP_7xkk,
+            0, OP_9xy0, OP_Annn, OP_Bnnn, OP_Cxkk, OP_Dxyn, 0, 0
+    };
+
+    switch (instruction >> (3u * NIBBLE)) {
+        case 0x0:
+            return instruction == 0x00e0 ? OP_00E0 : OP_00EE;
+        case 0x8:
+            if ((instruction & 0x0fu) <= 0x07) {
+                return OP_8xy0 + (instruction & 0x0fu);
+            }
+            return (instruction & 0x0fu) == 0x0e ? OP_8xyE : OP_ILLEGAL;
+        case 0xe:
+            return (instruction & 0x00ffu) == 0x9e ? OP_Ex9E : OP_ExA1;
+        case 0xf:
+            switch (instruction & 0x00ffu) {
+                case 0x07:
+                    return OP_Fx07;
+                case 0x0a:
+                    return OP_Fx0A;
+                case 0x15:
+                    return OP_Fx15;
+                case 0x18:
+                    return OP_Fx18;
+                case 0x1e:
+                    return OP_Fx1E;
+                case 0x29:
+                    return OP_Fx29;
+                case 0x33:
+                    return OP_Fx33;
+                case 0x55:
+                    return OP_Fx55;
+                case 0x65:
+                    return OP_Fx65;
+            }
+            return OP_ILLEGAL;
+    }
+    return kinds[instruction >> (3u * NIBBLE)];
+}
+
+/***
+ * Return the superinstruction for a pair, or first if the pair is not fused
+ */
+static uint8_t
+chip8_threaded_fuse(uint8_t first, uint8_t second)
+{
+    switch (first) {
+        case OP_3xkk:
+            return second == OP_1nnn ? OP_3xkk_1nnn : first;
+        case OP_4xkk:
+            return second == OP_1nnn ? OP_4xkk_1nnn : first;
+        case OP_7xkk:
+            return second == OP_3xkk ? OP_7xkk_3xkk : first;
+        case OP_Fx07:
+            return second == OP_3xkk ? OP_Fx07_3xkk : first;
+        case OP_6xkk:
+            return second == OP_6xkk ? OP_6xkk_6xkk : first;
+        case OP_Annn:
+            switch (second) {
+                case OP_Dxyn:
+                    return OP_Annn_Dxyn;
+                case OP_Fx1E:
+                    return OP_Annn_Fx1E;
+                case OP_Fx65:
+                    return OP_Annn_Fx65;
+            }
+            return first;
+    }
+    return first;
+}
+
+static void
+chip8_threaded_decode(struct chip8_threaded *threaded, const struct chip8 *chip8, uint16_t pc)
+{
+    struct chip8_threaded_op *op = &threaded->ops[pc];
+    uint16_t instruction = chip8_memory_fetch(chip8->memory, pc);
+
+    op->kind = op->single = chip8_threaded_kind(instruction);
+    op->x = (instruction >> (2u * NIBBLE)) & 0x0fu;
+    op->y = (instruction >> (1u * NIBBLE)) & 0x0fu;
+    op->nnn = instruction & 0x0fffu;
+    op->next = 0;
+    threaded->stats.decoded++;
+
+    if (op->kind == OP_1nnn && op->nnn == pc) {
+        op->kind = OP_SPIN;
+    } else if (pc + 2 < MEMORY_SIZE - 1) {
+        uint16_t second = chip8_memory_fetch(chip8->memory, pc + 2);
+        op->kind = chip8_threaded_fuse(op->single, chip8_threaded_kind(second));
+        op->next = second & 0x0fffu;
+    }
+    threaded->stats.fused += op->kind != op->single;
+}
+
+/***
+ * Drop the ops decoded from addresses in [from, to). A superinstruction reaches 3 bytes past
+ * its address, so callers pass the first written address minus 3.
+ */
+static void
+chip8_threaded_flush(struct chip8_threaded *threaded, uint32_t from, uint32_t to)
+{
+    for (uint32_t pc = from; pc < to && pc < MEMORY_SIZE - 1; pc++) {
+        threaded->ops[pc].kind = OP_DECODE;
+    }
+}
+
+#define DISPATCH() do {                                                 \
+        if (executed >= cycles) goto done;                              \
+        op = &threaded->ops[PC];                                        \
+        goto *handlers[op->kind];                                       \
+    } while (0)
+#define PAIR() do { if (cycles - executed < 2) goto *handlers[op->single]; } while (0)
+#define FAULT(type) do { fault = type; goto fault; } while (0)
+#define WROTE(from, to) do {                                            \
+        chip8->memory_version++;                                        \
+        threaded->version = chip8->memory_version;                      \
+        chip8_threaded_flush(threaded, (from) >= 3 ? (from) - 3 : 0, to); \
+    } while (0)
+
+#define Vx V[op->x]
+#define Vy V[op->y]
+#define KK (op->nnn & 0x00ffu)
+#define N (op->nnn & 0x000fu)
+#define X2 (op->next >> (2u * NIBBLE))
+#define Y2 ((op->next >> (1u * NIBBLE)) & 0x0fu)
+#define KK2 (op->next & 0x00ffu)
+#define N2 (op->next & 0x000fu)
+
+static uint32_t
+chip8_threaded_run(struct chip8_engine *engine, struct chip8 *chip8, uint32_t cycles)
+{
+    static const void *const handlers[OP_KINDS] = {
+            [OP_DECODE] = &&decode, [OP_BOUNDS] = &&bounds, [OP_ILLEGAL] = &&illegal,
+            [OP_00E0] = &&i_00E0, [OP_00EE] = &&i_00EE, [OP_1nnn] = &&i_1nnn, [OP_2nnn] = &&i_2nnn,
+            [OP_3xkk] = &&i_3xkk, [OP_4xkk] = &&i_4xkk, [OP_5xy0] = &&i_5xy0, [OP_6xkk] = &&i_6xkk,
+            [OP_7xkk] = &&i_7xkk, [OP_8xy0] = &&i_8xy0, [OP_8xy1] = &&i_8xy1, [OP_8xy2] = &&i_8xy2,
+            [OP_8xy3] = &&i_8xy3, [OP_8xy4] = &&i_8xy4, [OP_8xy5] = &&i_8xy5, [OP_8xy6] = &&i_8xy6,
+            [OP_8xy7] = &&i_8xy7, [OP_8xyE] = &&i_8xyE, [OP_9xy0] = &&i_9xy0, [OP_Annn] = &&i_Annn,
+            [OP_Bnnn] = &&i_Bnnn, [OP_Cxkk] = &&i_Cxkk, [OP_Dxyn] = &&i_Dxyn, [OP_Ex9E] = &&i_Ex9E,
+            [OP_ExA1] = &&i_ExA1, [OP_Fx07] = &&i_Fx07, [OP_Fx0A] = &&i_Fx0A, [OP_Fx15] = &&i_Fx15,
+            [OP_Fx18] = &&i_Fx18, [OP_Fx1E] = &&i_Fx1E, [OP_Fx29] = &&i_Fx29, [OP_Fx33] = &&i_Fx33,
+            [OP_Fx55] = &&i_Fx55, [OP_Fx65] = &&i_Fx65,
+            [OP_SPIN] = &&spin, [OP_3xkk_1nnn] = &&i_3xkk_1nnn, [OP_4xkk_1nnn] = &&i_4xkk_1nnn,
+            [OP_7xkk_3xkk] = &&i_7xkk_3xkk, [OP_Fx07_3xkk] = &&i_Fx07_3xkk, [OP_Annn_Dxyn] = &&i_Annn_Dxyn,
+            [OP_Annn_Fx1E] = &&i_Annn_Fx1E, [OP_Annn_Fx65] = &&i_Annn_Fx65, [OP_6xkk_6xkk] = &&i_6xkk_6xkk
+    };
+
+    struct chip8_threaded *threaded = (struct chip8_threaded *)engine;
+    struct chip8_registers *registers = chip8->registers;
+    uint8_t *V = registers->V;
+    struct chip8_memory *memory = chip8->memory;
+    uint8_t scratch[V_REGISTERS];
+    const uint16_t *keyboard = chip8->keyboard->keyboard;
+    const struct chip8_threaded_op *op;
+    uint16_t PC = registers->PC;
+    uint16_t I = registers->I;
+    uint32_t executed = 0;
+    enum chip8_fault fault;
+
+    if (threaded->owner != chip8 || threaded->version != chip8->memory_version) {
+        chip8_threaded_flush(threaded, 0, MEMORY_SIZE);
+        threaded->owner = chip8;
+        threaded->version = chip8->memory_version;
+        threaded->stats.flushes++;
+    }
+    if (PC >= MEMORY_SIZE - 1) {
+        /* Faults, only reachable through a jump or return the engine stopped at */
+        chip8_cycle(chip8);
+        return 0;
+    }
+    DISPATCH();
+
+decode:
+    chip8_threaded_decode(threaded, chip8, PC);
+    goto *handlers[op->kind];
+bounds:
+    FAULT(FAULT_MEMORY_BOUNDS);
+illegal:
+    FAULT(FAULT_ILLEGAL_INSTRUCTION);
+
+i_00E0:
+    chip8_display_clear(chip8->display);
+    chip8->effects++;
+    PC += 2;
+    executed++;
+    DISPATCH();
+i_00EE:
+    if (registers->SP == 0) {
+        FAULT(FAULT_STACK_UNDERFLOW);
+    }
+    PC = chip8_stack_pop(chip8->stack, &registers->SP) + 2;
+    executed++;
+    if (PC >= MEMORY_SIZE - 1) {
+        goto done;
+    }
+    DISPATCH();
+i_1nnn:
+    PC = op->nnn;
+    executed++;
+    DISPATCH();
+i_2nnn:
+    if (registers->SP >= STACK_SIZE) {
+        FAULT(FAULT_STACK_OVERFLOW);
+    }
+    chip8_stack_push(chip8->stack, &registers->SP, PC);
+    PC = op->nnn;
+    chip8->effects++;
+    executed++;
+    DISPATCH();
+i_3xkk:
+    PC += Vx == KK ? 4 : 2;
+    executed++;
+    DISPATCH();
+i_4xkk:
+    PC += Vx != KK ? 4 : 2;
+    executed++;
+    DISPATCH();
+i_5xy0:
+    PC += Vx == Vy ? 4 : 2;
+    executed++;
+    DISPATCH();
+i_6xkk:
+    Vx = KK;
+    PC += 2;
+    executed++;
+    DISPATCH();
+i_7xkk:
+    Vx += KK;
+    PC += 2;
+    executed++;
+    DISPATCH();
+i_8xy0:
+    Vx = Vy;
+    PC += 2;
+    executed++;
+    DISPATCH();
+i_8xy1:
+    Vx |= Vy;
+    PC += 2;
+    executed++;
+    DISPATCH();
+i_8xy2:
+    Vx &= Vy;
+    PC += 2;
+    executed++;
+    DISPATCH();
+i_8xy3:
+    Vx ^= Vy;
+    PC += 2;
+    executed++;
+    DISPATCH();
+i_8xy4: {
+    uint16_t sum = Vx + Vy;
+    V[0x0f] = sum > 0xff;
+    Vx = sum;
+    PC += 2;
+    executed++;
+    DISPATCH();
+}
+i_8xy5: {
+    uint8_t x = Vx, y = Vy;
+    V[0x0f] = x >= y;
+    Vx = x - y;
+    PC += 2;
+    executed++;
+    DISPATCH();
+}
+i_8xy6: {
+    uint8_t x = Vx;
+    V[0x0f] = x & 1u;
+    Vx = x >> 1u;
+    PC += 2;
+    executed++;
+    DISPATCH();
+}
+i_8xy7: {
+    uint8_t x = Vx, y = Vy;
+    V[0x0f] = y >= x;
+    Vx = y - x;
+    PC += 2;
+    executed++;
+    DISPATCH();
+}
+i_8xyE: {
+    uint8_t x = Vx;
+    V[0x0f] = x & 0x80u;
+    Vx = x << 1u;
+    PC += 2;
+    executed++;
+    DISPATCH();
+}
+i_9xy0:
+    PC += Vx != Vy ? 4 : 2;
+    executed++;
+    DISPATCH();
+i_Annn:
+    I = op->nnn;
+    PC += 2;
+    executed++;
+    DISPATCH();
+i_Bnnn:
+    PC = V[0] + op->nnn;
+    executed++;
+    if (PC >= MEMORY_SIZE - 1) {
+        goto done;
+    }
+    DISPATCH();
+i_Cxkk: {
+    uint32_t x = chip8->random;
+    x ^= x << 13u;
+    x ^= x >> 17u;
+    x ^= x << 5u;
+    chip8->random = x;
+    Vx = (x >> 24u) & KK;
+    chip8->effects++;
+    PC += 2;
+    executed++;
+    DISPATCH();
+}
+i_Dxyn:
+    if (I + N > MEMORY_SIZE) {
+        FAULT(FAULT_MEMORY_BOUNDS);
+    }
+    V[0x0f] = chip8_display_draw(chip8->display, Vx, Vy, N, chip8_memory_span(memory, I, N, scratch));
+    chip8->effects++;
+    PC += 2;
+    executed++;
+    DISPATCH();
+i_Ex9E:
+    PC += (*keyboard >> (Vx & 0x0fu)) & 1u ? 4 : 2;
+    executed++;
+    DISPATCH();
+i_ExA1:
+    PC += (*keyboard >> (Vx & 0x0fu)) & 1u ? 2 : 4;
+    executed++;
+    DISPATCH();
+i_Fx07:
+    Vx = registers->DT;
+    PC += 2;
+    executed++;
+    DISPATCH();
+i_Fx0A: {
+    /* Same quirk as the interpreter, keys 0 and 1 do not end the wait */
+    uint8_t key = *keyboard ? __builtin_ctz(*keyboard) : 0;
+    executed++;
+    chip8->waiting = !(key >> 1u);
+    if (chip8->waiting) {
+        goto done;
+    }
+    Vx = key;
+    PC += 2;
+    DISPATCH();
+}
+i_Fx15:
+    registers->DT = Vx;
+    PC += 2;
+    executed++;
+    DISPATCH();
+i_Fx18:
+    registers->ST = Vx;
+    PC += 2;
+    executed++;
+    DISPATCH();
+i_Fx1E:
+    I += Vx;
+    PC += 2;
+    executed++;
+    DISPATCH();
+i_Fx29:
+    I = chip8_memory_get_digit_sprite(Vx & 0x0fu);
+    PC += 2;
+    executed++;
+    DISPATCH();
+i_Fx33: {
+    uint8_t x = Vx;
+    if (I + 2 >= MEMORY_SIZE) {
+        FAULT(FAULT_MEMORY_BOUNDS);
+    }
+    chip8_memory_set(memory, I, x / 100);
+    chip8_memory_set(memory, I + 1, (x / 10) % 10);
+    chip8_memory_set(memory, I + 2, x % 10);
+    chip8->effects++;
+    WROTE(I, I + 3u);
+    PC += 2;
+    executed++;
+    DISPATCH();
+}
+i_Fx55:
+    if (I + op->x >= MEMORY_SIZE) {
+        FAULT(FAULT_MEMORY_BOUNDS);
+    }
+    for (uint8_t i = 0; i <= op->x; i++) {
+        chip8_memory_set(memory, I + i, V[i]);
+    }
+    chip8->effects++;
+    WROTE(I, I + op->x + 1u);
+    PC += 2;
+    executed++;
+    DISPATCH();
+i_Fx65: {
+    if (I + op->x >= MEMORY_SIZE) {
+        FAULT(FAULT_MEMORY_BOUNDS);
+    }
+    const uint8_t *bytes = chip8_memory_span(memory, I, op->x + 1u, scratch);
+    for (uint8_t i = 0; i <= op->x; i++) {
+        V[i] = bytes[i];
+    }
+    PC += 2;
+    executed++;
+    DISPATCH();
+}
+
+spin:
+    executed = cycles;
+    goto done;
+i_3xkk_1nnn:
+    PAIR();
+    if (Vx == KK) {
+        PC += 4;
+        executed++;
+    } else {
+        PC = op->next;
+        executed += 2;
+    }
+    DISPATCH();
+i_4xkk_1nnn:
+    PAIR();
+    if (Vx != KK) {
+        PC += 4;
+        executed++;
+    } else {
+        PC = op->next;
+        executed += 2;
+    }
+    DISPATCH();
+i_7xkk_3xkk:
+    PAIR();
+    Vx += KK;
+    PC += V[X2] == KK2 ? 6 : 4;
+    executed += 2;
+    DISPATCH();
+i_Fx07_3xkk:
+    PAIR();
+    Vx = registers->DT;
+    PC += V[X2] == KK2 ? 6 : 4;
+    executed += 2;
+    DISPATCH();
+i_Annn_Dxyn:
+    PAIR();
+    I = op->nnn;
+    PC += 2;
+    executed++;
+    if (I + N2 > MEMORY_SIZE) {
+        FAULT(FAULT_MEMORY_BOUNDS);
+    }
+    V[0x0f] = chip8_display_draw(chip8->display, V[X2], V[Y2], N2, chip8_memory_span(memory, I, N2, scratch));
+    chip8->effects++;
+    PC += 2;
+    executed++;
+    DISPATCH();
+i_Annn_Fx1E:
+    PAIR();
+    I = op->nnn + V[X2];
+    PC += 4;
+    executed += 2;
+    DISPATCH();
+i_Annn_Fx65: {
+    PAIR();
+    I = op->nnn;
+    PC += 2;
+    executed++;
+    if (I + X2 >= MEMORY_SIZE) {
+        FAULT(FAULT_MEMORY_BOUNDS);
+    }
+    const uint8_t *bytes = chip8_memory_span(memory, I, X2 + 1u, scratch);
+    for (uint8_t i = 0; i <= X2; i++) {
+        V[i] = bytes[i];
+    }
+    PC += 2;
+    executed++;
+    DISPATCH();
+}
+i_6xkk_6xkk:
+    PAIR();
+    Vx = KK;
+    V[X2] = KK2;
+    PC += 4;
+    executed += 2;
+    DISPATCH();
+
+fault:
+    chip8->fault = fault;
+    chip8->fault_pc = PC;
+done:
+    registers->PC = PC;
+    registers->I = I;
+    return executed;
+}
+
+#undef DISPATCH
+#undef PAIR
+#undef FAULT
+#undef WROTE
+#undef Vx
+#undef Vy
+#undef KK
+#undef N
+#undef X2
+#undef Y2
+#undef KK2
+#undef N2
+
+static void
+chip8_threaded_free(struct chip8_engine *engine)
+{
+    free(engine);
+}
+
+struct chip8_engine *
+chip8_threaded_init(void)
+{
+    struct chip8_threaded *threaded = calloc(1, sizeof(*threaded));
+    if (threaded == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+    threaded->engine.name = "threaded";
+    threaded->engine.run = chip8_threaded_run;
+    threaded->engine.free = chip8_threaded_free;
+    for (uint32_t pc = MEMORY_SIZE - 1; pc < THREADED_OPS; pc++) {
+        threaded->ops[pc].kind = OP_BOUNDS;
+    }
+    return &threaded->engine;
+}
+
+void
+chip8_threaded_get_stats(const struct chip8_engine *engine, struct chip8_threaded_stats *stats)
+{
+    *stats = ((const struct chip8_threaded *)engine)->stats;
+}
@@ -0,0 +1,135 @@
+#include "inc/chip8_trace.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static const int crash_signals[] = {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT};
+
+/* The armed trace, signal handlers cannot be handed any state */
+static struct chip8_trace *armed;
+static char *armed_path;
+
+struct chip8_trace *
+chip8_trace_init(uint32_t capacity)
+{
+    if (capacity == 0 || capacity > (1u << 31u)) {
+        return NULL;
+    }
+    uint32_t size = 1;
+    while (size < capacity) {
+        size <<= 1u;
+    }
+
+    struct chip8_trace *trace = calloc(1, sizeof(*trace) + size * sizeof(trace->entries[0]));
+    if (trace == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+    trace->header.magic = TRACE_MAGIC;
+    trace->header.version = TRACE_VERSION;
+    trace->header.capacity = size;
+    trace->header.entry_size = sizeof(trace->entries[0]);
+    trace->mask = size - 1;
+    return trace;
+}
+
+void
+chip8_trace_free(struct chip8_trace *trace)
+{
+    if (trace == armed) {
+        for (size_t i = 0; i < sizeof(crash_signals) / sizeof(crash_signals[0]); i++) {
+            signal(crash_signals[i], SIG_DFL);
+        }
+        signal(SIGUSR1, SIG_DFL);
+        armed = NULL;
+        free(armed_path);
+        armed_path = NULL;
+    }
+    free(trace);
+}
+
+static bool
+chip8_trace_write_all(int fd, const void *buffer, size_t size)
+{
+    const uint8_t *bytes = buffer;
+    while (size) {
+        ssize_t written = write(fd, bytes, size);
+        if (written <= 0) {
+            return false;
+        }
+        bytes += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool
+chip8_trace_write(const struct chip8_trace *trace, int fd)
+{
+    uint64_t total = trace->header.total;
+    uint32_t count = total < trace->header.capacity ? (uint32_t)total : trace->header.capacity;
+    uint32_t oldest = total < trace->header.capacity ? 0 : (uint32_t)(total & trace->mask);
+    struct chip8_trace_header header = trace->header;
+
+    header.total = total;
+    return chip8_trace_write_all(fd, &header, sizeof(header)) &&
+           chip8_trace_write_all(fd, &trace->entries[oldest], (count - oldest) * sizeof(trace->entries[0])) &&
+           chip8_trace_write_all(fd, trace->entries, oldest * sizeof(trace->entries[0]));
+}
+
+bool
+chip8_trace_dump(const struct chip8_trace *trace, const char *path)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    bool written = chip8_trace_write(trace, fd);
+    return close(fd) == 0 && written;
+}
+
+/***
+ * Dump and, for crashes, let the signal kill the process as it would have
+ */
+static void
+chip8_trace_handler(int signal_number)
+{
+    if (armed) {
+        chip8_trace_dump(armed, armed_path);
+    }
+    if (signal_number != SIGUSR1) {
+        signal(signal_number, SIG_DFL);
+        raise(signal_number);
+    }
+}
+
+bool
+chip8_trace_arm(struct chip8_trace *trace, const char *path)
+{
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = chip8_trace_handler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+
+    char *copy = malloc(strlen(path) + 1);
+    if (copy == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+    strcpy(copy, path);
+    free(armed_path);
+    armed_path = copy;
+    armed = trace;
+
+    for (size_t i = 0; i < sizeof(crash_signals) / sizeof(crash_signals[0]); i++) {
+        if (sigaction(crash_signals[i], &action, NULL) != 0) {
+            return false;
+        }
+    }
+    return sigaction(SIGUSR1, &action, NULL) == 0;
+}
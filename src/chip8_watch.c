@@ -0,0 +1,121 @@
+#include "inc/chip8_watch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO)
+#define WATCH_BUFFER 4096
+
+struct chip8_watch {
+    int fd;
+    char *name;                     /* File name within the watched directory */
+};
+
+struct chip8_watch *
+chip8_watch_init(const char *path)
+{
+    struct chip8_watch *watch = calloc(1, sizeof(*watch));
+    char *directory = strdup(path);
+    if (watch == NULL || directory == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+
+    char *slash = strrchr(directory, '/');
+    watch->name = strdup(slash ? slash + 1 : path);
+    if (watch->name == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+    if (slash == directory) {
+        slash[1] = '\0';
+    } else if (slash) {
+        *slash = '\0';
+    } else {
+        strcpy(directory, ".");
+    }
+
+    watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    bool ok = watch->fd >= 0 && *watch->name && inotify_add_watch(watch->fd, directory, WATCH_EVENTS) >= 0;
+    free(directory);
+    if (!ok) {
+        chip8_watch_free(watch);
+        return NULL;
+    }
+    return watch;
+}
+
+void
+chip8_watch_free(struct chip8_watch *watch)
+{
+    if (watch->fd >= 0) {
+        close(watch->fd);
+    }
+    free(watch->name);
+    free(watch);
+}
+
+/***
+ * Drain the events queued so far, return true if one of them was about the watched file
+ */
+static bool
+chip8_watch_drain(struct chip8_watch *watch)
+{
+    char buffer[WATCH_BUFFER] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool changed = false;
+    ssize_t length;
+    while ((length = read(watch->fd, buffer, sizeof(buffer))) > 0) {
+        const char *p = buffer;
+        while (p < buffer + length) {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            changed |= event->len && strcmp(event->name, watch->name) == 0;
+            p += sizeof(*event) + event->len;
+        }
+    }
+    return changed;
+}
+
+bool
+chip8_watch_wait(struct chip8_watch *watch, int timeout)
+{
+    struct pollfd fd = {watch->fd, POLLIN, 0};
+    if (poll(&fd, 1, timeout) <= 0 || !chip8_watch_drain(watch)) {
+        return false;
+    }
+    while (poll(&fd, 1, WATCH_SETTLE) > 0) {
+        chip8_watch_drain(watch);
+    }
+    return true;
+}
+
+#else
+
+struct chip8_watch *
+chip8_watch_init(const char *path)
+{
+    (void)path;
+    return NULL;
+}
+
+void
+chip8_watch_free(struct chip8_watch *watch)
+{
+    (void)watch;
+}
+
+bool
+chip8_watch_wait(struct chip8_watch *watch, int timeout)
+{
+    (void)watch;
+    (void)timeout;
+    return false;
+}
+
+#endif
@@ -9,15 +9,61 @@
 
 #define CYCLES_PER_SECOND 540
 #define FRAMES_PER_SECOND 60
+#define CYCLES_PER_FRAME (CYCLES_PER_SECOND / FRAMES_PER_SECOND)
 
 #define V_REGISTERS 16
 
+enum chip8_fault {
+    FAULT_NONE,
+    FAULT_STACK_OVERFLOW,           /* 2nnn with a full stack */
+    FAULT_STACK_UNDERFLOW,          /* 00EE with an empty stack */
+    FAULT_MEMORY_BOUNDS,            /* Fetch or memory access past MEMORY_SIZE */
+    FAULT_ILLEGAL_INSTRUCTION       /* Opcode without a handler */
+};
+
+/*
+ * Why chip8_run_until() returned. When several conditions hold at once, the first in this
+ * order is reported.
+ */
+enum chip8_stop {
+    STOP_FAULT,                     /* The machine halted */
+    STOP_PC,                        /* PC reached the address, the instruction there has not run */
+    STOP_MEMORY,                    /* The last instruction changed the watched byte */
+    STOP_DISPLAY,                   /* The last instruction changed what the display shows */
+    STOP_SOUND,                     /* The last instruction started the sound timer */
+    STOP_KEY_WAIT,                  /* The last instruction started waiting on Fx0A */
+    STOP_FRAMES,                    /* The frames ran, each one ending with a timer tick */
+    STOP_INSTRUCTIONS               /* The instructions ran, counting cycles skipped in idle loops */
+};
+
+#define UNTIL_PC (1u << STOP_PC)
+#define UNTIL_MEMORY (1u << STOP_MEMORY)
+#define UNTIL_DISPLAY (1u << STOP_DISPLAY)
+#define UNTIL_SOUND (1u << STOP_SOUND)
+#define UNTIL_KEY_WAIT (1u << STOP_KEY_WAIT)
+#define UNTIL_FRAMES (1u << STOP_FRAMES)
+#define UNTIL_INSTRUCTIONS (1u << STOP_INSTRUCTIONS)
+
+struct chip8_until {
+    uint32_t conditions;            /* UNTIL_* for the fields below that apply */
+    uint64_t instructions;
+    uint32_t frames;
+    uint16_t pc;
+    uint16_t address;               /* Byte watched by UNTIL_MEMORY, below MEMORY_SIZE */
+    uint64_t executed;              /* Set on return: instructions executed */
+    uint32_t elapsed;               /* Set on return: frames completed */
+};
+
 struct chip8_memory;
 struct chip8_registers;
 struct chip8_stack;
 struct chip8_keyboard;
 struct chip8_display;
-struct SDL_Renderer;
+struct chip8_idle;
+struct chip8_shm;
+struct chip8_engine;
+struct chip8_trace;
+struct chip8_heatmap;
 
 struct chip8 {
     struct chip8_memory *memory;
@@ -25,11 +71,44 @@ struct chip8 {
     struct chip8_stack *stack;
     struct chip8_keyboard *keyboard;
     struct chip8_display *display;
-    struct SDL_Renderer *renderer;
+    struct chip8_idle *idle;
+    struct chip8_shm *shm;      /* Optional state export, published every frame */
+    struct chip8_engine *engine; /* Optional, NULL interprets every instruction */
+    struct chip8_trace *trace;  /* Optional, keeps the last instructions executed */
+    struct chip8_heatmap *heatmap; /* Optional, counts accesses per address */
+    uint32_t effects;           /* Bumped by every instruction touching more than registers */
+    uint32_t memory_version;    /* Bumped whenever memory may have changed */
+    uint32_t random;            /* Cxkk generator state */
+    bool waiting;               /* Blocked on Fx0A until a key is pressed */
+    uint8_t fault;              /* enum chip8_fault, the machine halts once set */
+    uint16_t fault_pc;          /* Address of the faulting instruction */
+    uint8_t cycle;              /* Instructions executed in the current frame, chip8_run_until() stops within frames */
 };
 
-struct chip8 *chip8_init(struct SDL_Renderer *renderer, uint16_t *keyboard);
+struct chip8 *chip8_init(uint16_t *keyboard);
+void chip8_free(struct chip8 *chip8);
+struct chip8 *chip8_fork(const struct chip8 *chip8, uint16_t *keyboard);
+void chip8_reset(struct chip8 *chip8, uint32_t seed);
 void chip8_load_program(struct chip8 *chip8, const uint8_t *program, uint32_t size);
+void chip8_reload_program(struct chip8 *chip8, const uint8_t *previous, uint32_t previous_size, const uint8_t *program,
+                          uint32_t size);
 bool chip8_step(struct chip8 *chip8);
+bool chip8_advance(struct chip8 *chip8, uint32_t frames);
+
+/**
+ * Execute until one of the conditions holds or the machine faults, keeping frames of
+ * CYCLES_PER_FRAME instructions like chip8_step(), which finishes a frame this left halfway.
+ * A frame's timers tick as soon as its last instruction ran, also when a condition held after
+ * it, so they do not depend on where a run stopped. Engines are only used without instruction
+ * level conditions, and a PC condition is not checked for the first instruction, so a stop
+ * there can be resumed.
+ * @return the condition that held
+ */
+enum chip8_stop chip8_run_until(struct chip8 *chip8, struct chip8_until *until);
+void chip8_cycle(struct chip8 *chip8);
+bool chip8_tick(struct chip8 *chip8);
+bool chip8_waiting_for_key(const struct chip8 *chip8);
+bool chip8_timers_active(const struct chip8 *chip8);
+const char *chip8_fault_name(enum chip8_fault fault);
 
 #endif //CHIP8_CHIP8_H
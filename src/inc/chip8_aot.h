@@ -0,0 +1,57 @@
+#ifndef CHIP8_CHIP8_AOT_H
+#define CHIP8_CHIP8_AOT_H
+
+#include <stdint.h>
+
+#include "chip8_engine.h"
+
+#define AOT_ABI 2
+#define AOT_SYMBOL "chip8_aot_module"
+
+struct chip8;
+
+struct chip8_aot_block {
+    uint16_t address;
+    uint16_t size;              /* Bytes of code the block was compiled from */
+};
+
+/*
+ * What chip8-aot emits for a ROM. Blocks are only entered while the machine's memory still
+ * holds the bytes they were compiled from, everything else is left to the interpreter.
+ */
+struct chip8_aot_module {
+    uint32_t abi;               /* AOT_ABI */
+    uint32_t layout;            /* sizeof(struct chip8) the module was compiled against */
+    uint16_t block_count;
+    const struct chip8_aot_block *blocks;   /* Sorted by address */
+    const uint8_t *image;       /* Memory contents the blocks were compiled from */
+
+    /**
+     * Execute compiled code starting at PC.
+     * @param valid - per block, whether memory still matches the image
+     * @param cycle - interpreter, for the instructions the module does not translate
+     * @param budget - most instructions to execute
+     * @return instructions executed, 0 if PC does not start valid compiled code
+     */
+    uint32_t (*run)(struct chip8 *chip8, const uint8_t *valid, void (*cycle)(struct chip8 *), uint32_t budget);
+};
+
+struct chip8_aot_stats {
+    uint64_t compiled;          /* Instructions executed by the module */
+    uint64_t interpreted;       /* Instructions that fell back to the interpreter */
+    uint64_t revalidations;     /* Memory changes that forced a check against the image */
+};
+
+/**
+ * @param path - shared object built from chip8-aot output
+ * @return NULL if it cannot be loaded or was built for a different layout
+ */
+struct chip8_engine *chip8_aot_load(const char *path);
+
+/**
+ * Wraps a module linked into the executable. The engine does not own the module.
+ */
+struct chip8_engine *chip8_aot_init(const struct chip8_aot_module *module);
+void chip8_aot_get_stats(const struct chip8_engine *engine, struct chip8_aot_stats *stats);
+
+#endif //CHIP8_CHIP8_AOT_H
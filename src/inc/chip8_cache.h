@@ -0,0 +1,45 @@
+#ifndef CHIP8_CHIP8_CACHE_H
+#define CHIP8_CHIP8_CACHE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "chip8_state.h"
+
+#define CACHE_MAX_WRITES 32         /* Memory bytes a cached frame may change */
+
+struct chip8;
+
+struct chip8_cache_stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t uncacheable;       /* Frames that wrote more than CACHE_MAX_WRITES bytes */
+    uint64_t evictions;
+    uint32_t entries;           /* Slots in use */
+    uint32_t capacity;
+};
+
+struct chip8_cache;
+
+/**
+ * Opt-in transposition cache for whole frames, keyed by a hash of the machine state and the
+ * keyboard mask. The hash is kept up to date through memory_version and chip8->effects rather
+ * than recomputed every frame. The PRNG state is part of the key, so frames drawing random
+ * numbers through Cxkk are cached like any other. A cache must only be used from one thread at
+ * a time.
+ * @param budget - upper bound for the memory used by the entries, in bytes
+ * @return NULL if the budget does not fit a single entry
+ */
+struct chip8_cache *chip8_cache_init(size_t budget);
+void chip8_cache_free(struct chip8_cache *cache);
+
+/**
+ * Drop-in replacement for chip8_step(), restores the frame's outcome on a hit instead of
+ * executing it.
+ */
+bool chip8_cache_step(struct chip8_cache *cache, struct chip8 *chip8);
+void chip8_cache_clear(struct chip8_cache *cache);
+void chip8_cache_get_stats(const struct chip8_cache *cache, struct chip8_cache_stats *stats);
+
+#endif //CHIP8_CHIP8_CACHE_H
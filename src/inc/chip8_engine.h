@@ -0,0 +1,25 @@
+#ifndef CHIP8_CHIP8_ENGINE_H
+#define CHIP8_CHIP8_ENGINE_H
+
+#include <stdint.h>
+
+struct chip8;
+
+/*
+ * Alternative executor for instructions. chip8_step() hands the frame's cycle budget to
+ * the engine of a machine instead of interpreting it; engines must leave the machine in
+ * exactly the state the interpreter would.
+ */
+struct chip8_engine {
+    const char *name;
+
+    /**
+     * Execute instructions starting at PC.
+     * @param cycles - most instructions to execute, at least 1
+     * @return instructions executed, at least 1 unless the machine faulted
+     */
+    uint32_t (*run)(struct chip8_engine *engine, struct chip8 *chip8, uint32_t cycles);
+    void (*free)(struct chip8_engine *engine);
+};
+
+#endif //CHIP8_CHIP8_ENGINE_H
@@ -0,0 +1,73 @@
+#ifndef CHIP8_CHIP8_ENV_H
+#define CHIP8_CHIP8_ENV_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define ENV_MAX_WATCH 8
+
+enum chip8_env_observation {
+    ENV_OBSERVATION_BITPLANE,       /* DISPLAY_HEIGHT uint64_t rows, leftmost pixel in the top bit */
+    ENV_OBSERVATION_BYTES           /* DISPLAY_WIDTH * DISPLAY_HEIGHT bytes, 0 or 1 */
+};
+
+/**
+ * @param watched - current values of the watched addresses
+ * @param previous - values before the step
+ * @param count - number of watched addresses
+ * @param user
+ * @return reward for the step
+ */
+typedef float (*chip8_env_reward_fn)(const uint8_t *watched, const uint8_t *previous, uint8_t count, void *user);
+
+/**
+ * @return true if the episode is over
+ */
+typedef bool (*chip8_env_done_fn)(const uint8_t *watched, uint8_t count, void *user);
+
+struct chip8_env_config {
+    uint16_t envs;                          /* Number of machines */
+    uint16_t threads;                       /* Worker threads, 0 for one per online core */
+    uint8_t frame_skip;                     /* Frames every action is held for, 0 is treated as 1 */
+    uint32_t max_frames;                    /* Episode length limit, 0 for none */
+    enum chip8_env_observation observation;
+    uint16_t watch[ENV_MAX_WATCH];          /* Memory addresses handed to the hooks */
+    uint8_t watch_count;
+    chip8_env_reward_fn reward;             /* NULL reads the watched bytes as Fx33 BCD digits of a score */
+    chip8_env_done_fn done;                 /* NULL ends episodes only at max_frames or a fault */
+    void *user;
+};
+
+struct chip8_env;
+
+struct chip8_env *chip8_env_init(const uint8_t *program, uint32_t size, const struct chip8_env_config *config);
+void chip8_env_free(struct chip8_env *env);
+
+/**
+ * @return bytes of observation written per machine
+ */
+size_t chip8_env_observation_size(const struct chip8_env *env);
+
+/**
+ * Restart every machine, machine i is seeded from seed and i.
+ * @param env
+ * @param seed
+ * @param observations - envs * chip8_env_observation_size() bytes
+ */
+void chip8_env_reset(struct chip8_env *env, uint64_t seed, uint8_t *observations);
+
+/**
+ * Hold actions[i] on the keypad of machine i for frame_skip frames. Machines whose
+ * episode ended or faulted in the previous step are restarted first. Does not allocate.
+ * @param env
+ * @param actions - keypad masks, bit n is key n
+ * @param n_envs - number of machines to step, starting from the first
+ * @param observations - n_envs * chip8_env_observation_size() bytes
+ * @param rewards - n_envs rewards
+ * @param dones - n_envs episode end flags
+ */
+void chip8_env_step(struct chip8_env *env, const uint16_t *actions, uint16_t n_envs, uint8_t *observations,
+                    float *rewards, bool *dones);
+
+#endif //CHIP8_CHIP8_ENV_H
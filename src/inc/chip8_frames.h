@@ -0,0 +1,45 @@
+#ifndef CHIP8_CHIP8_FRAMES_H
+#define CHIP8_CHIP8_FRAMES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "chip8_display.h"
+
+#define FRAMES_SLOTS 3
+#define FRAMES_SLOT_MASK 0x3u
+#define FRAMES_FRESH 0x4u           /* Set while the middle slot holds a frame the consumer has not taken */
+
+struct chip8_frame {
+    struct chip8_display display;
+    uint32_t sequence;              /* Frames published up to and including this one */
+};
+
+/*
+ * Triple buffer handing completed frames from the emulation thread to the render thread.
+ * The producer fills the back slot and swaps it with the middle one, the consumer swaps the
+ * middle slot with the front one when it holds something newer. Neither side ever waits and
+ * the consumer always gets the newest complete frame, frames it was too slow for are skipped.
+ */
+struct chip8_frames {
+    uint32_t back;                  /* Producer's slot */
+    uint32_t sequence;
+    struct chip8_frame slots[FRAMES_SLOTS];
+    uint32_t middle;                /* Slot index and FRAMES_FRESH, only ever exchanged atomically */
+    uint32_t front;                 /* Consumer's slot */
+};
+
+void chip8_frames_init(struct chip8_frames *frames);
+
+/**
+ * Only ever called from one thread.
+ */
+void chip8_frames_publish(struct chip8_frames *frames, const struct chip8_display *display);
+
+/**
+ * Only ever called from one thread, the frame stays valid until the next call.
+ * @return newest frame published since the last call, NULL if there is none
+ */
+const struct chip8_frame *chip8_frames_acquire(struct chip8_frames *frames);
+
+#endif //CHIP8_CHIP8_FRAMES_H
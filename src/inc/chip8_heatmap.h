@@ -0,0 +1,59 @@
+#ifndef CHIP8_CHIP8_HEATMAP_H
+#define CHIP8_CHIP8_HEATMAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "chip8_memory.h"
+
+#define HEATMAP_WIDTH 64            /* Pixels per image row, one per address */
+#define HEATMAP_MODIFIED 0x01u      /* Written after it was executed */
+#define HEATMAP_GENERATED 0x02u     /* Executed after it was written */
+
+enum chip8_heatmap_access {
+    HEATMAP_EXECUTE,                /* Fetched as either byte of an instruction */
+    HEATMAP_SPRITE,                 /* Drawn by Dxyn */
+    HEATMAP_READ,                   /* Loaded by Fx65 */
+    HEATMAP_WRITE,                  /* Stored by Fx33 or Fx55 */
+    HEATMAP_ACCESSES
+};
+
+/*
+ * Set as chip8->heatmap to count every access to every address. Machines with a heatmap are
+ * always interpreted, like machines with a trace; without one nothing is counted or checked.
+ * Counters saturate instead of wrapping.
+ */
+struct chip8_heatmap {
+    uint32_t counts[HEATMAP_ACCESSES][MEMORY_SIZE];
+    uint8_t flags[MEMORY_SIZE];     /* HEATMAP_MODIFIED and HEATMAP_GENERATED */
+    uint64_t modified;              /* Writes over executed bytes */
+    uint64_t generated;             /* Fetches of written bytes */
+    uint16_t first_writer;          /* PC of the first write over code, valid once modified is set */
+    uint16_t first_modified;        /* Address it wrote */
+};
+
+struct chip8_heatmap *chip8_heatmap_init(void);
+void chip8_heatmap_free(struct chip8_heatmap *heatmap);
+
+/**
+ * Count the accesses of the instruction about to execute. Called by chip8_cycle(), so the
+ * accesses of an instruction that faults are counted as well.
+ * @param I - index register before the instruction
+ */
+void chip8_heatmap_record(struct chip8_heatmap *heatmap, uint16_t pc, uint16_t instruction, uint16_t I);
+
+/**
+ * One line per address that was accessed at all: address, the count of every access and
+ * whether it was modified or generated, after a header line.
+ */
+bool chip8_heatmap_write_csv(const struct chip8_heatmap *heatmap, FILE *fp);
+
+/**
+ * Binary PGM, HEATMAP_WIDTH addresses per row from address 0, brightness growing with the
+ * logarithm of the count so rarely touched bytes still show.
+ */
+bool chip8_heatmap_write_pgm(const struct chip8_heatmap *heatmap, enum chip8_heatmap_access access, FILE *fp);
+const char *chip8_heatmap_access_name(enum chip8_heatmap_access access);
+
+#endif //CHIP8_CHIP8_HEATMAP_H
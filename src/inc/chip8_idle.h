@@ -0,0 +1,37 @@
+#ifndef CHIP8_CHIP8_IDLE_H
+#define CHIP8_CHIP8_IDLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "chip8_registers.h"
+
+/*
+ * Idle loop detection.
+ *
+ * Within a frame the timers and the keyboard do not change, so a loop that brings the
+ * registers back to the same values without touching memory, display, stack or the RNG
+ * will keep doing so until the end of the frame. Such iterations can be skipped.
+ */
+struct chip8_idle {
+    struct chip8_registers registers;   /* Registers at the loop head */
+    uint32_t effects;                   /* Side effect counter at the loop head */
+    uint8_t cycle;                      /* Cycle at which the loop head was recorded */
+    bool armed;                         /* Loop head recorded in the current frame */
+};
+
+void chip8_idle_begin_frame(struct chip8_idle *idle);
+
+/**
+ * Called after every instruction that moved PC backwards or left it in place.
+ * @param idle
+ * @param registers - registers after the instruction
+ * @param effects - side effect counter after the instruction
+ * @param cycle - cycle of the instruction within the frame
+ * @param cycles - cycles in the frame
+ * @return number of cycles that can be skipped without changing the machine state
+ */
+uint8_t chip8_idle_check(struct chip8_idle *idle, const struct chip8_registers *registers, uint32_t effects,
+                         uint8_t cycle, uint8_t cycles);
+
+#endif //CHIP8_CHIP8_IDLE_H
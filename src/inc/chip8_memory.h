@@ -2,19 +2,61 @@
 #define CHIP8_CHIP8_MEMORY_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #define MEMORY_SIZE 4096
 #define PROGRAM_START_ADDR 0x200
+#define MEMORY_PAGE_SIZE 256
+#define MEMORY_PAGES (MEMORY_SIZE / MEMORY_PAGE_SIZE)
 
 #define NIBBLE 4
 #define BYTE 8
 
+struct chip8_memory_page {
+    uint8_t bytes[MEMORY_PAGE_SIZE];
+    uint32_t references;        /* Memories sharing the page, only written in place while 1 */
+};
+
+/*
+ * Memory is split into pages that a machine shares with its forks until one of them writes
+ * to the page, so forking does not copy memory. Reads index the pages directly, writes go
+ * through chip8_memory_set() or chip8_memory_write().
+ */
 struct chip8_memory {
-    uint8_t memory[MEMORY_SIZE];
+    struct chip8_memory_page *pages[MEMORY_PAGES];
+    uint32_t copied;            /* Shared pages copied by writes so far */
 };
 
 struct chip8_memory *chip8_memory_init(void);
+
+/**
+ * @return memory sharing every page with the given one, copy-on-write
+ */
+struct chip8_memory *chip8_memory_fork(const struct chip8_memory *memory);
+
+/**
+ * Drop the page of memory and share the one of source in its place, copy-on-write
+ */
+void chip8_memory_share(struct chip8_memory *memory, const struct chip8_memory *source, uint16_t page);
+void chip8_memory_free(struct chip8_memory *memory);
+void chip8_memory_reset(struct chip8_memory *memory);
 uint16_t chip8_memory_fetch(const struct chip8_memory *memory, uint16_t pc);
+uint8_t chip8_memory_get(const struct chip8_memory *memory, uint16_t address);
+void chip8_memory_set(struct chip8_memory *memory, uint16_t address, uint8_t value);
+
+/**
+ * @param scratch - at least size bytes, used when the range crosses a page boundary
+ * @return size contiguous bytes starting at address
+ */
+const uint8_t *chip8_memory_span(const struct chip8_memory *memory, uint16_t address, uint16_t size,
+                                 uint8_t *scratch);
+void chip8_memory_read(const struct chip8_memory *memory, uint16_t address, uint8_t *buffer, uint32_t size);
+
+/**
+ * Shared pages the bytes would not change are left shared.
+ */
+void chip8_memory_write(struct chip8_memory *memory, uint16_t address, const uint8_t *buffer, uint32_t size);
+bool chip8_memory_equal(const struct chip8_memory *memory, uint16_t address, const uint8_t *bytes, uint32_t size);
 void chip8_memory_load_program(struct chip8_memory *memory, const uint8_t *program, uint32_t size);
 uint16_t chip8_memory_get_digit_sprite(uint16_t digit);
 
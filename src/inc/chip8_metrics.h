@@ -0,0 +1,86 @@
+#ifndef CHIP8_CHIP8_METRICS_H
+#define CHIP8_CHIP8_METRICS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define METRICS_BUCKETS 256
+#define METRICS_BUCKET_US 250       /* Frame time resolution, the last bucket also takes anything longer */
+
+/*
+ * Where the frontend loop spends wall time. Whatever is not emulation, rendering or
+ * sleeping (event handling, input) is other.
+ */
+enum chip8_metrics_phase {
+    METRICS_OTHER,
+    METRICS_EMULATE,
+    METRICS_RENDER,
+    METRICS_SLEEP,
+    METRICS_PHASES
+};
+
+struct chip8_metrics_report {
+    double seconds;                 /* Wall time covered */
+    double ips;                     /* Emulated instructions per second */
+    double fps;                     /* Presented frames per second */
+    double share[METRICS_PHASES];   /* Fraction of wall time per phase */
+    double p50;                     /* Frame times in milliseconds */
+    double p95;
+    double p99;
+    uint32_t frames;
+    uint32_t missed;                /* Frames presented more than half a frame late */
+    double cpu;                     /* Process CPU time over wall time, can exceed 1 with threads */
+    const char *thread;             /* Optional, names the loop when several of them report */
+};
+
+struct chip8_metrics {
+    uint64_t frame_budget;          /* Nanoseconds between two presents */
+    enum chip8_metrics_phase phase;
+    uint64_t phase_start;
+    uint64_t phase_time[METRICS_PHASES];
+    uint64_t interval_start;
+    uint64_t cpu_start;
+    uint64_t last_frame;            /* 0 until the first present */
+    uint64_t instructions;
+    uint32_t frames;
+    uint32_t missed;
+    uint32_t histogram[METRICS_BUCKETS];
+};
+
+/**
+ * @param frame_budget - milliseconds between two presents, a frame is missed when it takes
+ * more than one and a half of them
+ */
+struct chip8_metrics *chip8_metrics_init(double frame_budget);
+void chip8_metrics_free(struct chip8_metrics *metrics);
+
+/**
+ * Charge the time since the last call to the phase that was running, then start phase.
+ */
+void chip8_metrics_enter(struct chip8_metrics *metrics, enum chip8_metrics_phase phase);
+void chip8_metrics_frame(struct chip8_metrics *metrics);
+
+/**
+ * The loop stopped presenting on purpose, the gap until the next frame is not a frame time.
+ */
+void chip8_metrics_idle(struct chip8_metrics *metrics);
+void chip8_metrics_instructions(struct chip8_metrics *metrics, uint64_t instructions);
+
+/**
+ * Summarize everything since the last report and start a new interval.
+ */
+void chip8_metrics_report(struct chip8_metrics *metrics, struct chip8_metrics_report *report);
+
+/**
+ * @param separator - between the groups of figures, " " for a log line or "\n" for an overlay
+ */
+void chip8_metrics_format(const struct chip8_metrics_report *report, const char *separator,
+                          char *buffer, size_t size);
+
+/**
+ * Append the report as one JSON object on its own line.
+ */
+bool chip8_metrics_write(const struct chip8_metrics_report *report, FILE *fp);
+
+#endif //CHIP8_CHIP8_METRICS_H
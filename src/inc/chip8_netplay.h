@@ -0,0 +1,67 @@
+#ifndef CHIP8_CHIP8_NETPLAY_H
+#define CHIP8_CHIP8_NETPLAY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define NETPLAY_PLAYERS 2
+#define NETPLAY_WINDOW 64           /* Frames of history, bounds how far back a rollback reaches */
+#define NETPLAY_MAX_PREDICTION 12   /* Frames simulated ahead of the last confirmed remote input */
+#define NETPLAY_MAGIC 0x504e3843u   /* "C8NP" */
+
+struct chip8;
+
+struct chip8_netplay_config {
+    uint8_t player;                 /* 0 or 1 */
+    uint16_t masks[NETPLAY_PLAYERS];    /* Keypad keys owned by each player */
+    uint32_t session;               /* Seeds the machine, packets from other sessions are ignored */
+    uint16_t local_port;
+    const char *remote_host;
+    uint16_t remote_port;
+    uint32_t latency;               /* Simulated one-way delay in milliseconds, for testing */
+    float loss;                     /* Simulated chance of dropping an outgoing packet, for testing */
+};
+
+struct chip8_netplay_stats {
+    uint32_t frames;
+    uint32_t rollbacks;
+    uint32_t resimulated;           /* Frames executed again after a misprediction */
+    uint32_t stalls;                /* Calls to advance that had to wait for the peer */
+    uint32_t sent;
+    uint32_t received;
+    uint32_t dropped;               /* Outgoing packets discarded by the simulated loss */
+};
+
+struct chip8_netplay;
+
+/**
+ * Resets the machine with the session seed and loads the program, both peers start from
+ * the same state this way.
+ * @return NULL if the socket cannot be set up or the configuration is invalid
+ */
+struct chip8_netplay *chip8_netplay_init(struct chip8 *chip8, const uint8_t *program, uint32_t size,
+                                         const struct chip8_netplay_config *config);
+void chip8_netplay_free(struct chip8_netplay *netplay);
+
+/**
+ * Simulate the next frame with the local keys applied immediately and the remote keys
+ * predicted. Frames simulated with a wrong prediction are rolled back and replayed as soon
+ * as the real input arrives.
+ * @param keys - local keypad, keys owned by the other player are ignored
+ * @return false if the peer fell too far behind and no frame was simulated
+ */
+bool chip8_netplay_advance(struct chip8_netplay *netplay, uint16_t keys);
+
+/**
+ * Exchange packets and apply late input without simulating a new frame.
+ */
+void chip8_netplay_poll(struct chip8_netplay *netplay);
+
+/**
+ * @return true once both peers hold each other's input for every frame simulated so far
+ */
+bool chip8_netplay_settled(const struct chip8_netplay *netplay);
+uint32_t chip8_netplay_frame(const struct chip8_netplay *netplay);
+void chip8_netplay_get_stats(const struct chip8_netplay *netplay, struct chip8_netplay_stats *stats);
+
+#endif //CHIP8_CHIP8_NETPLAY_H
@@ -0,0 +1,50 @@
+#ifndef CHIP8_CHIP8_RASTER_H
+#define CHIP8_CHIP8_RASTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define RASTER_MAX_SCALE 20
+
+enum chip8_raster_filter {
+    RASTER_FILTER_NONE,
+    RASTER_FILTER_SCALE2X           /* Scale2x/EPX smoothing, needs an even scale */
+};
+
+enum chip8_raster_kernel {
+    RASTER_KERNEL_SCALAR,
+    RASTER_KERNEL_SSE2,
+    RASTER_KERNEL_AVX2
+};
+
+struct chip8_raster {
+    uint32_t on;                        /* ARGB8888 color of lit pixels */
+    uint32_t off;                       /* ARGB8888 color of unlit pixels */
+    uint8_t scale;                      /* Output pixels per display pixel */
+    enum chip8_raster_filter filter;
+    enum chip8_raster_kernel kernel;    /* Best kernel the host supports, may be lowered */
+};
+
+/**
+ * @param raster
+ * @param scale - 1 to RASTER_MAX_SCALE
+ * @param filter
+ * @param on - ARGB8888 color of lit pixels
+ * @param off - ARGB8888 color of unlit pixels
+ * @return false if the scale is out of range or does not suit the filter
+ */
+bool chip8_raster_init(struct chip8_raster *raster, uint8_t scale, enum chip8_raster_filter filter,
+                       uint32_t on, uint32_t off);
+uint16_t chip8_raster_width(const struct chip8_raster *raster);
+uint16_t chip8_raster_height(const struct chip8_raster *raster);
+
+/**
+ * Expand the display bitplane into ARGB8888 pixels.
+ * @param raster
+ * @param display - DISPLAY_HEIGHT rows, leftmost pixel in the most significant bit
+ * @param pixels - chip8_raster_width() x chip8_raster_height() pixels
+ * @param pitch - bytes between the starts of two pixel rows
+ */
+void chip8_raster_draw(const struct chip8_raster *raster, const uint64_t *display, uint32_t *pixels, uint32_t pitch);
+
+#endif //CHIP8_CHIP8_RASTER_H
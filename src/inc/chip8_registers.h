@@ -2,6 +2,7 @@
 #define CHIP8_CHIP8_REGISTERS_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #define V_REGISTERS 16
 
@@ -34,4 +35,6 @@ void chip8_registers_decrement_PC(struct chip8_registers *registers);
 void chip8_registers_decrement_DT(struct chip8_registers *registers);
 void chip8_registers_decrement_ST(struct chip8_registers *registers);
 
+bool chip8_registers_equal(const struct chip8_registers *a, const struct chip8_registers *b);
+
 #endif //CHpIP8_CHIP8_REGISTERS_H
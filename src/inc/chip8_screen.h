@@ -0,0 +1,23 @@
+#ifndef CHIP8_CHIP8_SCREEN_H
+#define CHIP8_CHIP8_SCREEN_H
+
+#include <stdint.h>
+
+#include "chip8_raster.h"
+
+struct chip8_display;
+struct SDL_Renderer;
+struct SDL_Texture;
+
+struct chip8_screen {
+    struct SDL_Renderer *renderer;
+    struct SDL_Texture *texture;
+    struct chip8_raster raster;
+    uint32_t *pixels;           /* Raster output uploaded to texture */
+    const char *overlay;        /* Optional text drawn over the display, lines separated by \n */
+};
+
+struct chip8_screen *chip8_screen_init(struct SDL_Renderer *renderer);
+void chip8_screen_draw(struct chip8_screen *screen, const struct chip8_display *display);
+
+#endif //CHIP8_CHIP8_SCREEN_H
@@ -0,0 +1,66 @@
+#ifndef CHIP8_CHIP8_SERVER_H
+#define CHIP8_CHIP8_SERVER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "chip8_display.h"
+
+#define SERVER_MAGIC 0x56533843u    /* "C8SV" */
+#define SERVER_MAX_LAG 6            /* Frames a session may fall behind before the backlog is skipped */
+
+/*
+ * Wire format on the stream socket, in host byte order since clients are local. The server
+ * greets every client with a hello and then sends a frame message every 60th of a second;
+ * clients send the keypad as a uint16_t mask whenever it changes.
+ */
+struct chip8_server_hello {
+    uint32_t magic;                 /* SERVER_MAGIC */
+    uint16_t workers;
+    uint16_t fps;
+};
+
+struct chip8_server_frame {
+    uint32_t frame;
+    int32_t lateness;               /* Microseconds the frame finished after its deadline, negative if early */
+    uint32_t skipped;               /* Frames since the previous message that were not sent */
+    uint16_t keys;                  /* Keypad the frame ran with */
+    uint8_t sound;
+    uint8_t fault;                  /* enum chip8_fault, the session halts once set */
+    uint64_t display[DISPLAY_HEIGHT];
+};
+
+struct chip8_server_config {
+    const char *path;               /* Unix socket to listen on, replaced if it exists */
+    uint16_t workers;               /* Emulation threads, 0 for one per online core */
+    uint32_t max_sessions;
+    uint32_t seed;
+};
+
+struct chip8_server_stats {
+    uint32_t sessions;              /* Connected now */
+    uint64_t accepted;
+    uint64_t frames;
+    uint64_t missed;                /* Frames finished after their deadline */
+    uint64_t dropped;               /* Frames not sent because the client had not read the previous one */
+    uint64_t skipped;               /* Frames never emulated after a session fell SERVER_MAX_LAG behind */
+};
+
+struct chip8_server;
+
+/**
+ * Listen on the socket and start the workers. Every session gets a machine of its own, reset
+ * with the seed, running the program at 60 frames per second.
+ * @return NULL if the socket cannot be set up or the configuration is invalid
+ */
+struct chip8_server *chip8_server_init(const uint8_t *program, uint32_t size, const struct chip8_server_config *config);
+void chip8_server_free(struct chip8_server *server);
+
+/**
+ * Accept clients and read their input for up to timeout milliseconds, the workers keep
+ * emulating in the meantime. Only ever called from one thread.
+ */
+void chip8_server_poll(struct chip8_server *server, int timeout);
+void chip8_server_get_stats(const struct chip8_server *server, struct chip8_server_stats *stats);
+
+#endif //CHIP8_CHIP8_SERVER_H
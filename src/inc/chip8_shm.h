@@ -0,0 +1,76 @@
+#ifndef CHIP8_CHIP8_SHM_H
+#define CHIP8_CHIP8_SHM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "chip8_display.h"
+#include "chip8_memory.h"
+#include "chip8_registers.h"
+#include "chip8_stack.h"
+
+#define SHM_MAX_REGIONS 8
+#define SHM_MAGIC 0x48533843u       /* "C8SH" */
+#define SHM_LAYOUT 1
+
+struct chip8;
+
+struct chip8_shm_region {
+    uint16_t address;
+    uint16_t length;
+};
+
+/*
+ * Layout of the shared memory segment. The writer makes sequence odd before touching
+ * the frame and even again afterwards, readers retry until they copied the frame
+ * between two equal even values.
+ */
+struct chip8_shm_frame {
+    uint32_t magic;
+    uint32_t layout;
+    uint32_t sequence;                  /* Odd while a frame is being written */
+    uint32_t frame;                     /* Frames published so far */
+    uint64_t display[DISPLAY_HEIGHT];
+    uint8_t V[V_REGISTERS];
+    uint16_t I;
+    uint16_t PC;
+    uint8_t DT;
+    uint8_t ST;
+    uint8_t SP;
+    uint16_t stack[STACK_SIZE];
+    uint8_t region_count;
+    struct chip8_shm_region regions[SHM_MAX_REGIONS];
+    uint8_t memory[MEMORY_SIZE];        /* Regions back to back */
+};
+
+struct chip8_shm {
+    char *name;
+    struct chip8_shm_frame *frame;
+};
+
+/**
+ * Create the segment /name and export the given memory regions into it.
+ * @return NULL if the regions are invalid or the segment cannot be created
+ */
+struct chip8_shm *chip8_shm_create(const char *name, const struct chip8_shm_region *regions, uint8_t count);
+void chip8_shm_destroy(struct chip8_shm *shm);
+
+/**
+ * Publish the machine state. Never waits for readers.
+ */
+void chip8_shm_publish(struct chip8_shm *shm, const struct chip8 *chip8);
+
+/**
+ * Map an existing segment read-only.
+ * @return NULL if it does not exist or has a different layout
+ */
+const struct chip8_shm_frame *chip8_shm_attach(const char *name);
+void chip8_shm_detach(const struct chip8_shm_frame *frame);
+
+/**
+ * Copy a consistent frame out of the segment.
+ * @return false if the writer kept the frame busy for too many attempts
+ */
+bool chip8_shm_read(const struct chip8_shm_frame *shared, struct chip8_shm_frame *copy);
+
+#endif //CHIP8_CHIP8_SHM_H
@@ -0,0 +1,49 @@
+#ifndef CHIP8_CHIP8_STATE_H
+#define CHIP8_CHIP8_STATE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "chip8_display.h"
+#include "chip8_memory.h"
+#include "chip8_registers.h"
+#include "chip8_stack.h"
+
+struct chip8;
+
+/*
+ * Everything that determines how a machine continues, apart from the keyboard.
+ */
+struct chip8_state {
+    uint8_t memory[MEMORY_SIZE];
+    struct chip8_registers registers;
+    struct chip8_stack stack;
+    struct chip8_display display;
+    uint32_t random;
+    uint16_t fault_pc;
+    uint8_t fault;
+    bool waiting;
+    uint8_t cycle;              /* Instructions already executed in the current frame */
+};
+
+struct chip8_hash {
+    uint64_t low;
+    uint64_t high;
+};
+
+void chip8_state_save(const struct chip8 *chip8, struct chip8_state *state);
+void chip8_state_load(struct chip8 *chip8, const struct chip8_state *state);
+
+/**
+ * 128-bit hash of the machine state, equal states hash equally.
+ */
+struct chip8_hash chip8_state_hash(const struct chip8 *chip8);
+
+/**
+ * The memory part of chip8_state_hash(), for callers that track memory changes through
+ * chip8->memory_version and want to avoid rehashing 4 KB.
+ */
+struct chip8_hash chip8_state_hash_memory(const struct chip8_memory *memory);
+bool chip8_hash_equal(struct chip8_hash a, struct chip8_hash b);
+
+#endif //CHIP8_CHIP8_STATE_H
@@ -0,0 +1,106 @@
+#ifndef CHIP8_CHIP8_STREAM_H
+#define CHIP8_CHIP8_STREAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "chip8_display.h"
+
+#define STREAM_KEYFRAME_INTERVAL 120    /* Frames between two keyframes */
+#define STREAM_QUEUE 64                 /* Packets a subscriber may fall behind before it has to resync */
+#define STREAM_MAX_PACKET 272           /* Flags, mask, 256 row bytes with a control byte per 128, timers */
+
+/*
+ * Packet format, one per frame. Packets delimit themselves so they can be concatenated on a
+ * byte stream. A flags byte comes first, then in this order:
+ *   STREAM_KEYFRAME  uint32_t frame, all 32 rows and both timers, the decoder starts here
+ *   STREAM_ROWS      uint32_t mask of the rows that changed, bit 0 for the top row, then the XOR
+ *                    of those rows with what they were, run-length encoded: a control byte below
+ *                    0x80 stands for control + 1 zero bytes, from 0x80 on control - 0x7f literal
+ *                    bytes follow
+ *   STREAM_DT        delay timer, whenever it did not just count down by one
+ *   STREAM_ST        sound timer, likewise, sound plays while it is not 0
+ * Values are in network byte order, rows with their leftmost pixels first. Packets without
+ * STREAM_KEYFRAME are the frame after the previous packet.
+ */
+#define STREAM_KEYFRAME 0x01u
+#define STREAM_ROWS 0x02u
+#define STREAM_DT 0x04u
+#define STREAM_ST 0x08u
+
+struct chip8;
+
+/* An encoded frame, shared by everyone it is handed to */
+struct chip8_stream_packet {
+    uint32_t references;            /* Holders left, the last release frees it */
+    uint32_t frame;
+    uint16_t size;
+    uint8_t bytes[STREAM_MAX_PACKET];
+};
+
+struct chip8_stream_stats {
+    uint32_t subscribers;
+    uint64_t frames;
+    uint64_t keyframes;
+    uint64_t bytes;                 /* Encoded, once per frame however many subscribers got it */
+    uint64_t resyncs;               /* Subscribers that fell STREAM_QUEUE behind and restarted at a keyframe */
+};
+
+struct chip8_stream_decoder {
+    uint64_t display[DISPLAY_HEIGHT];
+    uint8_t DT;
+    uint8_t ST;
+    uint32_t frame;
+    bool synced;                    /* Packets before the first keyframe are skipped */
+};
+
+struct chip8_stream;
+struct chip8_stream_subscriber;
+
+/**
+ * @param interval - frames between two keyframes, 0 for STREAM_KEYFRAME_INTERVAL
+ */
+struct chip8_stream *chip8_stream_init(uint32_t interval);
+void chip8_stream_free(struct chip8_stream *stream);
+
+/**
+ * Encode the display and timers as they are after a frame.
+ * @return packet with one reference, held by the caller
+ */
+struct chip8_stream_packet *chip8_stream_encode(struct chip8_stream *stream, const struct chip8 *chip8);
+
+/**
+ * Hand the packet to every subscriber without copying it, taking over the caller's reference.
+ * Subscribers with a full queue lose it and wait for a keyframe, which the next frame becomes.
+ */
+void chip8_stream_publish(struct chip8_stream *stream, struct chip8_stream_packet *packet);
+void chip8_stream_retain(struct chip8_stream_packet *packet);
+
+/**
+ * Safe from any thread, so packets can be handed on to writer threads.
+ */
+void chip8_stream_release(struct chip8_stream_packet *packet);
+
+/**
+ * The next frame is encoded as a keyframe, so the subscriber starts with a full picture.
+ */
+struct chip8_stream_subscriber *chip8_stream_subscribe(struct chip8_stream *stream);
+void chip8_stream_unsubscribe(struct chip8_stream *stream, struct chip8_stream_subscriber *subscriber);
+
+/**
+ * @return oldest packet queued for the subscriber, to be released by the caller, or NULL
+ */
+struct chip8_stream_packet *chip8_stream_next(struct chip8_stream_subscriber *subscriber);
+void chip8_stream_get_stats(const struct chip8_stream *stream, struct chip8_stream_stats *stats);
+
+void chip8_stream_decoder_init(struct chip8_stream_decoder *decoder);
+
+/**
+ * Apply the packet at the start of bytes.
+ * @param consumed - size of the packet, 0 if bytes does not hold all of it yet
+ * @return false if the packet is malformed
+ */
+bool chip8_stream_decode(struct chip8_stream_decoder *decoder, const uint8_t *bytes, size_t size, size_t *consumed);
+
+#endif //CHIP8_CHIP8_STREAM_H
@@ -0,0 +1,23 @@
+#ifndef CHIP8_CHIP8_THREADED_H
+#define CHIP8_CHIP8_THREADED_H
+
+#include <stdint.h>
+
+#include "chip8_engine.h"
+
+struct chip8_threaded_stats {
+    uint64_t decoded;           /* Addresses decoded, again after every invalidation */
+    uint64_t fused;             /* Of those, decoded into a superinstruction with the next instruction */
+    uint64_t flushes;           /* Memory changed outside the engine and every address was dropped */
+};
+
+/**
+ * Threaded-code engine. Every address is decoded once into an index of a flat table of
+ * handlers, common instruction pairs into a single superinstruction, and dispatched with
+ * computed gotos. Decoded addresses are dropped when the engine's own Fx33/Fx55 write over
+ * them, and all of them when memory_version changes otherwise.
+ */
+struct chip8_engine *chip8_threaded_init(void);
+void chip8_threaded_get_stats(const struct chip8_engine *engine, struct chip8_threaded_stats *stats);
+
+#endif //CHIP8_CHIP8_THREADED_H
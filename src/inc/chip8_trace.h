@@ -0,0 +1,63 @@
+#ifndef CHIP8_CHIP8_TRACE_H
+#define CHIP8_CHIP8_TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TRACE_MAGIC 0x52543843u     /* "C8TR" */
+#define TRACE_VERSION 1
+
+/*
+ * One executed instruction, registers as they were right after it. Which of Vx and VF
+ * actually changed follows from the opcode, chip8-trace works it out when decoding.
+ */
+struct chip8_trace_entry {
+    uint16_t pc;
+    uint16_t opcode;
+    uint16_t I;
+    uint8_t Vx;                 /* x taken from the opcode */
+    uint8_t VF;
+};
+
+/*
+ * A dump is this header followed by the recorded entries, oldest first.
+ */
+struct chip8_trace_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;          /* Entries the ring holds, a power of two */
+    uint32_t entry_size;        /* sizeof(struct chip8_trace_entry) */
+    uint64_t total;             /* Instructions recorded, the ring keeps the last min(total, capacity) */
+};
+
+/*
+ * Set as chip8->trace to record every instruction the interpreter executes. Machines with a
+ * trace are always interpreted, engines do not report single instructions.
+ */
+struct chip8_trace {
+    struct chip8_trace_header header;
+    uint32_t mask;
+    struct chip8_trace_entry entries[];
+};
+
+/**
+ * @param capacity - instructions to keep, rounded up to a power of two
+ * @return NULL if capacity is 0
+ */
+struct chip8_trace *chip8_trace_init(uint32_t capacity);
+void chip8_trace_free(struct chip8_trace *trace);
+
+/**
+ * Write the dump to fd, only uses async-signal-safe calls.
+ */
+bool chip8_trace_write(const struct chip8_trace *trace, int fd);
+bool chip8_trace_dump(const struct chip8_trace *trace, const char *path);
+
+/**
+ * Dump to path when the process crashes (SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT) and
+ * whenever it receives SIGUSR1. Only one trace can be armed at a time, freeing it disarms.
+ * @return false if the handlers cannot be installed
+ */
+bool chip8_trace_arm(struct chip8_trace *trace, const char *path);
+
+#endif //CHIP8_CHIP8_TRACE_H
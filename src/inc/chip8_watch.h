@@ -0,0 +1,26 @@
+#ifndef CHIP8_CHIP8_WATCH_H
+#define CHIP8_CHIP8_WATCH_H
+
+#include <stdbool.h>
+
+#define WATCH_SETTLE 20             /* Milliseconds without further changes before a change counts */
+
+struct chip8_watch;
+
+/**
+ * Watch a file for being rewritten or replaced, through inotify on its directory so editors
+ * and assemblers that write a new file and rename it over the old one are seen as well.
+ * @return NULL if the directory cannot be watched or inotify is not available
+ */
+struct chip8_watch *chip8_watch_init(const char *path);
+void chip8_watch_free(struct chip8_watch *watch);
+
+/**
+ * Block until the file changed or the timeout ran out. A burst of writes, like an assembler
+ * emitting its output in pieces, is reported once after it went quiet for WATCH_SETTLE ms.
+ * @param timeout - milliseconds, negative to wait indefinitely
+ * @return true if the file changed
+ */
+bool chip8_watch_wait(struct chip8_watch *watch, int timeout);
+
+#endif //CHIP8_CHIP8_WATCH_H
@@ -1,61 +1,394 @@
 #include <stdio.h>
+#include <time.h>
 #include <SDL2/SDL.h>
 
 #include "inc/chip8.h"
+#include "inc/chip8_screen.h"
+#include "inc/chip8_shm.h"
+#include "inc/chip8_aot.h"
+#include "inc/chip8_threaded.h"
+#include "inc/chip8_trace.h"
+#include "inc/chip8_heatmap.h"
+#include "inc/chip8_netplay.h"
+#include "inc/chip8_metrics.h"
+#include "inc/chip8_frames.h"
+#include "inc/chip8_state.h"
+#include "inc/chip8_watch.h"
 
 #define ROM_SIZE 4096
+#define FRAME_TIME (1000 / FRAMES_PER_SECOND)
+#define NETPLAY_SESSION 0x43385350u
+#define FAST_FORWARD_SPEED 4
+#define TRACE_CAPACITY (1u << 16u)
+#define METRICS_INTERVAL 1000   /* Milliseconds between two reports */
+#define MAX_SPEED 64
+#define MAX_FRAMES_PER_PRESENT (MAX_SPEED * 4)  /* Emulated time beyond this is dropped, not caught up */
+#define OVERLAY_SIZE 256
+#define RENDER_TIMEOUT 100      /* Milliseconds without a frame before the renderer counts as idle */
+#define RELOAD_EVENT SDL_USEREVENT
+#define REQUEST_RELOAD 0x1u     /* The ROM changed on disk */
+#define REQUEST_PIN 0x2u
+#define REQUEST_RESTORE 0x4u
+#define REQUEST_UNPIN 0x8u
 
+struct options {
+    const char *rom;
+    const char *shm;
+    const char *aot;
+    bool threaded;
+    const char *trace;              /* Where the trace is dumped */
+    const char *heatmap;            /* Where memory accesses are written as CSV on exit */
+    bool watch;                     /* Reload the ROM whenever it changes */
+    bool watch_keep;                /* Reloads keep the machine running instead of resetting it */
+    uint32_t speed;                 /* Multiplier while fast-forward is held */
+    bool metrics_log;               /* Report on stderr */
+    const char *metrics_file;       /* Append reports as JSON lines */
+    bool netplay;
+    struct chip8_netplay_config netplay_config;
+    struct chip8_shm_region regions[SHM_MAX_REGIONS];
+    uint8_t region_count;
+};
+
+/* Shared by the emulation loop on the main thread and the render thread */
+struct render {
+    SDL_Window *window;
+    const struct options *options;
+    FILE *metrics_file;
+    uint32_t interval;              /* Milliseconds between two presents */
+    struct chip8_frames frames;
+    SDL_sem *ready;                 /* Posted when a frame is published, so the renderer sleeps in between */
+    SDL_atomic_t quit;
+    SDL_atomic_t overlay;
+    SDL_mutex *text_lock;           /* The renderer only tries it, so it never holds up emulation for long */
+    char text[OVERLAY_SIZE];        /* Emulation figures for the overlay */
+};
+
+/* The loaded program and the save point F9 and reloads go back to */
+struct program {
+    uint8_t rom[ROM_SIZE];
+    uint32_t size;
+    struct chip8_state pin;
+    uint8_t pin_rom[ROM_SIZE];      /* Program the save point was taken with */
+    uint32_t pin_size;
+    bool pinned;
+};
+
+/* Turns changes of the ROM file into events, so a paused or waiting loop wakes up for them */
+struct watch {
+    struct chip8_watch *watch;
+    SDL_atomic_t quit;
+};
+
+static void parse_options(int argc, char *argv[], struct options *options);
 static void init_sdl(void);
 static SDL_Window *init_window(void);
 static SDL_Renderer *init_renderer(struct SDL_Window *window);
 
-static uint16_t read_rom(char *file, uint8_t *buffer);
+static uint16_t read_rom(const char *file, uint8_t *buffer);
 static uint16_t *make_keyboard(const uint8_t *keyboard_state);
 static void update_keyboard(uint16_t *keyboard, const uint8_t *keyboard_state);
+static bool handle_events(bool *run, bool *overlay, uint32_t *requests);
+static uint32_t present_interval(SDL_Window *window);
+static int render_main(void *data);
+static int watch_main(void *data);
+static bool handle_requests(struct chip8 *chip8, struct program *program, uint32_t requests,
+                            const struct options *options);
+static void publish(struct render *render, const struct chip8 *chip8);
+static void halt(const struct chip8 *chip8, const char *trace);
+static void write_heatmap(const struct chip8_heatmap *heatmap, const char *file);
+static void report_metrics(struct chip8_metrics *metrics, const char *thread, const struct options *options,
+                           FILE *file, char *overlay, size_t size);
+static uint32_t frames_due(uint32_t *last, uint32_t *owed, uint32_t speed);
+static void wait_for_input(struct chip8 *chip8, bool run, uint32_t speed, uint32_t *last, uint32_t *owed);
 
 int
 main(int argc, char *argv[])
 {
-    if (argc != 2) {
-        puts("Usage: chip8 /path/to/rom");
-        exit(EXIT_FAILURE);
-    }
+    struct options options;
+    parse_options(argc, argv, &options);
 
     init_sdl();
     SDL_Window *window = init_window();
-    SDL_Renderer *renderer = init_renderer(window);
-    SDL_Event event;
 
-    uint8_t rom[ROM_SIZE];
-    int size = read_rom(argv[1], rom);
+    static struct program program;
+    program.size = read_rom(options.rom, program.rom);
 
     const uint8_t *keyboard_state = SDL_GetKeyboardState(NULL);
     uint16_t *keyboard = make_keyboard(keyboard_state);
 
-    struct chip8 *chip8 = chip8_init(renderer, keyboard);
-    chip8_load_program(chip8, rom, size);
+    struct chip8 *chip8 = chip8_init(keyboard);
+    struct chip8_netplay *netplay = NULL;
+    if (options.netplay) {
+        netplay = chip8_netplay_init(chip8, program.rom, program.size, &options.netplay_config);
+        if (netplay == NULL) {
+            puts("Could not set up netplay!");
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        chip8_load_program(chip8, program.rom, program.size);
+    }
+    if (options.shm) {
+        chip8->shm = chip8_shm_create(options.shm, options.regions, options.region_count);
+        if (chip8->shm == NULL) {
+            puts("Could not create shared memory!");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (options.aot) {
+        chip8->engine = chip8_aot_load(options.aot);
+        if (chip8->engine == NULL) {
+            puts("Could not load recompiled module!");
+            exit(EXIT_FAILURE);
+        }
+    } else if (options.threaded) {
+        chip8->engine = chip8_threaded_init();
+    }
+    if (options.trace) {
+        chip8->trace = chip8_trace_init(TRACE_CAPACITY);
+        if (!chip8_trace_arm(chip8->trace, options.trace)) {
+            puts("Could not install the trace handlers!");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (options.heatmap) {
+        chip8->heatmap = chip8_heatmap_init();
+    }
 
-    bool run = true;
-    while (true) {
-        SDL_PollEvent(&event);
-        if (event.type == SDL_QUIT || keyboard_state[SDL_SCANCODE_ESCAPE]) break;
-        if (keyboard_state[SDL_SCANCODE_SPACE]) run = !run;
+    /* A ROM developer's edits reach the running window without restarting the emulator */
+    static struct watch watch;
+    SDL_Thread *watch_thread = NULL;
+    if (options.watch) {
+        watch.watch = chip8_watch_init(options.rom);
+        if (watch.watch == NULL || (watch_thread = SDL_CreateThread(watch_main, "watch", &watch)) == NULL) {
+            puts("Could not watch the ROM!");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    FILE *metrics_file = NULL;
+    if (options.metrics_file && (metrics_file = fopen(options.metrics_file, "a")) == NULL) {
+        puts("Could not open the metrics file!");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Presenting can stall on vsync or the compositor, so it gets a thread of its own */
+    static struct render render;
+    uint32_t interval = present_interval(window);
+    render.window = window;
+    render.options = &options;
+    render.metrics_file = metrics_file;
+    render.interval = netplay ? FRAME_TIME : interval;
+    chip8_frames_init(&render.frames);
+    render.ready = SDL_CreateSemaphore(0);
+    render.text_lock = SDL_CreateMutex();
+    SDL_Thread *render_thread = NULL;
+    if (render.ready == NULL || render.text_lock == NULL ||
+        (render_thread = SDL_CreateThread(render_main, "render", &render)) == NULL) {
+        puts(SDL_GetError());
+        exit(EXIT_FAILURE);
+    }
 
-        if (run) {
+    bool run = true;
+    bool overlay = false;
+    uint32_t requests = 0;
+    uint32_t last = SDL_GetTicks();
+    uint32_t owed = 0;              /* Emulated time not run yet, in ms * FRAMES_PER_SECOND */
+    uint32_t next_report = last + METRICS_INTERVAL;
+    struct chip8_metrics *metrics = chip8_metrics_init(render.interval);
+    while (handle_events(&run, &overlay, &requests)) {
+        if ((int32_t)(SDL_GetTicks() - next_report) >= 0) {
+            SDL_LockMutex(render.text_lock);
+            report_metrics(metrics, "emulation", &options, metrics_file, render.text, sizeof(render.text));
+            SDL_UnlockMutex(render.text_lock);
+            next_report += METRICS_INTERVAL;
+        }
+        SDL_AtomicSet(&render.overlay, overlay);
+        if (requests && !netplay) {
+            /* Reloads and restores clear a fault, and what they bring back is there to be tried */
+            if (handle_requests(chip8, &program, requests, &options)) {
+                run = true;
+            }
+            publish(&render, chip8);
+            last = SDL_GetTicks();
+            owed = 0;
+        }
+        requests = 0;
+        uint16_t previous = *keyboard;
+        if (run || netplay) {
             update_keyboard(keyboard, keyboard_state);
-            chip8_step(chip8);
         }
 
-        SDL_Delay(1000 / FRAMES_PER_SECOND);
+        /* The peer keeps simulating at its own pace, so netplay never pauses, skips or blocks on Fx0A */
+        if (netplay) {
+            chip8_metrics_enter(metrics, METRICS_EMULATE);
+            if (chip8_netplay_advance(netplay, *keyboard)) {
+                chip8_metrics_instructions(metrics, CYCLES_PER_FRAME);
+            }
+            if (chip8->fault) {
+                halt(chip8, options.trace);
+                break;
+            }
+            chip8_metrics_enter(metrics, METRICS_OTHER);
+            publish(&render, chip8);
+            chip8_metrics_frame(metrics);
+            chip8_metrics_enter(metrics, METRICS_SLEEP);
+            SDL_Delay(FRAME_TIME);
+            chip8_metrics_enter(metrics, METRICS_OTHER);
+            continue;
+        }
+
+        uint32_t speed = keyboard_state[SDL_SCANCODE_TAB] ? options.speed : 1;
+        if (!run || (chip8_waiting_for_key(chip8) && *keyboard == previous)) {
+            chip8_metrics_enter(metrics, METRICS_SLEEP);
+            wait_for_input(chip8, run, speed, &last, &owed);
+            chip8_metrics_enter(metrics, METRICS_OTHER);
+            chip8_metrics_idle(metrics);
+            continue;
+        }
+
+        /* Run every frame due since the last pass, then present only the newest one */
+        uint32_t frames = frames_due(&last, &owed, speed);
+
+        if (frames) {
+            chip8_metrics_enter(metrics, METRICS_EMULATE);
+            chip8_advance(chip8, frames);
+            chip8_metrics_instructions(metrics, (uint64_t)frames * CYCLES_PER_FRAME);
+            if (chip8->fault) {
+                halt(chip8, options.trace);
+                if (!options.watch) {
+                    break;
+                }
+                /* Keep the window for the next reload */
+                run = false;
+            }
+            chip8_metrics_enter(metrics, METRICS_OTHER);
+            publish(&render, chip8);
+            chip8_metrics_frame(metrics);
+        }
+        chip8_metrics_enter(metrics, METRICS_SLEEP);
+        SDL_Delay(interval);
+        chip8_metrics_enter(metrics, METRICS_OTHER);
+    }
+
+    SDL_AtomicSet(&render.quit, 1);
+    if (watch_thread) {
+        SDL_AtomicSet(&watch.quit, 1);
+        SDL_WaitThread(watch_thread, NULL);
+        chip8_watch_free(watch.watch);
     }
+    SDL_SemPost(render.ready);
+    SDL_WaitThread(render_thread, NULL);
+    SDL_DestroySemaphore(render.ready);
+    SDL_DestroyMutex(render.text_lock);
 
-    SDL_DestroyRenderer(renderer);
+    chip8_metrics_free(metrics);
+    if (metrics_file) {
+        fclose(metrics_file);
+    }
+
+    if (netplay) {
+        chip8_netplay_free(netplay);
+    }
+    if (chip8->trace) {
+        chip8_trace_free(chip8->trace);
+    }
+    if (chip8->heatmap) {
+        write_heatmap(chip8->heatmap, options.heatmap);
+        chip8_heatmap_free(chip8->heatmap);
+    }
+    if (chip8->shm) {
+        chip8_shm_destroy(chip8->shm);
+    }
+    if (chip8->engine) {
+        chip8->engine->free(chip8->engine);
+    }
     SDL_DestroyWindow(window);
     SDL_Quit();
 
     return 0;
 }
 
+static void
+usage(void)
+{
+    puts("Usage: chip8 [--shm name [--shm-region address:length]...] [--aot module.so | --threaded] [--fast-forward speed] [--trace file]\n"
+         "             [--watch reset|keep] [--heatmap file] [--metrics-log] [--metrics-file file]\n"
+         "             [--netplay player:local_port:host:remote_port] /path/to/rom");
+    exit(EXIT_FAILURE);
+}
+
+/***
+ * player:local_port:host:remote_port, player 1 owns the left half of the keypad and
+ * player 2 the right half
+ */
+static void
+parse_netplay(char *arg, struct chip8_netplay_config *config)
+{
+    char *end;
+    unsigned long player = strtoul(arg, &end, 0);
+    if ((player != 1 && player != 2) || *end != ':') usage();
+    config->local_port = strtoul(end + 1, &end, 0);
+    if (*end != ':') usage();
+    config->remote_host = end + 1;
+    if ((end = strrchr(config->remote_host, ':')) == NULL || end == config->remote_host) usage();
+    *end = '\0';
+    config->remote_port = strtoul(end + 1, &end, 0);
+    if (*end != '\0') usage();
+
+    config->player = player - 1;
+    config->masks[0] = 0x05b7;
+    config->masks[1] = 0xfa48;
+    config->session = NETPLAY_SESSION;
+}
+
+static void
+parse_options(int argc, char *argv[], struct options *options)
+{
+    memset(options, 0, sizeof(*options));
+    options->speed = FAST_FORWARD_SPEED;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--shm") && i + 1 < argc) {
+            options->shm = argv[++i];
+        } else if (!strcmp(argv[i], "--aot") && i + 1 < argc) {
+            options->aot = argv[++i];
+        } else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+            options->trace = argv[++i];
+        } else if (!strcmp(argv[i], "--watch") && i + 1 < argc) {
+            options->watch = true;
+            options->watch_keep = !strcmp(argv[++i], "keep");
+            if (!options->watch_keep && strcmp(argv[i], "reset") != 0) usage();
+        } else if (!strcmp(argv[i], "--heatmap") && i + 1 < argc) {
+            options->heatmap = argv[++i];
+        } else if (!strcmp(argv[i], "--metrics-log")) {
+            options->metrics_log = true;
+        } else if (!strcmp(argv[i], "--metrics-file") && i + 1 < argc) {
+            options->metrics_file = argv[++i];
+        } else if (!strcmp(argv[i], "--threaded")) {
+            options->threaded = true;
+        } else if (!strcmp(argv[i], "--fast-forward") && i + 1 < argc) {
+            char *end;
+            options->speed = strtoul(argv[++i], &end, 0);
+            if (*end != '\0' || options->speed < 1 || options->speed > MAX_SPEED) usage();
+        } else if (!strcmp(argv[i], "--netplay") && i + 1 < argc) {
+            parse_netplay(argv[++i], &options->netplay_config);
+            options->netplay = true;
+        } else if (!strcmp(argv[i], "--shm-region") && i + 1 < argc) {
+            char *end;
+            if (options->region_count == SHM_MAX_REGIONS) usage();
+            struct chip8_shm_region *region = &options->regions[options->region_count++];
+            region->address = strtoul(argv[++i], &end, 0);
+            if (*end != ':') usage();
+            region->length = strtoul(end + 1, &end, 0);
+            if (*end != '\0') usage();
+        } else if (options->rom == NULL && argv[i][0] != '-') {
+            options->rom = argv[i];
+        } else {
+            usage();
+        }
+    }
+    if (options->rom == NULL || (options->aot && options->threaded) || (options->watch && options->netplay)) usage();
+}
+
 static void
 init_sdl(void)
 {
@@ -90,6 +423,280 @@ init_renderer(struct SDL_Window *window)
         SDL_Quit();
         exit(EXIT_FAILURE);
     }
+    return renderer;
+}
+
+/***
+ * Return false once the program should quit
+ */
+static bool
+handle_events(bool *run, bool *overlay, uint32_t *requests)
+{
+    SDL_Event event;
+    while (SDL_PollEvent(&event)) {
+        if (event.type == SDL_QUIT) return false;
+        if (event.type == RELOAD_EVENT) *requests |= REQUEST_RELOAD;
+        if (event.type != SDL_KEYDOWN || event.key.repeat) continue;
+
+        if (event.key.keysym.scancode == SDL_SCANCODE_ESCAPE) return false;
+        if (event.key.keysym.scancode == SDL_SCANCODE_SPACE) *run = !*run;
+        if (event.key.keysym.scancode == SDL_SCANCODE_F3) *overlay = !*overlay;
+        if (event.key.keysym.scancode == SDL_SCANCODE_F5) *requests |= REQUEST_PIN;
+        if (event.key.keysym.scancode == SDL_SCANCODE_F8) *requests |= REQUEST_UNPIN;
+        if (event.key.keysym.scancode == SDL_SCANCODE_F9) *requests |= REQUEST_RESTORE;
+    }
+    return true;
+}
+
+static void
+halt(const struct chip8 *chip8, const char *trace)
+{
+    printf("Halted: %s at 0x%03x\n", chip8_fault_name(chip8->fault), chip8->fault_pc);
+    if (trace && chip8_trace_dump(chip8->trace, trace)) {
+        printf("Last instructions written to %s\n", trace);
+    }
+}
+
+/***
+ * Go back to the save point, with the program loaded now in place of the one it was taken with
+ */
+static void
+restore(struct chip8 *chip8, const struct program *program)
+{
+    chip8_state_load(chip8, &program->pin);
+    chip8_reload_program(chip8, program->pin_rom, program->pin_size, program->rom, program->size);
+}
+
+/***
+ * Read the ROM again after it changed. With a save point pinned the machine goes back to it,
+ * otherwise it starts over or, with --watch keep, continues with the new code in place.
+ */
+static bool
+reload(struct chip8 *chip8, struct program *program, const struct options *options)
+{
+    uint8_t rom[ROM_SIZE];
+    FILE *fp = fopen(options->rom, "rb");
+    if (fp == NULL) {
+        puts("Could not reload the ROM!");
+        return false;
+    }
+    uint32_t size = fread(rom, 1, sizeof(rom), fp);
+    fclose(fp);
+
+    if (options->watch_keep && !program->pinned) {
+        chip8_reload_program(chip8, program->rom, program->size, rom, size);
+    }
+    memcpy(program->rom, rom, size);
+    program->size = size;
+    if (program->pinned) {
+        restore(chip8, program);
+    } else if (!options->watch_keep) {
+        chip8_reset(chip8, time(NULL));
+        chip8_load_program(chip8, program->rom, program->size);
+    }
+    printf("Reloaded %s, %u bytes\n", options->rom, size);
+    return true;
+}
+
+/***
+ * Return true if the machine was reloaded or restored
+ */
+static bool
+handle_requests(struct chip8 *chip8, struct program *program, uint32_t requests, const struct options *options)
+{
+    if (requests & REQUEST_PIN) {
+        chip8_state_save(chip8, &program->pin);
+        memcpy(program->pin_rom, program->rom, program->size);
+        program->pin_size = program->size;
+        program->pinned = true;
+        puts("Save point pinned");
+    }
+    if (requests & REQUEST_UNPIN) {
+        program->pinned = false;
+    }
+    if (requests & REQUEST_RELOAD) {
+        return reload(chip8, program, options);
+    }
+    if ((requests & REQUEST_RESTORE) && program->pinned) {
+        restore(chip8, program);
+        return true;
+    }
+    return false;
+}
+
+static int
+watch_main(void *data)
+{
+    struct watch *watch = data;
+    while (!SDL_AtomicGet(&watch->quit)) {
+        if (chip8_watch_wait(watch->watch, RENDER_TIMEOUT)) {
+            SDL_Event event;
+            memset(&event, 0, sizeof(event));
+            event.type = RELOAD_EVENT;
+            SDL_PushEvent(&event);
+        }
+    }
+    return 0;
+}
+
+static void
+write_heatmap(const struct chip8_heatmap *heatmap, const char *file)
+{
+    FILE *fp = fopen(file, "w");
+    if (fp == NULL || !chip8_heatmap_write_csv(heatmap, fp)) {
+        puts("Could not write the heatmap!");
+    } else {
+        if (heatmap->modified) {
+            printf("Self-modifying code, first write over code by 0x%03x at 0x%03x\n", heatmap->first_writer,
+                   heatmap->first_modified);
+        }
+        if (heatmap->generated) {
+            printf("Generated code, %llu fetches of written bytes\n", (unsigned long long)heatmap->generated);
+        }
+    }
+    if (fp) {
+        fclose(fp);
+    }
+}
+
+/***
+ * Present the newest published frame whenever there is one. The renderer is created here,
+ * since SDL only renders from the thread that created the renderer.
+ */
+static int
+render_main(void *data)
+{
+    struct render *render = data;
+    SDL_Renderer *renderer = init_renderer(render->window);
+    struct chip8_screen *screen = chip8_screen_init(renderer);
+    struct chip8_metrics *metrics = chip8_metrics_init(render->interval);
+    char figures[OVERLAY_SIZE] = "";
+    char overlay[2 * OVERLAY_SIZE] = "";
+    uint32_t next_report = SDL_GetTicks() + METRICS_INTERVAL;
+
+    while (!SDL_AtomicGet(&render->quit)) {
+        chip8_metrics_enter(metrics, METRICS_SLEEP);
+        int waited = SDL_SemWaitTimeout(render->ready, RENDER_TIMEOUT);
+        chip8_metrics_enter(metrics, METRICS_OTHER);
+        if ((int32_t)(SDL_GetTicks() - next_report) >= 0) {
+            report_metrics(metrics, "render", render->options, render->metrics_file, figures, sizeof(figures));
+            next_report += METRICS_INTERVAL;
+        }
+        if (waited == SDL_MUTEX_TIMEDOUT) {
+            chip8_metrics_idle(metrics);
+            continue;
+        }
+
+        const struct chip8_frame *frame = chip8_frames_acquire(&render->frames);
+        if (frame == NULL) {
+            continue;
+        }
+        screen->overlay = NULL;
+        if (SDL_AtomicGet(&render->overlay)) {
+            if (SDL_TryLockMutex(render->text_lock) == 0) {
+                snprintf(overlay, sizeof(overlay), "%s\n%s", render->text, figures);
+                SDL_UnlockMutex(render->text_lock);
+            }
+            screen->overlay = overlay;
+        }
+        chip8_metrics_enter(metrics, METRICS_RENDER);
+        chip8_screen_draw(screen, &frame->display);
+        chip8_metrics_frame(metrics);
+    }
+
+    chip8_metrics_free(metrics);
+    SDL_DestroyRenderer(renderer);
+    return 0;
+}
+
+/***
+ * Hand the display to the renderer, which never makes emulation wait
+ */
+static void
+publish(struct render *render, const struct chip8 *chip8)
+{
+    chip8_frames_publish(&render->frames, chip8->display);
+    if (SDL_SemValue(render->ready) == 0) {
+        SDL_SemPost(render->ready);
+    }
+}
+
+/***
+ * Refresh the overlay text and write the report wherever it was asked for
+ */
+static void
+report_metrics(struct chip8_metrics *metrics, const char *thread, const struct options *options, FILE *file,
+               char *overlay, size_t size)
+{
+    struct chip8_metrics_report report;
+    chip8_metrics_report(metrics, &report);
+    report.thread = thread;
+
+    chip8_metrics_format(&report, "\n", overlay, size);
+    if (options->metrics_log) {
+        char line[256];
+        chip8_metrics_format(&report, " ", line, sizeof(line));
+        fprintf(stderr, "%s\n", line);
+    }
+    if (file && !chip8_metrics_write(&report, file)) {
+        fputs("Could not write metrics!\n", stderr);
+    }
+}
+
+/***
+ * Milliseconds between two presented frames, one per display refresh
+ */
+static uint32_t
+present_interval(SDL_Window *window)
+{
+    SDL_DisplayMode mode;
+    if (SDL_GetWindowDisplayMode(window, &mode) != 0 || mode.refresh_rate <= 0) {
+        return FRAME_TIME;
+    }
+    return mode.refresh_rate < 1000 ? 1000 / mode.refresh_rate : 1;
+}
+
+/***
+ * Frames of emulated time that passed since last at the given speed. The remainder is carried
+ * in owed, so no speed makes frames run short or long.
+ */
+static uint32_t
+frames_due(uint32_t *last, uint32_t *owed, uint32_t speed)
+{
+    uint32_t ticks = SDL_GetTicks();
+    *owed += (ticks - *last) * speed * FRAMES_PER_SECOND;
+    *last = ticks;
+    uint32_t frames = *owed / 1000;
+    if (frames > MAX_FRAMES_PER_PRESENT) {
+        frames = MAX_FRAMES_PER_PRESENT;
+        *owed = 0;
+    } else {
+        *owed -= frames * 1000;
+    }
+    return frames;
+}
+
+/***
+ * Sleep until an event arrives while paused or blocked on Fx0A. Running timers keep ticking
+ * at the emulated speed, on the same clock as running frames.
+ */
+static void
+wait_for_input(struct chip8 *chip8, bool run, uint32_t speed, uint32_t *last, uint32_t *owed)
+{
+    if (!run || !chip8_timers_active(chip8)) {
+        SDL_WaitEvent(NULL);
+        *last = SDL_GetTicks();
+        *owed = 0;
+        return;
+    }
+
+    for (uint32_t frames = frames_due(last, owed, speed); frames; frames--) {
+        chip8_tick(chip8);
+    }
+    if (chip8_timers_active(chip8)) {
+        uint32_t rate = speed * FRAMES_PER_SECOND;
+        SDL_WaitEventTimeout(NULL, (1000 - *owed + rate - 1) / rate);
+    }
 }
 
 static void
@@ -123,7 +730,7 @@ make_keyboard(const uint8_t *keyboard_state)
 }
 
 static uint16_t
-read_rom(char *file, uint8_t *buffer)
+read_rom(const char *file, uint8_t *buffer)
 {
     FILE *fp = fopen(file, "rb");
     if (fp == NULL) {
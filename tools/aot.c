@@ -0,0 +1,574 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/inc/chip8.h"
+#include "../src/inc/chip8_aot.h"
+#include "../src/inc/chip8_memory.h"
+#include "../src/inc/chip8_state.h"
+#include "common.h"
+
+#define VERIFY_FRAMES 3600
+
+enum aot_kind {
+    KIND_NATIVE,                /* Translated, falls through */
+    KIND_FALLBACK,              /* Left to the interpreter, falls through */
+    KIND_WRITE,                 /* Writes memory, ends the block so code is checked again */
+    KIND_JUMP,
+    KIND_CALL,
+    KIND_RETURN,
+    KIND_SKIP,
+    KIND_INDIRECT,              /* Bnnn */
+    KIND_ILLEGAL                /* Left to the interpreter to fault on */
+};
+
+struct aot {
+    uint8_t memory[MEMORY_SIZE];
+    uint16_t end;               /* First address past the ROM */
+    bool code[MEMORY_SIZE];     /* Instruction starts reachable from PROGRAM_START_ADDR */
+    bool leader[MEMORY_SIZE];   /* Instruction starts that begin a block */
+    uint16_t worklist[MEMORY_SIZE];
+    uint16_t pending;
+};
+
+static void
+usage(void)
+{
+    puts("Usage: chip8-aot [-o output.c] /path/to/rom\n"
+         "       chip8-aot -v module.so [-f frames] /path/to/rom");
+    exit(EXIT_FAILURE);
+}
+
+static uint16_t
+aot_fetch(const struct aot *aot, uint16_t pc)
+{
+    return aot->memory[pc] << BYTE | aot->memory[pc + 1];
+}
+
+static bool
+aot_in_rom(const struct aot *aot, uint32_t pc)
+{
+    return pc >= PROGRAM_START_ADDR && pc + 1 < aot->end;
+}
+
+/***
+ * Mirrors the decoding in chip8.c, including what it does with unassigned encodings.
+ */
+static enum aot_kind
+aot_classify(uint16_t instruction)
+{
+    switch (instruction >> 12u) {
+        case 0x0:
+            return instruction == 0x00e0 ? KIND_FALLBACK : KIND_RETURN;
+        case 0x1:
+            return KIND_JUMP;
+        case 0x2:
+            return KIND_CALL;
+        case 0x3:
+        case 0x4:
+        case 0x5:
+        case 0x9:
+        case 0xe:
+            return KIND_SKIP;
+        case 0x8:
+            return (instruction & 0x0fu) <= 0x7 || (instruction & 0x0fu) == 0xe ? KIND_NATIVE : KIND_ILLEGAL;
+        case 0xb:
+            return KIND_INDIRECT;
+        case 0xd:
+            return KIND_FALLBACK;
+        case 0xf:
+            switch (instruction & 0xffu) {
+                case 0x07:
+                case 0x15:
+                case 0x18:
+                case 0x1e:
+                case 0x65:
+                    return KIND_NATIVE;
+                case 0x0a:
+                case 0x29:
+                    return KIND_FALLBACK;
+                case 0x33:
+                case 0x55:
+                    return KIND_WRITE;
+                default:
+                    return KIND_ILLEGAL;
+            }
+        default:
+            return KIND_NATIVE;
+    }
+}
+
+static void
+aot_enqueue(struct aot *aot, uint32_t pc)
+{
+    if (!aot_in_rom(aot, pc)) {
+        return;
+    }
+    aot->leader[pc] = true;
+    if (!aot->code[pc]) {
+        aot->worklist[aot->pending++] = pc;
+    }
+}
+
+/***
+ * Follows every statically known successor from the entry point. Reaching an instruction
+ * that was decoded before makes it a join point.
+ */
+static void
+aot_discover(struct aot *aot)
+{
+    aot_enqueue(aot, PROGRAM_START_ADDR);
+
+    while (aot->pending) {
+        uint16_t pc = aot->worklist[--aot->pending];
+        while (aot_in_rom(aot, pc)) {
+            if (aot->code[pc]) {
+                aot->leader[pc] = true;
+                break;
+            }
+            aot->code[pc] = true;
+
+            uint16_t instruction = aot_fetch(aot, pc);
+            enum aot_kind kind = aot_classify(instruction);
+            if (kind == KIND_NATIVE || kind == KIND_FALLBACK) {
+                pc += 2;
+                continue;
+            }
+            if (kind == KIND_WRITE) {
+                aot_enqueue(aot, pc + 2);
+            } else if (kind == KIND_JUMP) {
+                aot_enqueue(aot, instruction & 0x0fffu);
+            } else if (kind == KIND_CALL) {
+                aot_enqueue(aot, instruction & 0x0fffu);
+                aot_enqueue(aot, pc + 2);
+            } else if (kind == KIND_SKIP) {
+                aot_enqueue(aot, pc + 2);
+                aot_enqueue(aot, pc + 4);
+            }
+            break;
+        }
+    }
+}
+
+static void
+aot_goto(const struct aot *aot, FILE *fp, uint32_t target)
+{
+    target &= 0xffffu;
+    if (aot_in_rom(aot, target) && aot->leader[target]) {
+        fprintf(fp, "goto b_%03x;", target);
+    } else {
+        fprintf(fp, "EXIT(0x%03x);", target);
+    }
+}
+
+static void
+aot_emit_skip(const struct aot *aot, FILE *fp, uint16_t pc, const char *condition)
+{
+    fprintf(fp, "    if (%s) {\n        ", condition);
+    aot_goto(aot, fp, pc + 4);
+    fputs("\n    }\n    ", fp);
+    aot_goto(aot, fp, pc + 2);
+    fputc('\n', fp);
+}
+
+/***
+ * Emit one instruction, return false if it ends the block.
+ */
+static bool
+aot_emit_instruction(const struct aot *aot, FILE *fp, uint16_t pc)
+{
+    uint16_t instruction = aot_fetch(aot, pc);
+    uint8_t x = (instruction >> 8u) & 0x0fu;
+    uint8_t y = (instruction >> 4u) & 0x0fu;
+    uint8_t kk = instruction & 0xffu;
+    uint16_t nnn = instruction & 0x0fffu;
+    char condition[64];
+
+    if (!aot->leader[pc]) {
+        fprintf(fp, "i_%03x:\n", pc);
+    }
+    fprintf(fp, "    STEP(0x%03x);  /* %04x */\n", pc, instruction);
+    switch (aot_classify(instruction)) {
+        case KIND_FALLBACK:
+            fprintf(fp, "    FALLBACK(0x%03x);\n", pc);
+            return true;
+        case KIND_ILLEGAL:
+            fprintf(fp, "    BAIL(0x%03x);\n", pc);
+            return false;
+        case KIND_RETURN:
+            fprintf(fp, "    if (r->SP == 0) BAIL(0x%03x);\n"
+                        "    pc = chip8->stack->stack[--r->SP] + 2;\n"
+                        "    goto dispatch;\n", pc);
+            return false;
+        case KIND_JUMP:
+            fputs("    ", fp);
+            aot_goto(aot, fp, nnn);
+            fputc('\n', fp);
+            return false;
+        case KIND_CALL:
+            fprintf(fp, "    if (r->SP >= STACK_SIZE) BAIL(0x%03x);\n"
+                        "    chip8->stack->stack[r->SP++] = 0x%03x;\n"
+                        "    chip8->effects++;\n    ", pc, pc);
+            aot_goto(aot, fp, nnn);
+            fputc('\n', fp);
+            return false;
+        case KIND_INDIRECT:
+            fprintf(fp, "    pc = V0 + 0x%03x;\n    goto dispatch;\n", nnn);
+            return false;
+        case KIND_SKIP:
+            switch (instruction >> 12u) {
+                case 0x3:
+                    snprintf(condition, sizeof(condition), "V%X == 0x%02x", x, kk);
+                    break;
+                case 0x4:
+                    snprintf(condition, sizeof(condition), "V%X != 0x%02x", x, kk);
+                    break;
+                case 0x5:
+                    snprintf(condition, sizeof(condition), "V%X == V%X", x, y);
+                    break;
+                case 0x9:
+                    snprintf(condition, sizeof(condition), "V%X != V%X", x, y);
+                    break;
+                default:
+                    snprintf(condition, sizeof(condition), "%sKEY(V%X)", kk == 0x9e ? "" : "!", x);
+                    break;
+            }
+            aot_emit_skip(aot, fp, pc, condition);
+            return false;
+        case KIND_WRITE:
+            /* Pages may be shared with forks, writing them takes the interpreter's copy-on-write */
+            fprintf(fp, "    FALLBACK(0x%03x);\n"
+                        "    EXIT(0x%03x);\n", pc, (uint16_t)(pc + 2));
+            return false;
+        case KIND_NATIVE:
+            break;
+    }
+
+    switch (instruction >> 12u) {
+        case 0x6:
+            fprintf(fp, "    V%X = 0x%02x;\n", x, kk);
+            break;
+        case 0x7:
+            fprintf(fp, "    V%X += 0x%02x;\n", x, kk);
+            break;
+        case 0x8:
+            switch (instruction & 0x0fu) {
+                case 0x0:
+                    fprintf(fp, "    V%X = V%X;\n", x, y);
+                    break;
+                case 0x1:
+                    fprintf(fp, "    V%X |= V%X;\n", x, y);
+                    break;
+                case 0x2:
+                    fprintf(fp, "    V%X &= V%X;\n", x, y);
+                    break;
+                case 0x3:
+                    fprintf(fp, "    V%X ^= V%X;\n", x, y);
+                    break;
+                case 0x4:
+                    fprintf(fp, "    t = V%X + V%X;\n    VF = t > 0xff;\n    V%X = t;\n", x, y, x);
+                    break;
+                case 0x5:
+                    fprintf(fp, "    a = V%X;\n    b = V%X;\n    VF = a >= b;\n    V%X = a - b;\n", x, y, x);
+                    break;
+                case 0x6:
+                    fprintf(fp, "    a = V%X;\n    VF = a & 1u;\n    V%X = a >> 1u;\n", x, x);
+                    break;
+                case 0x7:
+                    fprintf(fp, "    a = V%X;\n    b = V%X;\n    VF = b >= a;\n    V%X = b - a;\n", x, y, x);
+                    break;
+                case 0xe:
+                    fprintf(fp, "    a = V%X;\n    VF = a & 0x80u;\n    V%X = a << 1u;\n", x, x);
+                    break;
+            }
+            break;
+        case 0xa:
+            fprintf(fp, "    I = 0x%03x;\n", nnn);
+            break;
+        case 0xc:
+            fprintf(fp, "    V%X = RANDOM() & 0x%02x;\n    chip8->effects++;\n", x, kk);
+            break;
+        case 0xf:
+            switch (kk) {
+                case 0x07:
+                    fprintf(fp, "    V%X = r->DT;\n", x);
+                    break;
+                case 0x15:
+                    fprintf(fp, "    r->DT = V%X;\n", x);
+                    break;
+                case 0x18:
+                    fprintf(fp, "    r->ST = V%X;\n", x);
+                    break;
+                case 0x1e:
+                    fprintf(fp, "    I += V%X;\n", x);
+                    break;
+                case 0x65:
+                    fprintf(fp, "    if (I + %u >= MEMORY_SIZE) BAIL(0x%03x);\n", x, pc);
+                    for (uint8_t i = 0; i <= x; i++) {
+                        fprintf(fp, "    V%X = M(I + %u);\n", i, i);
+                    }
+                    break;
+            }
+            break;
+    }
+    return true;
+}
+
+/***
+ * A block runs from its leader up to the first instruction that does not fall through,
+ * or up to the next leader.
+ */
+static uint16_t
+aot_block_end(const struct aot *aot, uint16_t pc)
+{
+    for (uint16_t at = pc;; at += 2) {
+        enum aot_kind kind = aot_classify(aot_fetch(aot, at));
+        if ((kind != KIND_NATIVE && kind != KIND_FALLBACK) || !aot_in_rom(aot, at + 2) ||
+            !aot->code[at + 2] || aot->leader[at + 2]) {
+            return at + 2;
+        }
+    }
+}
+
+/***
+ * Only 00EE and Bnnn jump through the dispatch switch once running.
+ */
+static bool
+aot_has_dynamic(const struct aot *aot)
+{
+    for (uint16_t pc = PROGRAM_START_ADDR; pc < aot->end; pc++) {
+        enum aot_kind kind = aot->code[pc] ? aot_classify(aot_fetch(aot, pc)) : KIND_NATIVE;
+        if (kind == KIND_RETURN || kind == KIND_INDIRECT) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void
+aot_emit_prologue(FILE *fp, const char *rom)
+{
+    fprintf(fp, "/* Generated by chip8-aot from %s, do not edit */\n\n", rom);
+    fputs("#include \"chip8.h\"\n"
+          "#include \"chip8_aot.h\"\n"
+          "#include \"chip8_keyboard.h\"\n"
+          "#include \"chip8_memory.h\"\n"
+          "#include \"chip8_registers.h\"\n"
+          "#include \"chip8_stack.h\"\n\n", fp);
+
+    fputs("#define M(address) (chip8->memory->pages[(address) / MEMORY_PAGE_SIZE]->bytes[(address) % MEMORY_PAGE_SIZE])\n"
+          "#define KEY(v) ((*chip8->keyboard->keyboard >> ((v) & 0x0fu)) & 1u)\n"
+          "#define SYNC()", fp);
+    for (uint8_t i = 0; i < V_REGISTERS; i++) {
+        fprintf(fp, " r->V[%u] = V%X;", i, i);
+    }
+    fputs(" r->I = I\n#define LOAD()", fp);
+    for (uint8_t i = 0; i < V_REGISTERS; i++) {
+        fprintf(fp, " V%X = r->V[%u];", i, i);
+    }
+    fputs(" I = r->I\n", fp);
+    fputs("/* Count an instruction, or stop in front of it once the budget is spent */\n"
+          "#define STEP(address) if (executed == budget) { pc = (address); goto leave; } executed++\n"
+          "/* Leave an instruction to the interpreter, typically so it can fault */\n"
+          "#define BAIL(address) do { executed--; pc = (address); goto leave; } while (0)\n"
+          "#define EXIT(address) do { pc = (address); goto leave; } while (0)\n"
+          "#define FALLBACK(address) do { SYNC(); r->PC = (address); cycle(chip8); LOAD(); \\\n"
+          "        if (chip8->fault || r->PC != (uint16_t)((address) + 2)) EXIT(r->PC); } while (0)\n"
+          "#define RANDOM() (chip8->random ^= chip8->random << 13u, chip8->random ^= chip8->random >> 17u, \\\n"
+          "        chip8->random ^= chip8->random << 5u, chip8->random >> 24u)\n\n", fp);
+}
+
+static void
+aot_emit(struct aot *aot, FILE *fp, const char *rom)
+{
+    uint16_t starts[MEMORY_SIZE / 2];
+    uint16_t ends[MEMORY_SIZE / 2];
+    uint16_t blocks = 0;
+
+    for (uint16_t pc = PROGRAM_START_ADDR; pc < aot->end; pc++) {
+        if (aot->leader[pc] && aot->code[pc]) {
+            starts[blocks] = pc;
+            ends[blocks++] = aot_block_end(aot, pc);
+        }
+    }
+
+    aot_emit_prologue(fp, rom);
+
+    fputs("static const uint8_t image[MEMORY_SIZE] = {", fp);
+    for (uint16_t pc = PROGRAM_START_ADDR; pc < aot->end; pc++) {
+        if ((pc - PROGRAM_START_ADDR) % 16 == 0) {
+            fprintf(fp, "\n        [0x%03x] = ", pc);
+        }
+        fprintf(fp, "0x%02x,%s", aot->memory[pc], (pc - PROGRAM_START_ADDR) % 16 == 15 ? "" : " ");
+    }
+    fputs("\n};\n\nstatic const struct chip8_aot_block blocks[] = {", fp);
+    for (uint16_t i = 0; i < blocks; i++) {
+        fprintf(fp, "%s{0x%03x, %u},", i % 6 ? " " : "\n        ", starts[i], ends[i] - starts[i]);
+    }
+    if (blocks == 0) {
+        fputs("\n        {0, 0}", fp);
+    }
+    fputs("\n};\n\n", fp);
+
+    fputs("static uint32_t\n"
+          "run(struct chip8 *chip8, const uint8_t *valid, void (*cycle)(struct chip8 *), uint32_t budget)\n"
+          "{\n"
+          "    struct chip8_registers *r = chip8->registers;\n"
+          "    uint8_t", fp);
+    for (uint8_t i = 0; i < V_REGISTERS; i++) {
+        fprintf(fp, " V%X = r->V[%u]%s", i, i, i == V_REGISTERS - 1 ? ";\n" : (i == 7 ? ",\n           " : ","));
+    }
+    fputs("    uint16_t I = r->I;\n"
+          "    uint16_t pc = r->PC;\n"
+          "    uint32_t executed = 0;\n"
+          "    unsigned t;\n"
+          "    uint8_t a, b;\n\n"
+          "    (void)t, (void)a, (void)b;\n", fp);
+    if (aot_has_dynamic(aot)) {
+        fputs("dispatch:\n", fp);
+    }
+    fputs("    switch (pc) {\n", fp);
+    for (uint16_t i = 0; i < blocks; i++) {
+        fprintf(fp, "        case 0x%03x: goto b_%03x;\n", starts[i], starts[i]);
+        for (uint16_t at = starts[i] + 2; at < ends[i]; at += 2) {
+            fprintf(fp, "        case 0x%03x: if (!valid[%u]) goto leave; goto i_%03x;\n", at, i, at);
+        }
+    }
+    fputs("        default: goto leave;\n"
+          "    }\n\n", fp);
+
+    for (uint16_t i = 0; i < blocks; i++) {
+        fprintf(fp, "b_%03x:\n    if (!valid[%u]) EXIT(0x%03x);\n", starts[i], i, starts[i]);
+        bool falls = true;
+        for (uint16_t at = starts[i]; at < ends[i] && falls; at += 2) {
+            falls = aot_emit_instruction(aot, fp, at);
+        }
+        if (falls) {
+            fputs("    ", fp);
+            aot_goto(aot, fp, ends[i]);
+            fputc('\n', fp);
+        }
+        fputc('\n', fp);
+    }
+
+    fputs("leave:\n"
+          "    SYNC();\n"
+          "    r->PC = pc;\n"
+          "    return executed;\n"
+          "}\n\n", fp);
+    fprintf(fp, "const struct chip8_aot_module chip8_aot_module = {\n"
+                "        AOT_ABI, sizeof(struct chip8), %u, blocks, image, run\n"
+                "};\n", blocks);
+}
+
+static int
+translate(const uint8_t *rom, uint32_t size, const char *name, const char *output)
+{
+    static struct aot aot;
+
+    memcpy(&aot.memory[PROGRAM_START_ADDR], rom, size);
+    aot.end = PROGRAM_START_ADDR + size;
+    aot_discover(&aot);
+
+    FILE *fp = output ? fopen(output, "w") : stdout;
+    if (fp == NULL) {
+        perror(output);
+        return EXIT_FAILURE;
+    }
+    aot_emit(&aot, fp, name);
+    if (output) {
+        fclose(fp);
+    }
+    return EXIT_SUCCESS;
+}
+
+/***
+ * Runs the interpreter and the module side by side on scripted input and compares the
+ * complete machine state after every frame.
+ */
+static int
+verify(const uint8_t *rom, uint32_t size, const char *path, uint32_t frames)
+{
+    struct chip8_engine *engine = chip8_aot_load(path);
+    if (engine == NULL) {
+        printf("Cannot load %s\n", path);
+        return EXIT_FAILURE;
+    }
+
+    uint16_t keyboard = 0;
+    struct chip8 *reference = chip8_init(&keyboard);
+    struct chip8 *compiled = chip8_init(&keyboard);
+    chip8_reset(reference, 1);
+    chip8_reset(compiled, 1);
+    chip8_load_program(reference, rom, size);
+    chip8_load_program(compiled, rom, size);
+    compiled->engine = engine;
+
+    double interpreted_time = 0, compiled_time = 0;
+    for (uint32_t frame = 0; frame < frames; frame++) {
+        keyboard = verify_keys(frame);
+        double start = now();
+        chip8_step(reference);
+        double middle = now();
+        chip8_step(compiled);
+        interpreted_time += middle - start;
+        compiled_time += now() - middle;
+
+        if (!chip8_hash_equal(chip8_state_hash(reference), chip8_state_hash(compiled))) {
+            printf("State differs after frame %u: PC %03x vs %03x\n", frame, reference->registers->PC,
+                   compiled->registers->PC);
+            return EXIT_FAILURE;
+        }
+    }
+
+    struct chip8_aot_stats stats;
+    chip8_aot_get_stats(engine, &stats);
+    printf("%u frames match, %.1f%% of instructions compiled, %llu revalidations, "
+           "interpreter %.2f ms, compiled %.2f ms\n", frames,
+           100.0 * stats.compiled / (stats.compiled + stats.interpreted ? stats.compiled + stats.interpreted : 1),
+           (unsigned long long)stats.revalidations, interpreted_time * 1e3, compiled_time * 1e3);
+
+    chip8_free(reference);
+    chip8_free(compiled);
+    engine->free(engine);
+    return EXIT_SUCCESS;
+}
+
+int
+main(int argc, char *argv[])
+{
+    const char *output = NULL;
+    const char *module = NULL;
+    long frames = VERIFY_FRAMES;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:v:f:")) != -1) {
+        switch (opt) {
+            case 'o':
+                output = optarg;
+                break;
+            case 'v':
+                module = optarg;
+                break;
+            case 'f':
+                frames = strtol(optarg, NULL, 0);
+                break;
+            default:
+                usage();
+        }
+    }
+    if (optind != argc - 1 || frames < 1) {
+        usage();
+    }
+
+    static uint8_t rom[ROM_SIZE];
+    uint32_t size = read_rom(argv[optind], rom);
+
+    if (module) {
+        return verify(rom, size, module, frames);
+    }
+    return translate(rom, size, argv[optind], output);
+}
@@ -0,0 +1,48 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include "common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+uint32_t
+read_rom(const char *file, uint8_t *buffer)
+{
+    FILE *fp = fopen(file, "rb");
+    if (fp == NULL) {
+        puts("File does not exist!");
+        exit(EXIT_FAILURE);
+    }
+    uint32_t size = fread(buffer, 1, ROM_SIZE, fp);
+    fclose(fp);
+    return size;
+}
+
+double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+uint64_t
+now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+uint16_t
+bench_keys(uint32_t frame)
+{
+    return (frame / 23) % 3 == 0 ? (uint16_t)(1u << ((frame / 7) % 16)) : 0;
+}
+
+uint16_t
+verify_keys(uint32_t frame)
+{
+    return (frame / 37) % 5 == 0 ? (uint16_t)(1u << ((frame / 11) % 16)) : 0;
+}
@@ -0,0 +1,42 @@
+#ifndef CHIP8_COMMON_H
+#define CHIP8_COMMON_H
+
+#include <stdint.h>
+
+#include "../src/inc/chip8_memory.h"
+
+#define ROM_SIZE (MEMORY_SIZE - PROGRAM_START_ADDR)     /* Largest program chip8_load_program() takes */
+
+/*
+ * Helpers shared by the benchmarks and the tools.
+ */
+
+/**
+ * Read a ROM, exiting if the file does not exist.
+ * @param buffer - at least ROM_SIZE bytes
+ * @return bytes read
+ */
+uint32_t read_rom(const char *file, uint8_t *buffer);
+
+/**
+ * @return monotonic clock in seconds
+ */
+double now(void);
+
+/**
+ * @return monotonic clock in nanoseconds
+ */
+uint64_t now_ns(void);
+
+/**
+ * Keypad mask the benchmarks hold on a frame, a key pressed now and then
+ */
+uint16_t bench_keys(uint32_t frame);
+
+/**
+ * Keypad mask chip8-verify, chip8-aot -v and chip8-heatmap hold on a frame, so they all look
+ * at the same run
+ */
+uint16_t verify_keys(uint32_t frame);
+
+#endif //CHIP8_COMMON_H
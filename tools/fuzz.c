@@ -0,0 +1,433 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/inc/chip8.h"
+#include "../src/inc/chip8_memory.h"
+#include "../src/inc/chip8_registers.h"
+#include "../src/inc/chip8_state.h"
+#include "common.h"
+
+#define MAP_SIZE 65536
+#define SEEN_SIZE (1u << 20u)               /* State hashes remembered */
+#define SEEN_PROBES 32
+#define CORPUS_MAX 4096
+#define TRACE_MAX_FRAMES 7200               /* Two minutes of input */
+#define CONTINUATION_MAX 120
+#define FAULTS (FAULT_ILLEGAL_INSTRUCTION + 1)
+#define CRASH_SITES (UINT16_MAX + 1)       /* Every fault_pc, Bnnn jumps up to 0x10fe */
+#define TRACE_VERSION 1
+
+struct fuzz_entry {
+    uint32_t seed;
+    uint32_t frames;
+    uint16_t *keys;                         /* Keypad mask of every frame */
+    struct chip8_state state;               /* After the last frame */
+};
+
+struct fuzz {
+    const uint8_t *rom;
+    uint32_t size;
+    const char *output;
+    uint8_t coverage[MAP_SIZE];             /* Edges taken, prev PC x PC */
+    uint64_t *seen;                         /* Open addressing set of state hashes, 0 is empty */
+    uint8_t crashes[FAULTS][CRASH_SITES];   /* Crash sites already reported */
+
+    pthread_mutex_t lock;                   /* Guards the corpus */
+    struct fuzz_entry *corpus[CORPUS_MAX];
+    uint32_t corpus_count;
+
+    uint64_t runs;
+    uint64_t frames;
+    uint32_t edges;
+    uint32_t states;
+    uint32_t crash_count;
+    bool stop;
+};
+
+struct fuzz_worker {
+    struct fuzz *fuzz;
+    pthread_t thread;
+    uint64_t random;
+    struct chip8 *chip8;
+    uint16_t keyboard;
+    uint32_t seed;
+    uint32_t frames;
+    uint16_t keys[TRACE_MAX_FRAMES];
+    struct chip8_state state;
+};
+
+static void
+usage(void)
+{
+    puts("Usage: chip8-fuzz [-j threads] [-t seconds] [-o directory] /path/to/rom\n"
+         "       chip8-fuzz -r trace /path/to/rom");
+    exit(EXIT_FAILURE);
+}
+
+/***
+ * xorshift64*
+ */
+static uint32_t
+fuzz_random(struct fuzz_worker *worker)
+{
+    worker->random ^= worker->random >> 12u;
+    worker->random ^= worker->random << 25u;
+    worker->random ^= worker->random >> 27u;
+    return (worker->random * 0x2545f4914f6cdd1du) >> 32u;
+}
+
+/***
+ * Return false if the state was explored before. Once a neighbourhood is full the
+ * oldest-probed slot is overwritten, so the set keeps the recent states.
+ */
+static bool
+fuzz_seen_insert(struct fuzz *fuzz, struct chip8_hash hash)
+{
+    uint64_t key = hash.low | 1u;
+    uint32_t home = hash.high & (SEEN_SIZE - 1);
+    uint32_t slot = home;
+
+    for (int probe = 0; probe < SEEN_PROBES; probe++) {
+        uint64_t current = __atomic_load_n(&fuzz->seen[slot], __ATOMIC_RELAXED);
+        if (current == 0 &&
+            __atomic_compare_exchange_n(&fuzz->seen[slot], &current, key, false, __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED)) {
+            __atomic_fetch_add(&fuzz->states, 1, __ATOMIC_RELAXED);
+            return true;
+        }
+        if (current == key) {
+            return false;
+        }
+        slot = (slot + 1) & (SEEN_SIZE - 1);
+    }
+    __atomic_store_n(&fuzz->seen[home], key, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&fuzz->states, 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+static void
+fuzz_write_trace(FILE *fp, uint32_t seed, const uint16_t *keys, uint32_t frames, const struct chip8 *chip8)
+{
+    fprintf(fp, "chip8-fuzz %d\nseed %08x\nframes %u\nfault %u %03x\n", TRACE_VERSION, seed, frames,
+            chip8->fault, chip8->fault_pc);
+    for (uint32_t i = 0; i < frames; i++) {
+        fprintf(fp, "%04x\n", keys[i]);
+    }
+}
+
+static void
+fuzz_report_crash(struct fuzz_worker *worker)
+{
+    struct fuzz *fuzz = worker->fuzz;
+    const struct chip8 *chip8 = worker->chip8;
+
+    if (__atomic_exchange_n(&fuzz->crashes[chip8->fault][chip8->fault_pc], 1, __ATOMIC_RELAXED)) {
+        return;
+    }
+    __atomic_fetch_add(&fuzz->crash_count, 1, __ATOMIC_RELAXED);
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/crash-%u-%03x.trace", fuzz->output, chip8->fault, chip8->fault_pc);
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "Could not write %s\n", path);
+        return;
+    }
+    fuzz_write_trace(fp, worker->seed, worker->keys, worker->frames, chip8);
+    fclose(fp);
+    fprintf(stderr, "crash: %s at 0x%03x after %u frames -> %s\n", chip8_fault_name(chip8->fault),
+            chip8->fault_pc, worker->frames, path);
+}
+
+static void
+fuzz_add_entry(struct fuzz_worker *worker)
+{
+    struct fuzz *fuzz = worker->fuzz;
+    struct fuzz_entry *entry = malloc(sizeof(*entry));
+    if (entry == NULL || (entry->keys = malloc(worker->frames * sizeof(*entry->keys))) == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+    entry->seed = worker->seed;
+    entry->frames = worker->frames;
+    memcpy(entry->keys, worker->keys, worker->frames * sizeof(*entry->keys));
+    chip8_state_save(worker->chip8, &entry->state);
+
+    pthread_mutex_lock(&fuzz->lock);
+    if (fuzz->corpus_count < CORPUS_MAX) {
+        fuzz->corpus[fuzz->corpus_count++] = entry;
+        entry = NULL;
+    } else {
+        uint32_t victim = fuzz_random(worker) % CORPUS_MAX;
+        struct fuzz_entry *old = fuzz->corpus[victim];
+        fuzz->corpus[victim] = entry;
+        entry = old;
+    }
+    pthread_mutex_unlock(&fuzz->lock);
+
+    if (entry) {
+        free(entry->keys);
+        free(entry);
+    }
+}
+
+/***
+ * Start from a fresh seed now and then, otherwise continue a corpus entry.
+ */
+static void
+fuzz_pick_start(struct fuzz_worker *worker)
+{
+    struct fuzz *fuzz = worker->fuzz;
+    bool root = true;
+
+    if (fuzz_random(worker) % 16) {
+        pthread_mutex_lock(&fuzz->lock);
+        if (fuzz->corpus_count) {
+            const struct fuzz_entry *entry = fuzz->corpus[fuzz_random(worker) % fuzz->corpus_count];
+            worker->seed = entry->seed;
+            worker->frames = entry->frames;
+            memcpy(worker->keys, entry->keys, entry->frames * sizeof(*entry->keys));
+            worker->state = entry->state;
+            root = false;
+        }
+        pthread_mutex_unlock(&fuzz->lock);
+    }
+
+    if (root) {
+        worker->seed = fuzz_random(worker);
+        worker->frames = 0;
+        chip8_reset(worker->chip8, worker->seed);
+        chip8_load_program(worker->chip8, fuzz->rom, fuzz->size);
+    } else {
+        chip8_state_load(worker->chip8, &worker->state);
+    }
+}
+
+/***
+ * Runs of no key, a single key, a random chord or the previous mask.
+ */
+static uint16_t
+fuzz_mutate_keys(struct fuzz_worker *worker, uint16_t previous)
+{
+    switch (fuzz_random(worker) % 4) {
+        case 0:
+            return 0;
+        case 1:
+            return 1u << (fuzz_random(worker) % 16);
+        case 2:
+            return fuzz_random(worker) & fuzz_random(worker);
+        default:
+            return previous;
+    }
+}
+
+/***
+ * One frame instruction by instruction, recording edges.
+ * @return true if a new edge was taken
+ */
+static bool
+fuzz_run_frame(struct fuzz_worker *worker)
+{
+    struct fuzz *fuzz = worker->fuzz;
+    struct chip8 *chip8 = worker->chip8;
+    bool discovered = false;
+
+    for (uint8_t cycle = 0; cycle < CYCLES_PER_FRAME && !chip8->fault; cycle++) {
+        uint16_t from = chip8_registers_get_PC(chip8->registers);
+        chip8_cycle(chip8);
+        uint16_t edge = (uint16_t)(from << 4u) ^ chip8_registers_get_PC(chip8->registers);
+
+        if (!fuzz->coverage[edge] && !__atomic_exchange_n(&fuzz->coverage[edge], 1, __ATOMIC_RELAXED)) {
+            __atomic_fetch_add(&fuzz->edges, 1, __ATOMIC_RELAXED);
+            discovered = true;
+        }
+    }
+    chip8_tick(chip8);
+    return discovered;
+}
+
+static void
+fuzz_run(struct fuzz_worker *worker)
+{
+    struct fuzz *fuzz = worker->fuzz;
+    bool discovered = false;
+
+    fuzz_pick_start(worker);
+
+    uint32_t begin = worker->frames;
+    uint32_t length = 1 + fuzz_random(worker) % CONTINUATION_MAX;
+    uint32_t end = worker->frames + length < TRACE_MAX_FRAMES ? worker->frames + length : TRACE_MAX_FRAMES;
+    uint16_t keys = worker->frames ? worker->keys[worker->frames - 1] : 0;
+    uint32_t hold = 0;
+
+    while (worker->frames < end) {
+        if (hold == 0) {
+            keys = fuzz_mutate_keys(worker, keys);
+            hold = 1 + fuzz_random(worker) % 30;
+        }
+        hold--;
+        worker->keyboard = keys;
+        worker->keys[worker->frames++] = keys;
+
+        discovered |= fuzz_run_frame(worker);
+        if (worker->chip8->fault) {
+            fuzz_report_crash(worker);
+            break;
+        }
+        if (!fuzz_seen_insert(fuzz, chip8_state_hash(worker->chip8))) {
+            break;
+        }
+    }
+
+    __atomic_fetch_add(&fuzz->runs, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&fuzz->frames, worker->frames - begin, __ATOMIC_RELAXED);
+    if (discovered && !worker->chip8->fault) {
+        fuzz_add_entry(worker);
+    }
+}
+
+static void *
+fuzz_worker_main(void *arg)
+{
+    struct fuzz_worker *worker = arg;
+    while (!__atomic_load_n(&worker->fuzz->stop, __ATOMIC_RELAXED)) {
+        fuzz_run(worker);
+    }
+    return NULL;
+}
+
+static int
+fuzz(const uint8_t *rom, uint32_t size, const char *output, long threads, long seconds)
+{
+    struct fuzz *fuzz = calloc(1, sizeof(*fuzz));
+    struct fuzz_worker *workers = calloc(threads, sizeof(*workers));
+    if (fuzz == NULL || workers == NULL || (fuzz->seen = calloc(SEEN_SIZE, sizeof(*fuzz->seen))) == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+    fuzz->rom = rom;
+    fuzz->size = size;
+    fuzz->output = output;
+    pthread_mutex_init(&fuzz->lock, NULL);
+
+    for (long i = 0; i < threads; i++) {
+        workers[i].fuzz = fuzz;
+        workers[i].random = (uint64_t)time(NULL) * 0x9e3779b97f4a7c15u + i + 1;
+        workers[i].chip8 = chip8_init(&workers[i].keyboard);
+        if (pthread_create(&workers[i].thread, NULL, fuzz_worker_main, &workers[i])) {
+            puts("Error creating thread!");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    double start = now();
+    for (long second = 1; seconds == 0 || second <= seconds; second++) {
+        sleep(1);
+        double elapsed = now() - start;
+        fprintf(stderr, "%5.0fs runs %8.0f/s frames %9.0f/s edges %5u corpus %4u states %8u crashes %u\n",
+                elapsed, __atomic_load_n(&fuzz->runs, __ATOMIC_RELAXED) / elapsed,
+                __atomic_load_n(&fuzz->frames, __ATOMIC_RELAXED) / elapsed,
+                __atomic_load_n(&fuzz->edges, __ATOMIC_RELAXED), fuzz->corpus_count,
+                __atomic_load_n(&fuzz->states, __ATOMIC_RELAXED),
+                __atomic_load_n(&fuzz->crash_count, __ATOMIC_RELAXED));
+    }
+
+    __atomic_store_n(&fuzz->stop, true, __ATOMIC_RELAXED);
+    for (long i = 0; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        chip8_free(workers[i].chip8);
+    }
+    return fuzz->crash_count ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/***
+ * Run a crash trace through the regular chip8_step() path.
+ */
+static int
+replay(const uint8_t *rom, uint32_t size, const char *file)
+{
+    FILE *fp = fopen(file, "r");
+    if (fp == NULL) {
+        puts("File does not exist!");
+        exit(EXIT_FAILURE);
+    }
+
+    int version;
+    uint32_t seed, frames, fault, fault_pc;
+    if (fscanf(fp, "chip8-fuzz %d seed %x frames %u fault %u %x", &version, &seed, &frames, &fault,
+               &fault_pc) != 5 || version != TRACE_VERSION) {
+        puts("Not a chip8-fuzz trace!");
+        exit(EXIT_FAILURE);
+    }
+
+    uint16_t keyboard = 0;
+    struct chip8 *chip8 = chip8_init(&keyboard);
+    chip8_reset(chip8, seed);
+    chip8_load_program(chip8, rom, size);
+
+    for (uint32_t frame = 0; frame < frames; frame++) {
+        unsigned int keys;
+        if (fscanf(fp, "%x", &keys) != 1) {
+            puts("Truncated trace!");
+            exit(EXIT_FAILURE);
+        }
+        keyboard = keys;
+        chip8_step(chip8);
+        if (chip8->fault) {
+            printf("%s at 0x%03x in frame %u\n", chip8_fault_name(chip8->fault), chip8->fault_pc, frame);
+            break;
+        }
+    }
+    fclose(fp);
+
+    bool reproduced = chip8->fault == fault && chip8->fault_pc == fault_pc;
+    printf("%s\n", reproduced ? "reproduced" : "not reproduced");
+    chip8_free(chip8);
+    return reproduced ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int
+main(int argc, char *argv[])
+{
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    long seconds = 60;
+    const char *output = ".";
+    const char *trace = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "j:t:o:r:")) != -1) {
+        switch (opt) {
+            case 'j':
+                threads = strtol(optarg, NULL, 0);
+                break;
+            case 't':
+                seconds = strtol(optarg, NULL, 0);
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            case 'r':
+                trace = optarg;
+                break;
+            default:
+                usage();
+        }
+    }
+    if (optind != argc - 1 || threads < 1 || seconds < 0) {
+        usage();
+    }
+
+    static uint8_t rom[ROM_SIZE];
+    uint32_t size = read_rom(argv[optind], rom);
+
+    if (trace) {
+        return replay(rom, size, trace);
+    }
+    return fuzz(rom, size, output, threads, seconds);
+}
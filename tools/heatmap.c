@@ -0,0 +1,140 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/inc/chip8.h"
+#include "../src/inc/chip8_heatmap.h"
+#include "../src/inc/chip8_memory.h"
+#include "common.h"
+
+#define HEATMAP_FRAMES 3600
+#define HEATMAP_SEED 1
+
+static void
+usage(void)
+{
+    puts("Usage: chip8-heatmap [-f frames] [-o directory] /path/to/rom...");
+    exit(EXIT_FAILURE);
+}
+
+/***
+ * Write the CSV and one PGM per access kind as directory/name.csv and directory/name-kind.pgm,
+ * name being the ROM file name without its extension.
+ */
+static bool
+write_files(const struct chip8_heatmap *heatmap, const char *directory, const char *rom)
+{
+    char base[256];
+    char path[512];
+    char *copy = strdup(rom);
+    if (copy == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+    snprintf(base, sizeof(base), "%s", basename(copy));
+    free(copy);
+    char *extension = strrchr(base, '.');
+    if (extension && extension != base) {
+        *extension = '\0';
+    }
+
+    for (int access = -1; access < HEATMAP_ACCESSES; access++) {
+        if (access < 0) {
+            snprintf(path, sizeof(path), "%s/%s.csv", directory, base);
+        } else {
+            snprintf(path, sizeof(path), "%s/%s-%s.pgm", directory, base, chip8_heatmap_access_name(access));
+        }
+        FILE *fp = fopen(path, access < 0 ? "w" : "wb");
+        if (fp == NULL) {
+            perror(path);
+            return false;
+        }
+        bool ok = access < 0 ? chip8_heatmap_write_csv(heatmap, fp) : chip8_heatmap_write_pgm(heatmap, access, fp);
+        if (fclose(fp) != 0 || !ok) {
+            perror(path);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void
+report(const struct chip8_heatmap *heatmap, const char *rom, uint32_t frames, const struct chip8 *chip8)
+{
+    uint32_t touched[HEATMAP_ACCESSES] = {0};
+    uint32_t modified = 0;
+    uint32_t generated = 0;
+    for (uint16_t address = 0; address < MEMORY_SIZE; address++) {
+        for (int access = 0; access < HEATMAP_ACCESSES; access++) {
+            touched[access] += heatmap->counts[access][address] != 0;
+        }
+        modified += (heatmap->flags[address] & HEATMAP_MODIFIED) != 0;
+        generated += (heatmap->flags[address] & HEATMAP_GENERATED) != 0;
+    }
+
+    printf("%s: %u frames%s\n", rom, frames, chip8->fault ? ", faulted" : "");
+    printf("  bytes executed %u, drawn %u, read %u, written %u\n", touched[HEATMAP_EXECUTE],
+           touched[HEATMAP_SPRITE], touched[HEATMAP_READ], touched[HEATMAP_WRITE]);
+    if (heatmap->modified == 0 && heatmap->generated == 0) {
+        puts("  no self-modifying code");
+        return;
+    }
+    printf("  SELF-MODIFYING: %llu writes over %u executed bytes, %llu fetches of %u written bytes\n",
+           (unsigned long long)heatmap->modified, modified, (unsigned long long)heatmap->generated, generated);
+    if (heatmap->modified) {
+        printf("  first write over code by 0x%03x at 0x%03x\n", heatmap->first_writer, heatmap->first_modified);
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    const char *directory = NULL;
+    long frames = HEATMAP_FRAMES;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:o:")) != -1) {
+        switch (opt) {
+            case 'f':
+                frames = strtol(optarg, NULL, 0);
+                break;
+            case 'o':
+                directory = optarg;
+                break;
+            default:
+                usage();
+        }
+    }
+    if (optind == argc || frames < 1) {
+        usage();
+    }
+
+    bool ok = true;
+    for (int i = optind; i < argc; i++) {
+        uint8_t rom[ROM_SIZE];
+        uint32_t size = read_rom(argv[i], rom);
+        uint16_t keyboard = 0;
+        struct chip8 *chip8 = chip8_init(&keyboard);
+        chip8->heatmap = chip8_heatmap_init();
+        chip8_reset(chip8, HEATMAP_SEED);
+        chip8_load_program(chip8, rom, size);
+
+        uint32_t frame;
+        for (frame = 0; frame < frames && !chip8->fault; frame++) {
+            keyboard = verify_keys(frame);
+            chip8_step(chip8);
+        }
+        report(chip8->heatmap, argv[i], frame, chip8);
+        if (directory) {
+            ok = write_files(chip8->heatmap, directory, argv[i]) && ok;
+        }
+
+        chip8_heatmap_free(chip8->heatmap);
+        chip8_free(chip8);
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,220 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../src/inc/chip8_server.h"
+#include "common.h"
+
+#define SOCKET_PATH "/tmp/chip8.sock"
+#define EVENTS 256
+#define LATENESS_BUCKETS 512
+#define LATENESS_BUCKET_US 250
+#define LATENESS_OFFSET_US 20000    /* Early frames go below the offset */
+#define KEY_INTERVAL 30             /* Frames between two keypad changes */
+
+struct load_client {
+    int fd;
+    uint32_t received;              /* Bytes of the frame message being read */
+    uint32_t frames;
+    struct chip8_server_frame frame;
+};
+
+/* Figures for one step of the ramp */
+struct load_step {
+    uint64_t frames;
+    uint64_t late;
+    uint64_t skipped;
+    uint32_t histogram[LATENESS_BUCKETS];
+};
+
+static void
+usage(void)
+{
+    puts("Usage: chip8-load [-s socket] [-n first sessions] [-i increment] [-m max sessions]\n"
+         "                  [-t seconds per step] [-p tolerated missed percent]");
+    exit(EXIT_FAILURE);
+}
+
+/***
+ * Connect and read the hello while blocking, then hand the socket to epoll.
+ */
+static bool
+load_connect(const char *path, int epoll, struct load_client *client, struct chip8_server_hello *hello)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        recv(fd, hello, sizeof(*hello), MSG_WAITALL) != sizeof(*hello) || hello->magic != SERVER_MAGIC ||
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    memset(client, 0, sizeof(*client));
+    client->fd = fd;
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = client};
+    return epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+static void
+load_frame(struct load_client *client, struct load_step *step)
+{
+    const struct chip8_server_frame *frame = &client->frame;
+    int64_t bucket = ((int64_t)frame->lateness + LATENESS_OFFSET_US) / LATENESS_BUCKET_US;
+
+    step->frames++;
+    step->late += frame->lateness > 0;
+    step->skipped += frame->skipped;
+    step->histogram[bucket < 0 ? 0 : bucket >= LATENESS_BUCKETS ? LATENESS_BUCKETS - 1 : bucket]++;
+
+    /* Walk the keypad like a player would, the server only sees state changes */
+    if (++client->frames % KEY_INTERVAL == 0) {
+        uint32_t turn = client->frames / KEY_INTERVAL;
+        uint16_t keys = turn % 3 ? (uint16_t)(1u << (turn % 16)) : 0;
+        send(client->fd, &keys, sizeof(keys), MSG_DONTWAIT | MSG_NOSIGNAL);
+    }
+}
+
+/***
+ * Return false once the server closed the connection
+ */
+static bool
+load_receive(struct load_client *client, struct load_step *step)
+{
+    while (true) {
+        ssize_t received = recv(client->fd, (uint8_t *)&client->frame + client->received,
+                                sizeof(client->frame) - client->received, 0);
+        if (received <= 0) {
+            return received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+        }
+        client->received += received;
+        if (client->received == sizeof(client->frame)) {
+            load_frame(client, step);
+            client->received = 0;
+        }
+    }
+}
+
+static double
+load_percentile(const struct load_step *step, double fraction)
+{
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < LATENESS_BUCKETS; bucket++) {
+        seen += step->histogram[bucket];
+        if (seen >= fraction * step->frames) {
+            return ((bucket + 1) * LATENESS_BUCKET_US - LATENESS_OFFSET_US) / 1e3;
+        }
+    }
+    return (LATENESS_BUCKETS * LATENESS_BUCKET_US - LATENESS_OFFSET_US) / 1e3;
+}
+
+int
+main(int argc, char *argv[])
+{
+    const char *path = SOCKET_PATH;
+    long first = 50, increment = 50, max = 4096;
+    double seconds = 3, tolerated = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:n:i:m:t:p:")) != -1) {
+        switch (opt) {
+            case 's':
+                path = optarg;
+                break;
+            case 'n':
+                first = strtol(optarg, NULL, 0);
+                break;
+            case 'i':
+                increment = strtol(optarg, NULL, 0);
+                break;
+            case 'm':
+                max = strtol(optarg, NULL, 0);
+                break;
+            case 't':
+                seconds = strtod(optarg, NULL);
+                break;
+            case 'p':
+                tolerated = strtod(optarg, NULL);
+                break;
+            default:
+                usage();
+        }
+    }
+    if (optind != argc || first < 1 || increment < 0 || max < first || seconds <= 0) {
+        usage();
+    }
+
+    struct load_client *clients = calloc(max, sizeof(*clients));
+    int epoll = epoll_create1(0);
+    if (clients == NULL || epoll < 0) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+
+    struct chip8_server_hello hello = {0};
+    long connected = 0, sustained = 0;
+    static struct load_step step;
+    for (long target = first; target <= max; target += increment ? increment : max) {
+        while (connected < target) {
+            if (!load_connect(path, epoll, &clients[connected], &hello)) {
+                printf("Cannot connect to %s\n", path);
+                return EXIT_FAILURE;
+            }
+            connected++;
+        }
+
+        /* New sessions start with their first deadline, the previous step's backlog is not counted */
+        memset(&step, 0, sizeof(step));
+        double start = now(), elapsed;
+        while ((elapsed = now() - start) < seconds) {
+            struct epoll_event events[EVENTS];
+            int count = epoll_wait(epoll, events, EVENTS, 100);
+            for (int i = 0; i < count; i++) {
+                if (!load_receive(events[i].data.ptr, &step)) {
+                    printf("Server closed a session\n");
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+
+        double expected = connected * (double)hello.fps * elapsed;
+        double missed = step.frames ? 100.0 * step.late / step.frames : 100.0;
+        printf("sessions %5ld  frames/s %8.0f of %8.0f  missed %6.2f%%  skipped %6llu  lateness p50 %6.2f p99 %6.2f ms\n",
+               connected, step.frames / elapsed, expected / elapsed, missed, (unsigned long long)step.skipped,
+               load_percentile(&step, 0.50), load_percentile(&step, 0.99));
+        fflush(stdout);
+        if (missed > tolerated || step.frames + step.skipped < 0.95 * expected) {
+            break;
+        }
+        sustained = connected;
+        if (increment == 0) {
+            break;
+        }
+    }
+
+    if (sustained) {
+        printf("%ld sessions sustained on %u workers, %.0f per worker\n", sustained, hello.workers,
+               (double)sustained / hello.workers);
+    } else {
+        printf("Deadlines slip already at %ld sessions\n", first);
+    }
+    for (long i = 0; i < connected; i++) {
+        close(clients[i].fd);
+    }
+    close(epoll);
+    free(clients);
+    return sustained ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,213 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/inc/chip8.h"
+#include "../src/inc/chip8_memory.h"
+#include "../src/inc/chip8_netplay.h"
+#include "../src/inc/chip8_state.h"
+#include "common.h"
+
+#define SESSION 0x5eed1234u
+#define SETTLE_TIMEOUT 10.0         /* Seconds to wait for the last input to arrive */
+
+/* Pong: 1 and 4 move the left paddle, C and D the right one */
+static const uint16_t masks[NETPLAY_PLAYERS] = {0x0012, 0x3000};
+
+struct harness {
+    const uint8_t *rom;
+    uint32_t size;
+    uint32_t frames;
+    uint32_t fps;
+    uint16_t port;
+    uint32_t latency;
+    float loss;
+};
+
+static void
+usage(void)
+{
+    puts("Usage: chip8-netplay-loopback [-l latency ms] [-p loss] [-f frames] [-r fps] [-P port] /path/to/rom");
+    exit(EXIT_FAILURE);
+}
+
+static void
+sleep_until(double deadline)
+{
+    double remaining = deadline - now();
+    if (remaining > 0) {
+        struct timespec ts = {(time_t)remaining, (long)((remaining - (time_t)remaining) * 1e9)};
+        nanosleep(&ts, NULL);
+    }
+}
+
+/***
+ * Each player holds a random subset of their keys for a few frames at a time, changing
+ * often enough to make the peer mispredict.
+ */
+static uint16_t
+script(uint8_t player, uint32_t frame)
+{
+    uint32_t x = (frame / (5 + 4 * player) + 1) * 0x9e3779b9u ^ (player + 1) * 0x85ebca6bu;
+    x ^= x >> 15u;
+    x *= 0x2c1b3c6du;
+    x ^= x >> 12u;
+    return (uint16_t)x & masks[player];
+}
+
+static int
+peer(const struct harness *harness, uint8_t player, int output)
+{
+    uint16_t keyboard = 0;
+    struct chip8 *chip8 = chip8_init(&keyboard);
+    struct chip8_netplay_config config = {
+        .player = player,
+        .masks = {masks[0], masks[1]},
+        .session = SESSION,
+        .local_port = harness->port + player,
+        .remote_host = "127.0.0.1",
+        .remote_port = harness->port + !player,
+        .latency = harness->latency,
+        .loss = harness->loss,
+    };
+    struct chip8_netplay *netplay = chip8_netplay_init(chip8, harness->rom, harness->size, &config);
+    if (netplay == NULL) {
+        printf("Player %u cannot open port %u\n", player + 1, config.local_port);
+        return EXIT_FAILURE;
+    }
+
+    double period = 1.0 / harness->fps;
+    double next = now();
+    double timeout = next + 2.0 * harness->frames / harness->fps + SETTLE_TIMEOUT;
+    while (chip8_netplay_frame(netplay) < harness->frames && now() < timeout) {
+        chip8_netplay_advance(netplay, script(player, chip8_netplay_frame(netplay)));
+        next += period;
+        sleep_until(next);
+    }
+
+    double deadline = now() + SETTLE_TIMEOUT;
+    while (chip8_netplay_frame(netplay) == harness->frames && !chip8_netplay_settled(netplay) &&
+           now() < deadline) {
+        chip8_netplay_poll(netplay);
+        sleep_until(now() + 0.001);
+    }
+    bool settled = chip8_netplay_frame(netplay) == harness->frames && chip8_netplay_settled(netplay);
+    /* Keep acknowledging until the peer has settled too */
+    for (double linger = now() + 2 * harness->latency / 1e3 + 0.25; now() < linger;) {
+        chip8_netplay_poll(netplay);
+        sleep_until(now() + 0.001);
+    }
+
+    struct chip8_netplay_stats stats;
+    struct chip8_hash hash = chip8_state_hash(chip8);
+    chip8_netplay_get_stats(netplay, &stats);
+    dprintf(output, "%d %016llx %016llx %u %u %u %u %u %u\n", settled, (unsigned long long)hash.low,
+            (unsigned long long)hash.high, stats.rollbacks, stats.resimulated, stats.stalls, stats.sent,
+            stats.received, stats.dropped);
+
+    chip8_netplay_free(netplay);
+    chip8_free(chip8);
+    return EXIT_SUCCESS;
+}
+
+/***
+ * The outcome both peers have to agree on: one machine fed both players' input directly.
+ */
+static struct chip8_hash
+reference(const struct harness *harness)
+{
+    uint16_t keyboard = 0;
+    struct chip8 *chip8 = chip8_init(&keyboard);
+
+    chip8_reset(chip8, SESSION);
+    chip8_load_program(chip8, harness->rom, harness->size);
+    for (uint32_t frame = 0; frame < harness->frames; frame++) {
+        keyboard = script(0, frame) | script(1, frame);
+        chip8_step(chip8);
+    }
+    struct chip8_hash hash = chip8_state_hash(chip8);
+    chip8_free(chip8);
+    return hash;
+}
+
+int
+main(int argc, char *argv[])
+{
+    static uint8_t rom[ROM_SIZE];
+    struct harness harness = {.rom = rom, .frames = 600, .fps = 60, .port = 7700, .latency = 40, .loss = 0.1f};
+    int opt;
+
+    while ((opt = getopt(argc, argv, "l:p:f:r:P:")) != -1) {
+        switch (opt) {
+            case 'l':
+                harness.latency = strtoul(optarg, NULL, 0);
+                break;
+            case 'p':
+                harness.loss = strtof(optarg, NULL);
+                break;
+            case 'f':
+                harness.frames = strtoul(optarg, NULL, 0);
+                break;
+            case 'r':
+                harness.fps = strtoul(optarg, NULL, 0);
+                break;
+            case 'P':
+                harness.port = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                usage();
+        }
+    }
+    if (optind != argc - 1 || harness.fps == 0 || harness.loss < 0 || harness.loss >= 1) {
+        usage();
+    }
+    harness.size = read_rom(argv[optind], rom);
+
+    int pipes[NETPLAY_PLAYERS][2];
+    pid_t children[NETPLAY_PLAYERS];
+    for (uint8_t player = 0; player < NETPLAY_PLAYERS; player++) {
+        if (pipe(pipes[player]) != 0 || (children[player] = fork()) < 0) {
+            perror("fork");
+            return EXIT_FAILURE;
+        }
+        if (children[player] == 0) {
+            close(pipes[player][0]);
+            _exit(peer(&harness, player, pipes[player][1]));
+        }
+        close(pipes[player][1]);
+    }
+
+    struct chip8_hash expected = reference(&harness);
+    bool match = true;
+    printf("%u frames at %u fps, %u ms one-way latency, %.0f%% loss\n", harness.frames, harness.fps,
+           harness.latency, harness.loss * 100);
+
+    for (uint8_t player = 0; player < NETPLAY_PLAYERS; player++) {
+        char line[256] = "";
+        FILE *fp = fdopen(pipes[player][0], "r");
+        int status;
+        int settled = 0;
+        unsigned long long low = 0, high = 0;
+        unsigned rollbacks = 0, resimulated = 0, stalls = 0, sent = 0, received = 0, dropped = 0;
+
+        if (fgets(line, sizeof(line), fp) == NULL ||
+            sscanf(line, "%d %llx %llx %u %u %u %u %u %u", &settled, &low, &high, &rollbacks, &resimulated,
+                   &stalls, &sent, &received, &dropped) != 9) {
+            settled = 0;
+        }
+        fclose(fp);
+        waitpid(children[player], &status, 0);
+
+        bool same = settled && low == expected.low && high == expected.high;
+        match = match && same;
+        printf("player %u: %s, %u rollbacks, %u frames resimulated, %u stalls, %u sent, %u received, %u dropped\n",
+               player + 1, same ? "state matches" : (settled ? "STATE DIFFERS" : "DID NOT SETTLE"), rollbacks,
+               resimulated, stalls, sent, received, dropped);
+    }
+    return match ? EXIT_SUCCESS : EXIT_FAILURE;
+}
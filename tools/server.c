@@ -0,0 +1,88 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../src/inc/chip8_memory.h"
+#include "../src/inc/chip8_server.h"
+#include "common.h"
+
+#define SOCKET_PATH "/tmp/chip8.sock"
+#define MAX_SESSIONS 4096
+#define REPORT_INTERVAL 1.0
+
+static volatile sig_atomic_t stop;
+
+static void
+usage(void)
+{
+    puts("Usage: chip8-server [-j workers] [-m max sessions] [-s socket] /path/to/rom");
+    exit(EXIT_FAILURE);
+}
+
+static void
+interrupt(int signal_number)
+{
+    (void)signal_number;
+    stop = 1;
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct chip8_server_config config = {SOCKET_PATH, 0, MAX_SESSIONS, 1};
+    int opt;
+
+    while ((opt = getopt(argc, argv, "j:m:s:")) != -1) {
+        switch (opt) {
+            case 'j':
+                config.workers = (uint16_t)strtoul(optarg, NULL, 0);
+                break;
+            case 'm':
+                config.max_sessions = (uint32_t)strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                config.path = optarg;
+                break;
+            default:
+                usage();
+        }
+    }
+    if (optind != argc - 1) {
+        usage();
+    }
+
+    static uint8_t rom[ROM_SIZE];
+    uint32_t size = read_rom(argv[optind], rom);
+    struct chip8_server *server = chip8_server_init(rom, size, &config);
+    if (server == NULL) {
+        printf("Cannot listen on %s\n", config.path);
+        return EXIT_FAILURE;
+    }
+    signal(SIGINT, interrupt);
+    signal(SIGTERM, interrupt);
+    printf("Listening on %s\n", config.path);
+
+    struct chip8_server_stats last = {0}, stats;
+    double reported = now();
+    while (!stop) {
+        chip8_server_poll(server, 100);
+        double elapsed = now() - reported;
+        if (elapsed < REPORT_INTERVAL) {
+            continue;
+        }
+        chip8_server_get_stats(server, &stats);
+        uint64_t frames = stats.frames - last.frames;
+        printf("sessions %u  frames/s %.0f  missed %.2f%%  dropped %llu  skipped %llu\n", stats.sessions,
+               frames / elapsed, frames ? 100.0 * (stats.missed - last.missed) / frames : 0.0,
+               (unsigned long long)(stats.dropped - last.dropped), (unsigned long long)(stats.skipped - last.skipped));
+        fflush(stdout);
+        last = stats;
+        reported += elapsed;
+    }
+
+    chip8_server_free(server);
+    return EXIT_SUCCESS;
+}
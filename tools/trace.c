@@ -0,0 +1,208 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/inc/chip8_trace.h"
+
+static void
+usage(void)
+{
+    puts("Usage: chip8-trace [-n last instructions] /path/to/trace");
+    exit(EXIT_FAILURE);
+}
+
+/***
+ * Cowgod's mnemonics, with the interpreter's reading of opcodes it does not know:
+ * 0nnn other than 00E0 returns and Ex other than 9E is SKNP.
+ */
+static void
+disassemble(uint16_t opcode, char *buffer, size_t size)
+{
+    unsigned x = (opcode >> 8u) & 0x0fu, y = (opcode >> 4u) & 0x0fu;
+    unsigned nnn = opcode & 0x0fffu, kk = opcode & 0x00ffu, n = opcode & 0x000fu;
+    static const char *const alu[] = {"LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN"};
+
+    switch (opcode >> 12u) {
+        case 0x0:
+            snprintf(buffer, size, opcode == 0x00e0 ? "CLS" : "RET");
+            return;
+        case 0x1:
+            snprintf(buffer, size, "JP 0x%03x", nnn);
+            return;
+        case 0x2:
+            snprintf(buffer, size, "CALL 0x%03x", nnn);
+            return;
+        case 0x3:
+            snprintf(buffer, size, "SE V%X, 0x%02x", x, kk);
+            return;
+        case 0x4:
+            snprintf(buffer, size, "SNE V%X, 0x%02x", x, kk);
+            return;
+        case 0x5:
+            snprintf(buffer, size, "SE V%X, V%X", x, y);
+            return;
+        case 0x6:
+            snprintf(buffer, size, "LD V%X, 0x%02x", x, kk);
+            return;
+        case 0x7:
+            snprintf(buffer, size, "ADD V%X, 0x%02x", x, kk);
+            return;
+        case 0x8:
+            if (n < 8) {
+                snprintf(buffer, size, "%s V%X, V%X", alu[n], x, y);
+            } else if (n == 0x0e) {
+                snprintf(buffer, size, "SHL V%X", x);
+            } else {
+                snprintf(buffer, size, "ILLEGAL");
+            }
+            return;
+        case 0x9:
+            snprintf(buffer, size, "SNE V%X, V%X", x, y);
+            return;
+        case 0xa:
+            snprintf(buffer, size, "LD I, 0x%03x", nnn);
+            return;
+        case 0xb:
+            snprintf(buffer, size, "JP V0, 0x%03x", nnn);
+            return;
+        case 0xc:
+            snprintf(buffer, size, "RND V%X, 0x%02x", x, kk);
+            return;
+        case 0xd:
+            snprintf(buffer, size, "DRW V%X, V%X, %u", x, y, n);
+            return;
+        case 0xe:
+            snprintf(buffer, size, "%s V%X", kk == 0x9e ? "SKP" : "SKNP", x);
+            return;
+    }
+    switch (kk) {
+        case 0x07:
+            snprintf(buffer, size, "LD V%X, DT", x);
+            return;
+        case 0x0a:
+            snprintf(buffer, size, "LD V%X, K", x);
+            return;
+        case 0x15:
+            snprintf(buffer, size, "LD DT, V%X", x);
+            return;
+        case 0x18:
+            snprintf(buffer, size, "LD ST, V%X", x);
+            return;
+        case 0x1e:
+            snprintf(buffer, size, "ADD I, V%X", x);
+            return;
+        case 0x29:
+            snprintf(buffer, size, "LD F, V%X", x);
+            return;
+        case 0x33:
+            snprintf(buffer, size, "LD B, V%X", x);
+            return;
+        case 0x55:
+            snprintf(buffer, size, "LD [I], V%X", x);
+            return;
+        case 0x65:
+            snprintf(buffer, size, "LD V%X, [I]", x);
+            return;
+    }
+    snprintf(buffer, size, "ILLEGAL");
+}
+
+/***
+ * The register the instruction wrote, and VF where it sets a flag
+ */
+static void
+effect(const struct chip8_trace_entry *entry, char *buffer, size_t size)
+{
+    uint16_t opcode = entry->opcode;
+    unsigned x = (opcode >> 8u) & 0x0fu, n = opcode & 0x000fu, kk = opcode & 0x00ffu;
+    bool flag = false, writes_x = false;
+
+    switch (opcode >> 12u) {
+        case 0x6:
+        case 0x7:
+        case 0xc:
+            writes_x = true;
+            break;
+        case 0x8:
+            writes_x = n < 8 || n == 0x0e;
+            flag = n >= 4 && writes_x;
+            break;
+        case 0xa:
+            snprintf(buffer, size, "I=0x%03x", entry->I);
+            return;
+        case 0xd:
+            flag = true;
+            break;
+        case 0xf:
+            writes_x = kk == 0x07 || kk == 0x0a || kk == 0x65;
+            if (kk == 0x1e || kk == 0x29) {
+                snprintf(buffer, size, "I=0x%03x", entry->I);
+                return;
+            }
+            break;
+    }
+
+    buffer[0] = '\0';
+    if (writes_x) {
+        snprintf(buffer, size, "V%X=0x%02x", x, entry->Vx);
+    }
+    if (flag && !(writes_x && x == 0x0f)) {
+        size_t used = strlen(buffer);
+        snprintf(buffer + used, size - used, "%sVF=0x%02x", used ? " " : "", entry->VF);
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    uint64_t last = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+            case 'n':
+                last = strtoull(optarg, NULL, 0);
+                break;
+            default:
+                usage();
+        }
+    }
+    if (optind != argc - 1) {
+        usage();
+    }
+
+    FILE *fp = fopen(argv[optind], "rb");
+    if (fp == NULL) {
+        puts("File does not exist!");
+        exit(EXIT_FAILURE);
+    }
+    struct chip8_trace_header header;
+    if (fread(&header, sizeof(header), 1, fp) != 1 || header.magic != TRACE_MAGIC ||
+        header.version != TRACE_VERSION || header.entry_size != sizeof(struct chip8_trace_entry)) {
+        puts("Not a trace written by this version!");
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t count = header.total < header.capacity ? header.total : header.capacity;
+    uint64_t skip = last && last < count ? count - last : 0;
+    struct chip8_trace_entry entry;
+
+    printf("%llu instructions recorded, showing the last %llu\n", (unsigned long long)header.total,
+           (unsigned long long)(count - skip));
+    printf("%12s  %-5s  %-4s  %-20s%s\n", "#", "PC", "op", "instruction", "wrote");
+    for (uint64_t i = 0; i < count && fread(&entry, sizeof(entry), 1, fp) == 1; i++) {
+        char text[32], wrote[32];
+        if (i < skip) {
+            continue;
+        }
+        disassemble(entry.opcode, text, sizeof(text));
+        effect(&entry, wrote, sizeof(wrote));
+        printf("%12llu  0x%03x  %04x  %-*s%s\n", (unsigned long long)(header.total - count + i), entry.pc,
+               entry.opcode, wrote[0] ? 20 : 0, text, wrote);
+    }
+    fclose(fp);
+    return EXIT_SUCCESS;
+}
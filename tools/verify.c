@@ -0,0 +1,573 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/inc/chip8.h"
+#include "../src/inc/chip8_aot.h"
+#include "../src/inc/chip8_memory.h"
+#include "../src/inc/chip8_state.h"
+#include "../src/inc/chip8_threaded.h"
+#include "common.h"
+
+#define VERIFY_FRAMES 3600
+#define VERIFY_SEED 1
+#define VERIFY_MAGIC 0x56473843u      /* "C8GV" */
+#define VERIFY_VERSION 1
+#define DIFF_BYTES 16                   /* Differing memory bytes listed before summarizing */
+
+/*
+ * Machine state after one instruction of the reference run, the last instruction of a frame
+ * is recorded after the timers ticked. Memory and display are only kept as checksums.
+ */
+struct verify_record {
+    uint16_t PC;
+    uint16_t I;
+    uint8_t V[V_REGISTERS];
+    uint8_t SP;
+    uint8_t DT;
+    uint8_t ST;
+    uint8_t flags;              /* waiting | fault << 1 */
+    uint32_t memory;
+    uint32_t display;
+};
+
+struct verify_header {
+    uint32_t magic;             /* VERIFY_MAGIC */
+    uint32_t version;           /* VERIFY_VERSION */
+    uint32_t record_size;
+    uint32_t rom;               /* Checksum of the ROM the trace was recorded from */
+    uint32_t frames;
+    uint32_t count;             /* Records, less than frames * CYCLES_PER_FRAME if the reference faulted */
+};
+
+/* Lets the reference run skip rehashing memory and display an instruction left alone */
+struct verify_cache {
+    bool valid;
+    uint32_t memory_version;
+    uint32_t effects;
+    uint32_t memory;
+    uint32_t display;
+};
+
+struct verify_rom {
+    const char *path;
+    uint8_t data[ROM_SIZE];
+    uint32_t size;
+    struct verify_header header;
+    struct verify_record *records;
+};
+
+static void
+usage(void)
+{
+    puts("Usage: chip8-verify [-e interpreter|threaded|aot] [-a module directory] [-f frames] /path/to/rom...\n"
+         "       chip8-verify -w golden [-f frames] /path/to/rom\n"
+         "       chip8-verify -g golden [-e engine] [-a module directory] /path/to/rom");
+    exit(EXIT_FAILURE);
+}
+
+static uint32_t
+checksum(const void *data, size_t size)
+{
+    const uint8_t *bytes = data;
+    uint32_t hash = 0x811c9dc5u;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x01000193u;
+    }
+    return hash;
+}
+
+/***
+ * Candidates are always hashed in full, their memory_version and effects are not trusted.
+ */
+static void
+snapshot(const struct chip8 *chip8, struct verify_cache *cache, struct verify_record *record)
+{
+    const struct chip8_registers *registers = chip8->registers;
+
+    if (!cache->valid || cache->memory_version != chip8->memory_version) {
+        struct chip8_hash hash = chip8_state_hash_memory(chip8->memory);
+        cache->memory = (uint32_t)(hash.low ^ hash.low >> 32u ^ hash.high);
+    }
+    if (!cache->valid || cache->effects != chip8->effects) {
+        cache->display = checksum(chip8->display->display, sizeof(chip8->display->display));
+    }
+    cache->valid = true;
+    cache->memory_version = chip8->memory_version;
+    cache->effects = chip8->effects;
+
+    memset(record, 0, sizeof(*record));
+    record->PC = registers->PC;
+    record->I = registers->I;
+    memcpy(record->V, registers->V, sizeof(record->V));
+    record->SP = registers->SP;
+    record->DT = registers->DT;
+    record->ST = registers->ST;
+    record->flags = chip8->waiting | chip8->fault << 1u;
+    record->memory = cache->memory;
+    record->display = cache->display;
+}
+
+static bool
+matches(const struct chip8 *chip8, const struct verify_record *expected)
+{
+    struct verify_cache cache = {0};
+    struct verify_record actual;
+    snapshot(chip8, &cache, &actual);
+    return memcmp(&actual, expected, sizeof(actual)) == 0;
+}
+
+static struct chip8 *
+boot(const struct verify_rom *rom, uint16_t *keyboard)
+{
+    struct chip8 *chip8 = chip8_init(keyboard);
+    chip8_reset(chip8, VERIFY_SEED);
+    chip8_load_program(chip8, rom->data, rom->size);
+    return chip8;
+}
+
+/***
+ * The interpreter one instruction at a time, without idle detection, until `stop` instructions
+ * executed, the scripted frames ran out or the machine faulted.
+ * @param records - receives every instruction's state if not NULL
+ * @param address - receives the address of the last instruction executed
+ */
+static struct chip8 *
+reference(const struct verify_rom *rom, uint32_t frames, uint32_t stop, struct verify_record *records,
+          uint32_t *count, uint16_t *keyboard, uint16_t *address)
+{
+    struct chip8 *chip8 = boot(rom, keyboard);
+    struct verify_cache cache = {0};
+
+    *count = 0;
+    for (uint32_t frame = 0; frame < frames && !chip8->fault && *count < stop; frame++) {
+        *keyboard = verify_keys(frame);
+        for (uint32_t cycle = 0; cycle < CYCLES_PER_FRAME && !chip8->fault && *count < stop; cycle++) {
+            *address = chip8->registers->PC;
+            chip8_cycle(chip8);
+            if (cycle == CYCLES_PER_FRAME - 1 || chip8->fault) {
+                chip8_tick(chip8);
+            }
+            if (records) {
+                snapshot(chip8, &cache, &records[*count]);
+            }
+            (*count)++;
+        }
+    }
+    return chip8;
+}
+
+static void
+record(struct verify_rom *rom, uint32_t frames)
+{
+    uint16_t keyboard, address;
+    uint32_t count;
+
+    rom->records = malloc((size_t)frames * CYCLES_PER_FRAME * sizeof(*rom->records));
+    if (rom->records == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+    chip8_free(reference(rom, frames, UINT32_MAX, rom->records, &count, &keyboard, &address));
+
+    rom->header.magic = VERIFY_MAGIC;
+    rom->header.version = VERIFY_VERSION;
+    rom->header.record_size = sizeof(struct verify_record);
+    rom->header.rom = checksum(rom->data, rom->size);
+    rom->header.frames = frames;
+    rom->header.count = count;
+}
+
+static bool
+write_golden(const struct verify_rom *rom, const char *path)
+{
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL) {
+        return false;
+    }
+    bool written = fwrite(&rom->header, sizeof(rom->header), 1, fp) == 1 &&
+                   fwrite(rom->records, sizeof(*rom->records), rom->header.count, fp) == rom->header.count;
+    return fclose(fp) == 0 && written;
+}
+
+static bool
+read_golden(struct verify_rom *rom, const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        puts("File does not exist!");
+        return false;
+    }
+    struct verify_header *header = &rom->header;
+    if (fread(header, sizeof(*header), 1, fp) != 1 || header->magic != VERIFY_MAGIC ||
+        header->version != VERIFY_VERSION || header->record_size != sizeof(struct verify_record) ||
+        header->count > (uint64_t)header->frames * CYCLES_PER_FRAME) {
+        puts("Not a golden trace written by this version!");
+        fclose(fp);
+        return false;
+    }
+    if (header->rom != checksum(rom->data, rom->size)) {
+        printf("%s was recorded from a different ROM\n", path);
+        fclose(fp);
+        return false;
+    }
+    rom->records = malloc((header->count ? header->count : 1) * sizeof(*rom->records));
+    if (rom->records == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+    bool read = fread(rom->records, sizeof(*rom->records), header->count, fp) == header->count;
+    fclose(fp);
+    if (!read) {
+        puts("Golden trace is truncated!");
+    }
+    return read;
+}
+
+static void
+diff_field(const char *name, unsigned expected, unsigned actual, int width)
+{
+    if (expected != actual) {
+        printf("    %-8s 0x%0*x  0x%0*x\n", name, width, expected, width, actual);
+    }
+}
+
+/***
+ * Prints every difference between the golden record and the candidate, then memory, stack and
+ * display against this build's interpreter re-run up to the same instruction.
+ */
+static void
+report(const struct verify_rom *rom, const char *engine, uint32_t index, const struct chip8 *candidate,
+       const char *context)
+{
+    const struct verify_record *golden = &rom->records[index];
+    struct verify_cache cache = {0};
+    struct verify_record actual;
+    char name[8];
+    uint16_t keyboard, address = PROGRAM_START_ADDR;
+    uint32_t count;
+
+    struct chip8 *expected = reference(rom, rom->header.frames, index + 1, NULL, &count, &keyboard, &address);
+    snapshot(candidate, &cache, &actual);
+
+    printf("%s %s: diverged at instruction %u (frame %u, cycle %u)%s, 0x%03x %04x\n", rom->path, engine, index,
+           index / CYCLES_PER_FRAME, index % CYCLES_PER_FRAME, context, address,
+           chip8_memory_fetch(expected->memory, address));
+    printf("    %-8s %-6s  %s\n", "", "golden", engine);
+    diff_field("PC", golden->PC, actual.PC, 3);
+    diff_field("I", golden->I, actual.I, 3);
+    for (unsigned x = 0; x < V_REGISTERS; x++) {
+        snprintf(name, sizeof(name), "V%X", x);
+        diff_field(name, golden->V[x], actual.V[x], 2);
+    }
+    diff_field("SP", golden->SP, actual.SP, 2);
+    diff_field("DT", golden->DT, actual.DT, 2);
+    diff_field("ST", golden->ST, actual.ST, 2);
+    diff_field("waiting", golden->flags & 1u, actual.flags & 1u, 1);
+    diff_field("fault", golden->flags >> 1u, actual.flags >> 1u, 1);
+
+    /* The golden trace only keeps checksums, the contents come from re-executing the reference */
+    cache.valid = false;
+    snapshot(expected, &cache, &actual);
+    if (memcmp(&actual, golden, sizeof(actual)) != 0) {
+        printf("    this build's interpreter disagrees with the golden trace here as well\n");
+    }
+    uint32_t differing = 0;
+    for (uint32_t at = 0; at < MEMORY_SIZE; at++) {
+        uint8_t want = chip8_memory_get(expected->memory, at), got = chip8_memory_get(candidate->memory, at);
+        if (want != got && differing++ < DIFF_BYTES) {
+            snprintf(name, sizeof(name), "[%03x]", at);
+            diff_field(name, want, got, 2);
+        }
+    }
+    if (differing > DIFF_BYTES) {
+        printf("    ... %u memory bytes differ\n", differing);
+    }
+    for (uint32_t i = 0; i < STACK_SIZE; i++) {
+        snprintf(name, sizeof(name), "stack%u", i);
+        diff_field(name, expected->stack->stack[i], candidate->stack->stack[i], 3);
+    }
+    for (uint32_t row = 0; row < DISPLAY_HEIGHT; row++) {
+        if (expected->display->display[row] != candidate->display->display[row]) {
+            printf("    row %-4u %016llx  %016llx\n", row, (unsigned long long)expected->display->display[row],
+                   (unsigned long long)candidate->display->display[row]);
+        }
+    }
+    chip8_free(expected);
+}
+
+/***
+ * Executes one instruction of the candidate, the interpreter's when engine is NULL.
+ */
+static void
+single_step(struct chip8_engine *engine, struct chip8 *chip8)
+{
+    if (engine) {
+        engine->run(engine, chip8, 1);
+    } else {
+        chip8_cycle(chip8);
+    }
+}
+
+/***
+ * Replays a batch that ended in the wrong state one instruction at a time from the state it
+ * started in, to name the first instruction that went wrong. Batches can diverge without any
+ * of their instructions doing so on their own, superinstructions and idle detection only
+ * apply to longer runs, so the batch is reported as a whole then.
+ */
+static void
+pinpoint(const struct verify_rom *rom, const char *name, struct chip8_engine *engine, struct chip8 *chip8,
+         const struct chip8_state *before, uint32_t start, uint32_t end, uint32_t frame_end)
+{
+    struct chip8_state after;
+    chip8_state_save(chip8, &after);
+    chip8_state_load(chip8, before);
+
+    for (uint32_t index = start; index <= end && index < rom->header.count; index++) {
+        single_step(engine, chip8);
+        if (index == frame_end || chip8->fault) {
+            chip8_tick(chip8);
+        }
+        if (!matches(chip8, &rom->records[index])) {
+            report(rom, name, index, chip8, "");
+            return;
+        }
+    }
+    char context[64] = "";
+    if (start != end) {
+        snprintf(context, sizeof(context), ", only when %u..%u run as one batch", start, end);
+    }
+    chip8_state_load(chip8, &after);
+    report(rom, name, end, chip8, context);
+}
+
+/***
+ * Replays the scripted input through the candidate and compares its state with the golden
+ * record after every batch it executes: every frame for the interpreter, every call to run()
+ * for engines, which end batches at jumps, key waits and writes to code.
+ */
+static bool
+replay(const struct verify_rom *rom, const char *name, struct chip8_engine *engine, uint32_t *batches)
+{
+    const struct verify_header *header = &rom->header;
+    uint16_t keyboard = 0;
+    struct chip8 *chip8 = boot(rom, &keyboard);
+    struct chip8_state before;
+    bool ok = true;
+
+    *batches = 0;
+    for (uint32_t frame = 0; frame < header->frames && !chip8->fault && ok; frame++) {
+        uint32_t base = frame * CYCLES_PER_FRAME, frame_end = base + CYCLES_PER_FRAME - 1;
+        keyboard = verify_keys(frame);
+
+        for (uint32_t cycles = 0; cycles < CYCLES_PER_FRAME && !chip8->fault && ok;) {
+            chip8_state_save(chip8, &before);
+            uint32_t executed = CYCLES_PER_FRAME;
+            if (engine) {
+                executed = engine->run(engine, chip8, CYCLES_PER_FRAME - cycles);
+            } else {
+                chip8_step(chip8);
+            }
+            uint32_t start = base + cycles;
+            cycles += executed;
+            (*batches)++;
+
+            /* A faulting instruction is the last one recorded, whether or not run() counted it */
+            uint32_t end = chip8->fault && header->count ? header->count - 1 : base + cycles - 1;
+            bool frame_done = cycles >= CYCLES_PER_FRAME || chip8->waiting || chip8->fault;
+            if (engine && frame_done) {
+                /* The reference executes Fx0A for the rest of the frame without changing anything */
+                if (end < frame_end && !chip8->fault &&
+                    (end >= header->count || !matches(chip8, &rom->records[end]))) {
+                    end = end < header->count ? end : header->count - 1;
+                    pinpoint(rom, name, engine, chip8, &before, start, end, frame_end);
+                    ok = false;
+                    break;
+                }
+                chip8_tick(chip8);
+                if (!chip8->fault) {
+                    end = frame_end;
+                }
+            }
+            if (end >= header->count) {
+                printf("%s %s: still running at instruction %u, the reference faulted at %u\n", rom->path, name,
+                       end, header->count - 1);
+                ok = false;
+            } else if (!matches(chip8, &rom->records[end])) {
+                pinpoint(rom, name, engine, chip8, &before, start < end ? start : end, end, frame_end);
+                ok = false;
+            }
+            cycles = frame_done ? CYCLES_PER_FRAME : cycles;
+        }
+    }
+    if (ok && !chip8->fault && (uint64_t)header->frames * CYCLES_PER_FRAME != header->count) {
+        printf("%s %s: never faulted, the reference faulted at instruction %u\n", rom->path, name,
+               header->count - 1);
+        ok = false;
+    }
+    chip8_free(chip8);
+    return ok;
+}
+
+/***
+ * This build's interpreter against a golden trace recorded by another build, every instruction.
+ */
+static bool
+compare_reference(const struct verify_rom *rom)
+{
+    struct verify_record *records = malloc((size_t)rom->header.frames * CYCLES_PER_FRAME * sizeof(*records));
+    uint16_t keyboard, address;
+    uint32_t count, executed;
+
+    if (records == NULL) {
+        puts("Error allocating memory!");
+        exit(EXIT_FAILURE);
+    }
+    chip8_free(reference(rom, rom->header.frames, UINT32_MAX, records, &count, &keyboard, &address));
+
+    bool ok = true;
+    for (uint32_t index = 0; index < count && index < rom->header.count && ok; index++) {
+        if (memcmp(&records[index], &rom->records[index], sizeof(*records)) != 0) {
+            struct chip8 *chip8 = reference(rom, rom->header.frames, index + 1, NULL, &executed, &keyboard,
+                                            &address);
+            report(rom, "reference", index, chip8, "");
+            chip8_free(chip8);
+            ok = false;
+        }
+    }
+    if (ok && count != rom->header.count) {
+        printf("%s reference: %u instructions, the golden trace has %u\n", rom->path, count, rom->header.count);
+        ok = false;
+    }
+    free(records);
+    return ok;
+}
+
+static struct chip8_engine *
+load_engine(const char *name, const char *rom, const char *modules)
+{
+    if (strcmp(name, "threaded") == 0) {
+        return chip8_threaded_init();
+    }
+    /* chip8-aot output for roms/Pong.ch8 is built as <modules>/Pong.so */
+    const char *base = strrchr(rom, '/') ? strrchr(rom, '/') + 1 : rom;
+    const char *extension = strrchr(base, '.');
+    int length = extension ? (int)(extension - base) : (int)strlen(base);
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%.*s.so", modules, length, base);
+
+    struct chip8_engine *engine = chip8_aot_load(path);
+    if (engine == NULL) {
+        printf("Cannot load %s\n", path);
+    }
+    return engine;
+}
+
+static bool
+verify(struct verify_rom *rom, const char *name, const char *modules)
+{
+    struct chip8_engine *engine = NULL;
+    uint32_t batches = 0;
+    double start = now();
+    bool ok;
+
+    if (strcmp(name, "reference") == 0) {
+        ok = compare_reference(rom);
+        batches = rom->header.count;
+    } else if (strcmp(name, "interpreter") != 0 && (engine = load_engine(name, rom->path, modules)) == NULL) {
+        ok = false;
+    } else {
+        ok = replay(rom, name, engine, &batches);
+    }
+    if (ok) {
+        printf("%-28s %-11s %9u instructions %7u batches  ok  %7.1f ms\n", rom->path, name, rom->header.count,
+               batches, (now() - start) * 1e3);
+    }
+    if (engine) {
+        engine->free(engine);
+    }
+    return ok;
+}
+
+int
+main(int argc, char *argv[])
+{
+    const char *engine = NULL;
+    const char *modules = NULL;
+    const char *golden = NULL;
+    const char *output = NULL;
+    long frames = VERIFY_FRAMES;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "e:a:f:g:w:")) != -1) {
+        switch (opt) {
+            case 'e':
+                engine = optarg;
+                break;
+            case 'a':
+                modules = optarg;
+                break;
+            case 'f':
+                frames = strtol(optarg, NULL, 0);
+                break;
+            case 'g':
+                golden = optarg;
+                break;
+            case 'w':
+                output = optarg;
+                break;
+            default:
+                usage();
+        }
+    }
+    if (optind == argc || frames < 1 || frames > UINT32_MAX / CYCLES_PER_FRAME ||
+        ((golden || output) && optind != argc - 1) || (golden && output)) {
+        usage();
+    }
+    if (engine && strcmp(engine, "interpreter") != 0 && strcmp(engine, "threaded") != 0 &&
+        strcmp(engine, "aot") != 0) {
+        usage();
+    }
+    if (engine && strcmp(engine, "aot") == 0 && modules == NULL) {
+        usage();
+    }
+
+    static struct verify_rom rom;
+    bool ok = true;
+    for (int i = optind; i < argc; i++) {
+        rom.path = argv[i];
+        rom.size = read_rom(rom.path, rom.data);
+        if (golden) {
+            if (!read_golden(&rom, golden)) {
+                return EXIT_FAILURE;
+            }
+            ok = verify(&rom, "reference", modules) && ok;
+        } else {
+            record(&rom, frames);
+        }
+        if (output) {
+            if (!write_golden(&rom, output)) {
+                perror(output);
+                return EXIT_FAILURE;
+            }
+            printf("%s: %u instructions over %u frames\n", output, rom.header.count, rom.header.frames);
+            return EXIT_SUCCESS;
+        }
+
+        if (engine) {
+            ok = verify(&rom, engine, modules) && ok;
+        } else {
+            ok = verify(&rom, "interpreter", modules) && ok;
+            ok = verify(&rom, "threaded", modules) && ok;
+            if (modules) {
+                ok = verify(&rom, "aot", modules) && ok;
+            }
+        }
+        free(rom.records);
+        rom.records = NULL;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}